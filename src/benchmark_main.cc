@@ -0,0 +1,36 @@
+using namespace std;
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "types.h"
+#include "benchmark_program.h"
+#include "omp_facade.h"
+
+
+int main(int argc, char **argv) {
+    struct mcmc_options opt;
+
+    if((argc < 4) or (argc > 6)) {
+        fprintf(stderr, "Usage: %s pedfile mapfile datfile [iterations] [threads]\n"
+                        "       (zero iterations only runs the microbenchmarks)\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    opt.iterations = (argc > 4) ? atoi(argv[4]) : 1000;
+    opt.burnin = opt.iterations / 10;
+    opt.thread_count = (argc > 5) ? atoi(argv[5]) : DEFAULT_THREAD_COUNT;
+
+    // zero iterations runs just the microbenchmarks
+    if((opt.iterations < 0) or (opt.thread_count < 1)) {
+        fprintf(stderr, "Error: iterations must be non-negative and threads must be a positive integer\n");
+        return EXIT_FAILURE;
+    }
+
+    set_num_threads(opt.thread_count);
+
+    BenchmarkProgram bp(argv[1], argv[2], argv[3], opt);
+
+    return bp.run() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
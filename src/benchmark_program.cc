@@ -0,0 +1,372 @@
+using namespace std;
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include "benchmark_program.h"
+#include "descent_graph.h"
+#include "markov_chain.h"
+#include "peel_sequence_generator.h"
+#include "sequential_imputation.h"
+#include "lod_score.h"
+#include "random.h"
+#include "omp_facade.h"
+#include "convergence.h"
+#include "founder_allele_graph4.h"
+#include "founder_allele_graph_block.h"
+#include "meiosis_sampler.h"
+
+
+// the sum stops the compiler optimising the loops away
+static int benchmark_sink = 0;
+
+
+double BenchmarkProgram::time_chain(Pedigree& p, DescentGraph& dg, PeelSequenceGenerator& psg, bool use_pool, enum graph_layout layout) {
+    struct mcmc_options tmp_options = options;
+    DescentGraph tmp(dg);
+    double start_time;
+    
+    tmp_options.use_pool = use_pool;
+    tmp_options.graph_layout = layout;
+    tmp.set_layout(layout);
+
+    MarkovChain chain(&p, &map, &psg, tmp_options, 0);
+
+    start_time = get_wtime();
+    LODscores* lod = chain.run(tmp);
+    double run_time = get_wtime() - start_time;
+
+    delete lod;
+
+    return run_time;
+}
+
+// the likelihood is only worked out between steps, so it is not timed and 
+// nothing is scored
+double BenchmarkProgram::time_mixing(Pedigree& p, DescentGraph& dg, PeelSequenceGenerator& psg, double block_prob, double& ess) {
+    struct mcmc_options tmp_options = options;
+    DescentGraph tmp(dg);
+    ConvergenceDiagnostics trace(1);
+    double run_time = 0.0;
+    
+    tmp_options.block_prob = block_prob;
+    tmp_options.burnin = options.iterations;
+
+    MarkovChain chain(&p, &map, &psg, tmp_options, 0);
+
+    for(int i = 0; i < options.iterations; ++i) {
+        double start_time = get_wtime();
+        chain.step(tmp, i, 1);
+        run_time += (get_wtime() - start_time);
+
+        trace.add(0, chain.get_likelihood(tmp));
+    }
+
+    ess = trace.ess();
+
+    return run_time;
+}
+
+// what MeiosisSampler::step_sample() does
+double BenchmarkProgram::time_meiosis_walk(Pedigree& p, DescentGraph& dg, int repeats) {
+    int sum = 0;
+    
+    double start_time = get_wtime();
+    
+    for(int r = 0; r < repeats; ++r) {
+        for(unsigned i = p.num_founders(); i < p.num_members(); ++i) {
+            for(int j = 0; j < 2; ++j) {
+                for(unsigned k = 0; k < map.num_markers(); ++k) {
+                    sum += dg.get(i, k, static_cast<enum parentage>(j));
+                }
+            }
+        }
+    }
+    
+    double run_time = get_wtime() - start_time;
+    
+    benchmark_sink += sum;
+    
+    return run_time;
+}
+
+// what LocusSampler::step() and the lod scores do
+double BenchmarkProgram::time_locus_walk(Pedigree& p, DescentGraph& dg, int repeats) {
+    int sum = 0;
+    
+    double start_time = get_wtime();
+    
+    for(int r = 0; r < repeats; ++r) {
+        for(unsigned k = 0; k < map.num_markers(); ++k) {
+            for(unsigned i = p.num_founders(); i < p.num_members(); ++i) {
+                for(int j = 0; j < 2; ++j) {
+                    sum += dg.get(i, k, static_cast<enum parentage>(j));
+                }
+            }
+        }
+    }
+    
+    double run_time = get_wtime() - start_time;
+    
+    benchmark_sink += sum;
+    
+    return run_time;
+}
+
+// average time of one FounderAlleleGraph4::likelihood() call over every
+// locus, the founder allele graph is evaluated for every locus of every
+// meiosis in each meiosis sampler sweep
+double BenchmarkProgram::time_founder_allele_graph(Pedigree& p, DescentGraph& dg) {
+    FounderAlleleGraph4 f(&p, &map, options.sex_linked);
+    double sum = 0.0;
+    int repeats = max(1, int(1e8 / (double(p.num_members()) * map.num_markers())));
+    double run_time = 0.0;
+    
+    f.set_sequence(dg.get_founderallelegraph_ordering());
+    
+    for(unsigned k = 0; k < map.num_markers(); ++k) {
+        f.set_locus(k);
+        f.reset(dg);
+        
+        double start_time = get_wtime();
+        
+        // set_locus() stops likelihood() reusing the last result
+        for(int r = 0; r < repeats; ++r) {
+            f.set_locus(k);
+            sum += f.likelihood();
+        }
+        
+        run_time += (get_wtime() - start_time);
+    }
+    
+    benchmark_sink += (sum < 0.0) ? 1 : 0;
+    
+    return run_time / (double(repeats) * map.num_markers());
+}
+
+// the same as time_founder_allele_graph(), but with every locus reset and
+// evaluated FOUNDERALLELEGRAPH_BLOCK at a time, per locus
+double BenchmarkProgram::time_founder_allele_block(Pedigree& p, DescentGraph& dg) {
+    vector<FounderAlleleGraph4> graphs(map.num_markers(), FounderAlleleGraph4(&p, &map, options.sex_linked));
+    vector<FounderAlleleGraph4*> ptrs(map.num_markers());
+    double probs[FOUNDERALLELEGRAPH_BLOCK];
+    FounderAlleleGraphBlock fb(&p);
+    double sum = 0.0;
+    int repeats = max(1, int(1e8 / (double(p.num_members()) * map.num_markers())));
+    
+    fb.set_sequence(dg.get_founderallelegraph_ordering());
+    
+    for(unsigned k = 0; k < map.num_markers(); ++k) {
+        graphs[k].set_locus(k);
+        ptrs[k] = &graphs[k];
+    }
+    
+    double start_time = get_wtime();
+    
+    for(int r = 0; r < repeats; ++r) {
+        for(unsigned k = 0; k < map.num_markers(); k += FOUNDERALLELEGRAPH_BLOCK) {
+            int count = min(FOUNDERALLELEGRAPH_BLOCK, int(map.num_markers() - k));
+            
+            fb.evaluate(dg, &ptrs[k], count, probs);
+            
+            for(int j = 0; j < count; ++j) {
+                sum += probs[j];
+            }
+        }
+    }
+    
+    double run_time = get_wtime() - start_time;
+    
+    benchmark_sink += (sum < 0.0) ? 1 : 0;
+    
+    return run_time / (double(repeats) * map.num_markers());
+}
+
+// the same as time_founder_allele_block(), one locus at a time
+double BenchmarkProgram::time_founder_allele_reset(Pedigree& p, DescentGraph& dg) {
+    FounderAlleleGraph4 f(&p, &map, options.sex_linked);
+    double sum = 0.0;
+    int repeats = max(1, int(1e8 / (double(p.num_members()) * map.num_markers())));
+    
+    f.set_sequence(dg.get_founderallelegraph_ordering());
+    
+    double start_time = get_wtime();
+    
+    for(int r = 0; r < repeats; ++r) {
+        for(unsigned k = 0; k < map.num_markers(); ++k) {
+            f.set_locus(k);
+            f.reset(dg);
+            sum += f.likelihood();
+        }
+    }
+    
+    double run_time = get_wtime() - start_time;
+    
+    benchmark_sink += (sum < 0.0) ? 1 : 0;
+    
+    return run_time / (double(repeats) * map.num_markers());
+}
+
+// average time of one FounderAlleleGraph4::flip_likelihood() call, every 
+// meiosis is tried at every locus as in a meiosis sampler sweep
+double BenchmarkProgram::time_founder_allele_flip(Pedigree& p, DescentGraph& dg) {
+    FounderAlleleGraph4 f(&p, &map, options.sex_linked);
+    double sum = 0.0;
+    int meioses = 2 * (p.num_members() - p.num_founders());
+    int repeats = max(1, int(1e7 / (double(p.num_members()) * map.num_markers())));
+    double run_time = 0.0;
+    
+    if(meioses == 0) {
+        return 0.0;
+    }
+    
+    f.set_sequence(dg.get_founderallelegraph_ordering());
+    
+    for(unsigned k = 0; k < map.num_markers(); ++k) {
+        f.set_locus(k);
+        f.reset(dg);
+        f.likelihood();
+        
+        double start_time = get_wtime();
+        
+        for(int r = 0; r < repeats; ++r) {
+            for(int j = 0; j < meioses; ++j) {
+                sum += f.flip_likelihood(dg, p.num_founders() + (j / 2), static_cast<enum parentage>(j % 2));
+            }
+        }
+        
+        run_time += (get_wtime() - start_time);
+    }
+    
+    benchmark_sink += (sum < 0.0) ? 1 : 0;
+    
+    return run_time / (double(repeats) * meioses * map.num_markers());
+}
+
+// MeiosisSampler::reset() on a graph it has not seen before, then on the
+// same graph again, when only loci that have changed are rebuilt
+void BenchmarkProgram::time_meiosis_reset(Pedigree& p, DescentGraph& dg, double& first, double& unchanged) {
+    MeiosisSampler ms(&p, &map, options.sex_linked);
+    DescentGraph tmp(dg);
+    int repeats = 100;
+    
+    double start_time = get_wtime();
+    ms.reset(tmp, 0);
+    first = get_wtime() - start_time;
+    
+    start_time = get_wtime();
+    
+    for(int r = 0; r < repeats; ++r) {
+        ms.reset(tmp, 0);
+    }
+    
+    unchanged = (get_wtime() - start_time) / repeats;
+}
+
+bool BenchmarkProgram::run() {
+    
+    init_random();
+    if(options.random_filename == "") {
+        seed_random_implicit();
+    }
+    else {
+        seed_random_explicit(options.random_filename);
+    }
+
+    options.sex_linked = dm.is_sexlinked();
+    
+    for(unsigned int i = 0; i < pedigrees.size(); ++i) {
+        Pedigree& p = pedigrees[i];
+
+        DescentGraph dg(&p, &map, dm.is_sexlinked());
+        dg.random_descentgraph();
+        
+        printf("%s\t%d founder alleles\tfounder allele graph = %.3fus/call\tflip = %.3fus/call\n",
+                p.get_id().c_str(),
+                2 * p.num_founders(),
+                time_founder_allele_graph(p, dg) * 1e6,
+                time_founder_allele_flip(p, dg) * 1e6);
+        
+        printf("%s\tfounder allele graph reset + likelihood = %.3fus/locus\tin blocks of %d = %.3fus/locus\n",
+                p.get_id().c_str(),
+                time_founder_allele_reset(p, dg) * 1e6,
+                FOUNDERALLELEGRAPH_BLOCK,
+                time_founder_allele_block(p, dg) * 1e6);
+        
+        double reset_first, reset_unchanged;
+        
+        time_meiosis_reset(p, dg, reset_first, reset_unchanged);
+        
+        printf("%s\tmeiosis sampler reset = %.3fms\tunchanged = %.3fms\n",
+                p.get_id().c_str(),
+                reset_first * 1e3,
+                reset_unchanged * 1e3);
+        
+        // microbenchmarks only
+        if(options.iterations == 0) {
+            continue;
+        }
+
+        PeelSequenceGenerator psg(&p, &map, dm.is_sexlinked(), options.verbose);
+        psg.build_peel_sequence(options.peelopt_iterations);
+
+        SequentialImputation si(&p, &map, &psg, dm.is_sexlinked());
+        si.parallel_run(dg, options.si_iterations);
+        
+        if(dg.get_likelihood() == LOG_ZERO) {
+            fprintf(stderr, "error, bad descent graph %s:%d\n", __FILE__, __LINE__);
+            abort();
+        }
+
+        double omp_time = time_chain(p, dg, psg, false, LOCUS_MAJOR);
+        double pool_time = time_chain(p, dg, psg, true, LOCUS_MAJOR);
+
+        printf("%s\t%d threads\tomp = %.3fs\tpool = %.3fs\tspeedup = %.2f\n", 
+                p.get_id().c_str(), 
+                options.thread_count, 
+                omp_time, 
+                pool_time, 
+                omp_time / pool_time);
+        
+        // half of the meiosis sampler steps replaced by block sampler steps
+        double block_prob = (1.0 - options.lsampler_prob) / 2.0;
+        double m_ess, b_ess;
+        double m_time = time_mixing(p, dg, psg, 0.0, m_ess);
+        double b_time = time_mixing(p, dg, psg, block_prob, b_ess);
+
+        printf("%s\tblock sampler prob\tlikelihood ESS\tsampling time\tESS/s\n"
+               "%s\t%.3f\t\t%.1f\t\t%.3fs\t\t%.2f\n"
+               "%s\t%.3f\t\t%.1f\t\t%.3fs\t\t%.2f\n",
+                p.get_id().c_str(),
+                p.get_id().c_str(), 0.0, m_ess, m_time, m_ess / m_time,
+                p.get_id().c_str(), block_prob, b_ess, b_time, b_ess / b_time);
+        
+        // enough repeats to touch ~10^9 bits
+        int repeats = max(1, int(1e9 / (double(2 * p.num_members()) * map.num_markers())));
+        DescentGraph by_meiosis(dg);
+        
+        by_meiosis.set_layout(MEIOSIS_MAJOR);
+        
+        double locus_mwalk = time_meiosis_walk(p, dg, repeats);
+        double locus_lwalk = time_locus_walk(p, dg, repeats);
+        double meiosis_mwalk = time_meiosis_walk(p, by_meiosis, repeats);
+        double meiosis_lwalk = time_locus_walk(p, by_meiosis, repeats);
+        double meiosis_time = time_chain(p, dg, psg, true, MEIOSIS_MAJOR);
+        
+        printf("%s\tlayout\tmeiosis walk\tlocus walk\tchain\n"
+               "%s\tlocus  \t%.3fs\t\t%.3fs\t\t%.3fs\n"
+               "%s\tmeiosis\t%.3fs\t\t%.3fs\t\t%.3fs\n",
+                p.get_id().c_str(),
+                p.get_id().c_str(), locus_mwalk, locus_lwalk, pool_time,
+                p.get_id().c_str(), meiosis_mwalk, meiosis_lwalk, meiosis_time);
+    }
+
+    if(benchmark_sink == -1) {
+        printf("\n");
+    }
+
+    return true;
+}
+
@@ -0,0 +1,48 @@
+#ifndef LKG_BENCHMARKPROGRAM_H_
+#define LKG_BENCHMARKPROGRAM_H_
+
+#include "program.h"
+#include "types.h"
+
+class Pedigree;
+class DescentGraph;
+class PeelSequenceGenerator;
+
+// times the markov chain with the omp-for-per-step implementation against
+// the persistent worker pool, starting from the same descent graph, then
+// compares the descent graph layouts: the access patterns of the meiosis
+// sampler (one meiosis along the map) and the locus sampler (every meiosis
+// at one locus) on their own and then the whole chain
+//
+// the access pattern timings are a proxy for cache misses, for the real
+// numbers run under 'perf stat -e cache-misses'
+//
+// the meiosis block sampler is compared with the meiosis sampler by the
+// effective sample size of the likelihood trace per second of sampling
+//
+// with zero iterations only the founder allele graph and the meiosis sampler
+// reset are timed, so large pedigrees can be benchmarked without running the
+// chain
+class BenchmarkProgram : public Program {
+
+    double time_chain(Pedigree& p, DescentGraph& dg, PeelSequenceGenerator& psg, bool use_pool, enum graph_layout layout);
+    double time_mixing(Pedigree& p, DescentGraph& dg, PeelSequenceGenerator& psg, double block_prob, double& ess);
+    double time_meiosis_walk(Pedigree& p, DescentGraph& dg, int repeats);
+    double time_locus_walk(Pedigree& p, DescentGraph& dg, int repeats);
+    double time_founder_allele_graph(Pedigree& p, DescentGraph& dg);
+    double time_founder_allele_flip(Pedigree& p, DescentGraph& dg);
+    double time_founder_allele_reset(Pedigree& p, DescentGraph& dg);
+    double time_founder_allele_block(Pedigree& p, DescentGraph& dg);
+    void time_meiosis_reset(Pedigree& p, DescentGraph& dg, double& first, double& unchanged);
+    
+ public :
+    BenchmarkProgram(char* ped, char* map, char* dat, struct mcmc_options options) : 
+        Program(ped, map, dat, "", options) {}
+    
+	~BenchmarkProgram() {}
+    
+    bool run();
+};
+
+#endif
+
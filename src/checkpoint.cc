@@ -0,0 +1,197 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+#include "checkpoint.h"
+
+using namespace std;
+
+
+const unsigned int CHECKPOINT_MAGIC = 0x4b43574c; // "LWCK"
+
+
+bool Checkpoint::exists() const {
+    FILE* f = fopen(filename.c_str(), "rb");
+
+    if(f == NULL) {
+        return false;
+    }
+
+    fclose(f);
+    return true;
+}
+
+bool Checkpoint::read() {
+    FILE* f = fopen(filename.c_str(), "rb");
+    unsigned int magic;
+    size_t length;
+
+    clear();
+
+    if(f == NULL) {
+        return false;
+    }
+
+    if((fread(&magic, sizeof(magic), 1, f) != 1) or
+       (magic != CHECKPOINT_MAGIC) or
+       (fread(&length, sizeof(length), 1, f) != 1)) {
+        fprintf(stderr, "error: '%s' is not a checkpoint file\n", filename.c_str());
+        fclose(f);
+        return false;
+    }
+
+    data.resize(length);
+
+    if((length != 0) and (fread(&data[0], 1, length, f) != length)) {
+        fprintf(stderr, "error: checkpoint file '%s' is truncated\n", filename.c_str());
+        fclose(f);
+        clear();
+        return false;
+    }
+
+    fclose(f);
+    return true;
+}
+
+// the checkpoint is written to a temporary file first and then renamed, so
+// if we are killed halfway through the previous checkpoint is still intact
+bool Checkpoint::write() const {
+    string tmpname = filename + ".tmp";
+    FILE* f = fopen(tmpname.c_str(), "wb");
+    size_t length = data.size();
+    bool ok;
+
+    if(f == NULL) {
+        fprintf(stderr, "error: could not open '%s' (%s)\n", tmpname.c_str(), strerror(errno));
+        return false;
+    }
+
+    ok = (fwrite(&CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC), 1, f) == 1) and
+         (fwrite(&length, sizeof(length), 1, f) == 1) and
+         ((length == 0) or (fwrite(&data[0], 1, length, f) == length));
+
+    ok = (fclose(f) == 0) and ok;
+
+    if(ok) {
+        ok = (rename(tmpname.c_str(), filename.c_str()) == 0);
+    }
+
+    if(not ok) {
+        fprintf(stderr, "error: could not write checkpoint '%s' (%s)\n", filename.c_str(), strerror(errno));
+        remove(tmpname.c_str());
+    }
+
+    return ok;
+}
+
+CheckpointWriter::CheckpointWriter() :
+    thread(),
+    lock(),
+    cond(),
+    pending(""),
+    busy(false),
+    finished(false),
+    failures(0) {
+
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&cond, NULL);
+
+    if(pthread_create(&thread, NULL, CheckpointWriter::_run, this) != 0) {
+        fprintf(stderr, "error: could not start checkpoint thread (%s:%d)\n", __FILE__, __LINE__);
+        abort();
+    }
+}
+
+CheckpointWriter::~CheckpointWriter() {
+    pthread_mutex_lock(&lock);
+    finished = true;
+    pthread_cond_broadcast(&cond);
+    pthread_mutex_unlock(&lock);
+
+    pthread_join(thread, NULL);
+
+    pthread_cond_destroy(&cond);
+    pthread_mutex_destroy(&lock);
+
+    if(failures != 0) {
+        fprintf(stderr, "warning: %d checkpoint%s could not be written\n", failures, failures == 1 ? "" : "s");
+    }
+}
+
+void* CheckpointWriter::_run(void* arg) {
+    static_cast<CheckpointWriter*>(arg)->run();
+    return NULL;
+}
+
+// pending is only touched by the chain while busy is false, so the file
+// can be written without holding the lock
+void CheckpointWriter::run() {
+    pthread_mutex_lock(&lock);
+
+    while(1) {
+        while((not busy) and (not finished)) {
+            pthread_cond_wait(&cond, &lock);
+        }
+
+        if(not busy) {
+            break;
+        }
+
+        pthread_mutex_unlock(&lock);
+
+        bool ok = pending.write();
+
+        pthread_mutex_lock(&lock);
+
+        if(not ok) {
+            ++failures;
+        }
+
+        busy = false;
+        pthread_cond_broadcast(&cond);
+    }
+
+    pthread_mutex_unlock(&lock);
+}
+
+bool CheckpointWriter::idle() {
+    bool tmp;
+
+    pthread_mutex_lock(&lock);
+    tmp = not busy;
+    pthread_mutex_unlock(&lock);
+
+    return tmp;
+}
+
+void CheckpointWriter::wait() {
+    pthread_mutex_lock(&lock);
+
+    while(busy) {
+        pthread_cond_wait(&cond, &lock);
+    }
+
+    pthread_mutex_unlock(&lock);
+}
+
+bool CheckpointWriter::submit(Checkpoint& c) {
+    pthread_mutex_lock(&lock);
+
+    if(busy) {
+        pthread_mutex_unlock(&lock);
+        return false;
+    }
+
+    pending.swap(c);
+    busy = true;
+    pthread_cond_broadcast(&cond);
+
+    pthread_mutex_unlock(&lock);
+
+    return true;
+}
+
@@ -0,0 +1,149 @@
+#ifndef LKG_CHECKPOINT_H_
+#define LKG_CHECKPOINT_H_
+
+using namespace std;
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <pthread.h>
+
+
+// a compact binary snapshot of the state of a Markov chain (or anything else
+// that needs to survive a restart) that is built up in memory and then
+// written in one go
+//
+// values are stored in native byte order with no padding, a checkpoint is
+// only meant to be read back by the same build on the same machine. the
+// file starts with a magic number and the length of the payload, so a
+// truncated file is rejected rather than half read
+class Checkpoint {
+
+    string filename;
+    vector<char> data;
+    size_t offset;      // read position
+
+ public :
+    Checkpoint(string filename) :
+        filename(filename),
+        data(),
+        offset(0) {}
+
+    Checkpoint(const Checkpoint& rhs) :
+        filename(rhs.filename),
+        data(rhs.data),
+        offset(rhs.offset) {}
+
+    ~Checkpoint() {}
+
+    Checkpoint& operator=(const Checkpoint& rhs) {
+        if(this != &rhs) {
+            filename = rhs.filename;
+            data = rhs.data;
+            offset = rhs.offset;
+        }
+        return *this;
+    }
+
+    void swap(Checkpoint& rhs) {
+        filename.swap(rhs.filename);
+        data.swap(rhs.data);
+        std::swap(offset, rhs.offset);
+    }
+
+    void clear() {
+        data.clear();
+        offset = 0;
+    }
+
+    string get_filename() const {
+        return filename;
+    }
+
+    void put_bytes(const void* p, size_t n) {
+        const char* tmp = static_cast<const char*>(p);
+        data.insert(data.end(), tmp, tmp + n);
+    }
+
+    bool get_bytes(void* p, size_t n) {
+        if((offset + n) > data.size()) {
+            return false;
+        }
+
+        if(n != 0) {
+            memcpy(p, &data[offset], n);
+        }
+
+        offset += n;
+        return true;
+    }
+
+    // T must be plain old data
+    template<typename T> void put(const T& value) {
+        put_bytes(&value, sizeof(T));
+    }
+
+    template<typename T> bool get(T& value) {
+        return get_bytes(&value, sizeof(T));
+    }
+
+    template<typename T> void put_vector(const vector<T>& v) {
+        put(v.size());
+
+        if(not v.empty()) {
+            put_bytes(&v[0], sizeof(T) * v.size());
+        }
+    }
+
+    template<typename T> bool get_vector(vector<T>& v) {
+        size_t n;
+
+        if((not get(n)) or ((offset + (sizeof(T) * n)) > data.size())) {
+            return false;
+        }
+
+        v.resize(n);
+
+        return (n == 0) or get_bytes(&v[0], sizeof(T) * n);
+    }
+
+    bool exists() const;
+    bool read();
+    bool write() const;
+};
+
+// writes checkpoints on a background thread so the Markov chain does not
+// have to wait for the disk
+//
+// there is only one slot, the chain builds the next checkpoint in its own
+// buffer and hands it over with submit(), which swaps the buffers and returns
+// immediately. if the previous checkpoint is still being written submit()
+// returns false without doing anything and the chain tries again later
+class CheckpointWriter {
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    Checkpoint pending;
+    bool busy;          // pending has not been written yet
+    bool finished;
+    int failures;
+
+    static void* _run(void* arg);
+    void run();
+
+    // not copyable, owns a thread
+    CheckpointWriter(const CheckpointWriter& rhs);
+    CheckpointWriter& operator=(const CheckpointWriter& rhs);
+
+ public :
+    CheckpointWriter();
+    ~CheckpointWriter();    // waits for the last checkpoint to be written
+
+    bool idle();
+    void wait();        // until the last checkpoint submitted has been written
+    bool submit(Checkpoint& c);
+};
+
+#endif
+
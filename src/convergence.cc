@@ -0,0 +1,196 @@
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include "convergence.h"
+#include "logarithms.h"
+
+using namespace std;
+
+
+unsigned int ConvergenceDiagnostics::length() const {
+    unsigned int n = traces.empty() ? 0 : traces[0].size();
+
+    for(unsigned int i = 1; i < traces.size(); ++i) {
+        n = min(n, unsigned(traces[i].size()));
+    }
+
+    return n;
+}
+
+void ConvergenceDiagnostics::chain_statistics(unsigned int start, unsigned int n, vector<double>& means, vector<double>& variances) const {
+    
+    means.assign(traces.size(), 0.0);
+    variances.assign(traces.size(), 0.0);
+
+    for(unsigned int i = 0; i < traces.size(); ++i) {
+        for(unsigned int j = start; j < start + n; ++j) {
+            means[i] += traces[i][j];
+        }
+        means[i] /= n;
+
+        for(unsigned int j = start; j < start + n; ++j) {
+            double tmp = traces[i][j] - means[i];
+            variances[i] += (tmp * tmp);
+        }
+        variances[i] /= (n - 1);
+    }
+}
+
+double ConvergenceDiagnostics::autocovariance(unsigned int chain, unsigned int start, unsigned int n, double mean, unsigned int lag) const {
+    const vector<double>& x = traces[chain];
+    double total = 0.0;
+
+    for(unsigned int j = start; j < start + n - lag; ++j) {
+        total += (x[j] - mean) * (x[j + lag] - mean);
+    }
+
+    return total / n;
+}
+
+ConvergenceDiagnostics ConvergenceDiagnostics::exp_scaled() const {
+    ConvergenceDiagnostics tmp(traces.size());
+    double largest = -numeric_limits<double>::max();
+
+    for(unsigned int i = 0; i < traces.size(); ++i) {
+        for(unsigned int j = 0; j < traces[i].size(); ++j) {
+            largest = max(largest, traces[i][j]);
+        }
+    }
+
+    for(unsigned int i = 0; i < traces.size(); ++i) {
+        for(unsigned int j = 0; j < traces[i].size(); ++j) {
+            tmp.add(i, exp_relative(traces[i][j], largest));
+        }
+    }
+
+    return tmp;
+}
+
+// Gelman & Rubin (1992)
+double ConvergenceDiagnostics::gelman_rubin(unsigned int start) const {
+    unsigned int m = traces.size();
+    unsigned int n = length() - start;
+    vector<double> means;
+    vector<double> variances;
+
+    if((m < 2) or (length() < start + 2)) {
+        return numeric_limits<double>::infinity();
+    }
+
+    chain_statistics(start, n, means, variances);
+
+    double grand_mean = 0.0;
+    double W = 0.0;
+
+    for(unsigned int i = 0; i < m; ++i) {
+        grand_mean += means[i];
+        W += variances[i];
+    }
+    grand_mean /= m;
+    W /= m;
+
+    double B = 0.0;
+    for(unsigned int i = 0; i < m; ++i) {
+        B += (means[i] - grand_mean) * (means[i] - grand_mean);
+    }
+    B *= (double(n) / (m - 1));
+
+    // every chain is stuck on the same value
+    if(W == 0.0) {
+        return (B == 0.0) ? 1.0 : numeric_limits<double>::infinity();
+    }
+
+    double var_plus = ((double(n - 1) / n) * W) + (B / n);
+
+    return sqrt(var_plus / W);
+}
+
+// split R-hat (Gelman et al. 2013), every chain is cut in half so that a
+// chain that is still drifting looks like two chains that disagree
+double ConvergenceDiagnostics::rhat(unsigned int start) const {
+    unsigned int m = traces.size();
+    unsigned int n = (length() < start) ? 0 : (length() - start) / 2;
+
+    if((m < 2) or (n < 2)) {
+        return numeric_limits<double>::infinity();
+    }
+
+    ConvergenceDiagnostics halves(2 * m);
+
+    for(unsigned int i = 0; i < m; ++i) {
+        for(unsigned int j = 0; j < n; ++j) {
+            halves.add(2 * i,     traces[i][start + j]);
+            halves.add(2 * i + 1, traces[i][start + n + j]);
+        }
+    }
+
+    return halves.gelman_rubin(0);
+}
+
+// autocorrelations are combined across chains and truncated with Geyer's
+// initial positive sequence, the sum stops at the first negative pair so
+// usually only a handful of lags are ever calculated
+double ConvergenceDiagnostics::ess(unsigned int start) const {
+    unsigned int m = traces.size();
+    unsigned int n = length() - start;
+    vector<double> means;
+    vector<double> variances;
+
+    if((m < 1) or (length() < start + 4)) {
+        return 0.0;
+    }
+
+    chain_statistics(start, n, means, variances);
+
+    double grand_mean = 0.0;
+    double W = 0.0;
+
+    for(unsigned int i = 0; i < m; ++i) {
+        grand_mean += means[i];
+        W += variances[i];
+    }
+    grand_mean /= m;
+    W /= m;
+
+    double B = 0.0;
+    if(m > 1) {
+        for(unsigned int i = 0; i < m; ++i) {
+            B += (means[i] - grand_mean) * (means[i] - grand_mean);
+        }
+        B *= (double(n) / (m - 1));
+    }
+
+    double var_plus = ((double(n - 1) / n) * W) + (B / n);
+
+    if(var_plus == 0.0) {
+        return 0.0;
+    }
+
+    double tau = -1.0;
+
+    for(unsigned int lag = 0; lag + 1 < n; lag += 2) {
+        double pair = 0.0;
+
+        for(unsigned int k = lag; k < lag + 2; ++k) {
+            double acov = 0.0;
+
+            for(unsigned int i = 0; i < m; ++i) {
+                acov += autocovariance(i, start, n, means[i], k);
+            }
+            acov /= m;
+
+            pair += 1.0 - ((W - acov) / var_plus);
+        }
+
+        if(pair <= 0.0)
+            break;
+
+        tau += (2.0 * pair);
+    }
+
+    return (m * n) / max(tau, 1.0 / (m * n));
+}
+
@@ -0,0 +1,61 @@
+#ifndef LKG_CONVERGENCE_H_
+#define LKG_CONVERGENCE_H_
+
+using namespace std;
+
+#include <vector>
+
+
+// traces of a scalar quantity from several independent chains, used to
+// calculate the Gelman-Rubin potential scale reduction factor (R-hat) and
+// the effective sample size across all chains
+class ConvergenceDiagnostics {
+
+    vector<vector<double> > traces;
+
+    unsigned int length() const;
+    void chain_statistics(unsigned int start, unsigned int n, vector<double>& means, vector<double>& variances) const;
+    double autocovariance(unsigned int chain, unsigned int start, unsigned int n, double mean, unsigned int lag) const;
+    double gelman_rubin(unsigned int start) const;
+
+ public :
+    ConvergenceDiagnostics(int num_chains) :
+        traces(num_chains) {}
+
+    ConvergenceDiagnostics(const ConvergenceDiagnostics& rhs) :
+        traces(rhs.traces) {}
+
+    ~ConvergenceDiagnostics() {}
+
+    ConvergenceDiagnostics& operator=(const ConvergenceDiagnostics& rhs) {
+        if(this != &rhs) {
+            traces = rhs.traces;
+        }
+        return *this;
+    }
+
+    void add(int chain, double value) {
+        traces[chain].push_back(value);
+    }
+
+    void clear() {
+        for(unsigned int i = 0; i < traces.size(); ++i) {
+            traces[i].clear();
+        }
+    }
+
+    // number of samples every chain has
+    unsigned int size() const {
+        return length();
+    }
+
+    // for traces of log values, returns the traces of exp(x - max(x))
+    ConvergenceDiagnostics exp_scaled() const;
+
+    // both use the samples from index start onwards
+    double rhat(unsigned int start=0) const;
+    double ess(unsigned int start=0) const;
+};
+
+#endif
+
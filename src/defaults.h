@@ -10,18 +10,30 @@ const int DEFAULT_MCMC_CHAINS               = 1;
 const int DEFAULT_MCMC_ITERATIONS           = 50000;
 const int DEFAULT_MCMC_BURNIN               = 50000;
 const int DEFAULT_MCMC_EXCHANGE_PERIOD      = 10;
+const double DEFAULT_MCMC_EXCHANGE_TARGET   = 0.234;
 const int DEFAULT_MCMC_SCORING_PERIOD       = 10;
 const int DEFAULT_MCMC_RUNS                 = 1;
+const double DEFAULT_RHAT_THRESHOLD         = 1.05;
+const int DEFAULT_MIN_ESS                   = 400;
+const int DIAGNOSTIC_PERIOD                 = 20;   // in scoring periods
+const int DEFAULT_TARGET_PEAKS              = 0;    // all intervals
+const int TARGET_SE_PERIOD                  = 100;  // in samples
 
 #define DEFAULT_RESULTS_FILENAME "swiftlink.out"
 #define DEFAULT_CODA_PREFIX "trace"
+#define DEFAULT_TUNING_CACHE ""  // no cache unless -C is given
+#define DEFAULT_CHECKPOINT_PREFIX "checkpoint"
 
 const int DEFAULT_SEQUENTIALIMPUTATION_RUNS = 1000;
 
 const int DEFAULT_THREAD_COUNT              = 1;
+const int DEFAULT_SCORING_THREADS           = 0;
+const int DEFAULT_SNAPSHOT_BUFFER           = 4;
+const int ONLINE_TUNING_SWEEPS              = 5;
 const int DEFAULT_LODSCORES                 = 5;
 const int DEFAULT_PEELOPT_ITERATIONS        = 1000000;
 const double DEFAULT_LSAMPLER_PROB          = 0.5;
+const double DEFAULT_BLOCK_PROB             = 0.0;
 
 #endif
 
@@ -10,10 +10,66 @@
 #include "genetic_map.h"
 #include "elimination.h"
 #include "founder_allele_graph4.h"
+#include "founder_allele_graph_block.h"
 
 using namespace std;
 
 
+static inline int popcount64(uint64_t x) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    int count = 0;
+    for(; x != 0; ++count) {
+        x &= (x - 1);
+    }
+    return count;
+#endif
+}
+
+// enough for a chain's own map and those of its neighbours in the
+// temperature ladder
+const unsigned int LIKELIHOOD_TERMS_SLOTS = 3;
+
+static unsigned long last_graph_id = 0;
+
+// in place transpose of a 64x64 bit matrix, bit j of a[i] swaps with 
+// bit i of a[j] (recursively swaps the off-diagonal blocks)
+static void transpose64(uint64_t a[64]) {
+    uint64_t m = ~uint64_t(0) >> 32;
+    
+    for(int j = 32; j != 0; j >>= 1, m ^= (m << j)) {
+        for(int k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+            uint64_t t = ((a[k] >> j) ^ a[k | j]) & m;
+            a[k] ^= (t << j);
+            a[k | j] ^= t;
+        }
+    }
+}
+
+// src has src_rows rows of src_row_words words, dst gets one row per bit 
+// column of src (dst_rows of them) of dst_row_words words
+static void transpose_bits(const uint64_t* src, int src_rows, int src_row_words, 
+                           uint64_t* dst, int dst_rows, int dst_row_words) {
+    uint64_t block[64];
+    
+    for(int r = 0; r < src_rows; r += 64) {
+        for(int w = 0; w < src_row_words; ++w) {
+            for(int k = 0; k < 64; ++k) {
+                block[k] = ((r + k) < src_rows) ? src[((r + k) * src_row_words) + w] : 0;
+            }
+            
+            transpose64(block);
+            
+            for(int k = 0; k < 64; ++k) {
+                if(((w * 64) + k) < dst_rows) {
+                    dst[(((w * 64) + k) * dst_row_words) + (r / 64)] = block[k];
+                }
+            }
+        }
+    }
+}
+
 DescentGraph::DescentGraph(Pedigree* ped, GeneticMap* map, bool sex_linked) :
     data(NULL),
     ped(ped), 
@@ -21,15 +77,26 @@ DescentGraph::DescentGraph(Pedigree* ped, GeneticMap* map, bool sex_linked) :
     prob(0.0), 
     marker_transmission(log(0.5) * (2 * (ped->num_members() - ped->num_founders()))), 
     graph_size(2 * ped->num_members()),
+    layout(LOCUS_MAJOR),
+    row_words(0),
+    locus_stride(0),
+    meiosis_stride(0),
     recombinations(-1),
     sex_linked(sex_linked),
-    seq() {
+    seq(),
+    meiosis_mask(),
+    num_meioses(0),
+    terms(),
+    terms_clock(0),
+    id(_next_id()),
+    locus_changes(map->num_markers(), 0),
+    source_id(0),
+    source_changes() {
     
-    data = new int[graph_size * map->num_markers()];
+    _init_layout(LOCUS_MAJOR);
     
-    for(unsigned i = 0; i < (graph_size * map->num_markers()); ++i) {
-        data[i] = 0;
-    }
+    data = new uint64_t[_data_length()];
+    fill(data, data + _data_length(), 0);
     
     if(sex_linked) {
         marker_transmission = log(0.5) * (ped->num_members() - ped->num_founders());
@@ -37,6 +104,7 @@ DescentGraph::DescentGraph(Pedigree* ped, GeneticMap* map, bool sex_linked) :
     }
 
     find_founderallelegraph_ordering();
+    _init_meiosis_mask();
 }
 
 DescentGraph::DescentGraph(const DescentGraph& d) : 
@@ -46,15 +114,25 @@ DescentGraph::DescentGraph(const DescentGraph& d) :
     prob(d.prob), 
 	marker_transmission(d.marker_transmission),
     graph_size(d.graph_size),
+    layout(d.layout),
+    row_words(d.row_words),
+    locus_stride(d.locus_stride),
+    meiosis_stride(d.meiosis_stride),
     recombinations(d.recombinations),
     sex_linked(d.sex_linked),
-    seq(d.seq) {
-
-    unsigned int data_length = graph_size * map->num_markers();
-    
-	data = new int[data_length];
+    seq(d.seq),
+    meiosis_mask(d.meiosis_mask),
+    num_meioses(d.num_meioses),
+    terms(d.terms),
+    terms_clock(d.terms_clock),
+    id(_next_id()),
+    locus_changes(d.locus_changes),
+    source_id(0),
+    source_changes() {
+
+	data = new uint64_t[_data_length()];
     copy(d.data, 
-         d.data + data_length, 
+         d.data + _data_length(), 
          data);
 }
 
@@ -65,21 +143,189 @@ DescentGraph::~DescentGraph() {
 DescentGraph& DescentGraph::operator=(const DescentGraph& d) {
     
 	if(&d != this) {
+	    size_t old_length = _data_length();
+	    
 		ped = d.ped;
 		map = d.map;
 		prob = d.prob;
 		graph_size = d.graph_size;
+		layout = d.layout;
+		row_words = d.row_words;
+		locus_stride = d.locus_stride;
+		meiosis_stride = d.meiosis_stride;
 		marker_transmission = d.marker_transmission;
         sex_linked = d.sex_linked;
+        meiosis_mask = d.meiosis_mask;
+        num_meioses = d.num_meioses;
+        terms = d.terms;
+        terms_clock = d.terms_clock;
+        id = _next_id();
+        locus_changes = d.locus_changes;
+        source_id = 0;
+        source_changes.clear();
+        
+        if(_data_length() != old_length) {
+            delete[] data;
+            data = new uint64_t[_data_length()];
+        }
                 
         copy(d.data, 
-             d.data + (graph_size * map->num_markers()), 
+             d.data + _data_length(), 
              data);
     }
 
 	return *this;
 }
 
+void DescentGraph::swap(DescentGraph& d) {
+    std::swap(data, d.data);
+    std::swap(ped, d.ped);
+    std::swap(map, d.map);
+    std::swap(prob, d.prob);
+    std::swap(marker_transmission, d.marker_transmission);
+    std::swap(graph_size, d.graph_size);
+    std::swap(layout, d.layout);
+    std::swap(row_words, d.row_words);
+    std::swap(locus_stride, d.locus_stride);
+    std::swap(meiosis_stride, d.meiosis_stride);
+    std::swap(recombinations, d.recombinations);
+    std::swap(sex_linked, d.sex_linked);
+    seq.swap(d.seq);
+    meiosis_mask.swap(d.meiosis_mask);
+    std::swap(num_meioses, d.num_meioses);
+    terms.swap(d.terms);
+    std::swap(terms_clock, d.terms_clock);
+    std::swap(id, d.id);
+    locus_changes.swap(d.locus_changes);
+    std::swap(source_id, d.source_id);
+    source_changes.swap(d.source_changes);
+}
+
+// d's change counters only mean something if this graph still holds what
+// it copied from d last time, and anything that replaces the contents of a
+// graph wholesale gives it a new id
+void DescentGraph::copy_changed(DescentGraph& d) {
+    if((source_id != d.id) or (ped != d.ped) or (map != d.map)) {
+        *this = d;
+    }
+    else {
+        for(unsigned i = 0; i < map->num_markers(); ++i) {
+            if(source_changes[i] != d.locus_changes[i]) {
+                copy_locus(d, i, i);
+            }
+        }
+        
+        prob = d.prob;
+        recombinations = d.recombinations;
+    }
+    
+    source_id = d.id;
+    source_changes = d.locus_changes;
+}
+
+unsigned long DescentGraph::_next_id() {
+    unsigned long tmp;
+    
+    #pragma omp critical(descent_graph_id)
+    {
+        tmp = ++last_graph_id;
+    }
+    
+    return tmp;
+}
+
+void DescentGraph::_init_layout(enum graph_layout l) {
+    layout = l;
+    
+    if(layout == LOCUS_MAJOR) {
+        row_words = (graph_size + 63) / 64;
+        locus_stride = row_words * 64;
+        meiosis_stride = 1;
+    }
+    else {
+        row_words = (map->num_markers() + 63) / 64;
+        locus_stride = 1;
+        meiosis_stride = row_words * 64;
+    }
+}
+
+size_t DescentGraph::_data_length() const {
+    return row_words * ((layout == LOCUS_MAJOR) ? map->num_markers() : graph_size);
+}
+
+void DescentGraph::set_layout(enum graph_layout l) {
+    if(l == layout) {
+        return;
+    }
+    
+    const uint64_t* old_data = data;
+    int old_rows = (layout == LOCUS_MAJOR) ? map->num_markers() : graph_size;
+    int old_row_words = row_words;
+    
+    _init_layout(l);
+    
+    data = new uint64_t[_data_length()];
+    
+    transpose_bits(old_data, old_rows, old_row_words,
+                   data, (layout == LOCUS_MAJOR) ? map->num_markers() : graph_size, row_words);
+    
+    delete[] old_data;
+}
+
+void DescentGraph::get_locus(unsigned locus, vector<uint64_t>& row) const {
+    if(layout == LOCUS_MAJOR) {
+        row.assign(data + (locus * row_words), data + ((locus + 1) * row_words));
+        return;
+    }
+    
+    row.assign((graph_size + 63) / 64, 0);
+    
+    for(int i = 0; i < graph_size; ++i) {
+        size_t index = _index(locus, i);
+        
+        if(data[index >> 6] & _bit(index)) {
+            row[i >> 6] |= _bit(i);
+        }
+    }
+}
+
+void DescentGraph::get_meiosis(unsigned meiosis, vector<uint64_t>& row) const {
+    if(layout == MEIOSIS_MAJOR) {
+        row.assign(data + (meiosis * row_words), data + ((meiosis + 1) * row_words));
+        return;
+    }
+    
+    row.assign((map->num_markers() + 63) / 64, 0);
+    
+    for(unsigned i = 0; i < map->num_markers(); ++i) {
+        size_t index = _index(i, meiosis);
+        
+        if(data[index >> 6] & _bit(index)) {
+            row[i >> 6] |= _bit(i);
+        }
+    }
+}
+
+// founders do not have meioses and for sex-linked traits only the maternal
+// meiosis counts
+void DescentGraph::_init_meiosis_mask() {
+    unsigned num_alleles = sex_linked ? 1 : 2;
+
+    meiosis_mask.assign((graph_size + 63) / 64, 0);
+    num_meioses = 0;
+
+    for(unsigned i = 0; i < ped->num_members(); ++i) {
+        if(ped->get_by_index(i)->isfounder())
+            continue;
+
+        for(unsigned j = 0; j < num_alleles; ++j) {
+            unsigned bit = (i * 2) + j;
+            meiosis_mask[bit >> 6] |= _bit(bit);
+            ++num_meioses;
+        }
+    }
+}
+
 void DescentGraph::_invalidate_paternal_x() {
     Person* p;
 
@@ -102,54 +348,113 @@ bool DescentGraph::random_descentgraph() {
     return ge.random_descentgraph(*this);
 }
 
-/*
-void DescentGraph::copy_from(DescentGraph& d, unsigned start, unsigned end) {
-    copy(d.data + start, d.data + end, data);
+// in the meiosis-major layout neighbouring loci share words, and the locus
+// samplers write to different loci in parallel
+void DescentGraph::_set_index(size_t index, int value) {
+    uint64_t* word = data + (index >> 6);
+    uint64_t bit = _bit(index);
+    
+    if(layout == MEIOSIS_MAJOR) {
+        if(value != 0) {
+            #pragma omp atomic
+            *word |= bit;
+        }
+        else {
+            #pragma omp atomic
+            *word &= ~bit;
+        }
+        return;
+    }
+    
+    if(value != 0)
+        *word |= bit;
+    else
+        *word &= ~bit;
+}
+
+void DescentGraph::_flip_index(size_t index) {
+    uint64_t* word = data + (index >> 6);
+    uint64_t bit = _bit(index);
+    
+    if(layout == MEIOSIS_MAJOR) {
+        #pragma omp atomic
+        *word ^= bit;
+        return;
+    }
+    
+    *word ^= bit;
 }
-*/
 
 int DescentGraph::get_bit(unsigned i) const {
-    return data[i];
+    size_t index = _index(i / graph_size, i % graph_size);
+    return (data[index >> 6] & _bit(index)) ? 1 : 0;
 }
 
 void DescentGraph::set_bit(unsigned i, int b) {
-    data[i] = b;
+    if(get_bit(i) != b) {
+        _flip_index(_index(i / graph_size, i % graph_size));
+        _changed(i / graph_size);
+    }
 }
 
 void DescentGraph::flip_bit(unsigned i) {
-    data[i] = (data[i] == 0) ? 1 : 0; 
+    _flip_index(_index(i / graph_size, i % graph_size));
+    _changed(i / graph_size);
 }
 
-/*
-int DescentGraph::_offset(unsigned person_id, unsigned locus, enum parentage p) const {
-	return (graph_size * locus) + (person_id * 2) + p;
+void DescentGraph::unpack(vector<int>& v) const {
+    v.resize(get_unpacked_size());
+    
+    for(unsigned i = 0; i < v.size(); ++i) {
+        v[i] = get_bit(i);
+    }
 }
 
-int DescentGraph::get(unsigned person_id, unsigned locus, enum parentage p) const {
-    return data[_offset(person_id, locus, p)];
+void DescentGraph::pack(const vector<int>& v) {
+    for(unsigned i = 0; i < v.size(); ++i) {
+        set_bit(i, v[i]);
+    }
 }
-*/
 
 void DescentGraph::copy_locus(unsigned src, unsigned dst) {
-    for(unsigned i = 0; i < ped->num_members(); ++i) {
-        data[_offset(i, dst, MATERNAL)] = data[_offset(i, src, MATERNAL)];
-        data[_offset(i, dst, PATERNAL)] = data[_offset(i, src, PATERNAL)];
-    }
+    copy_locus(*this, src, dst);
 }
 
 void DescentGraph::copy_locus(DescentGraph& d, unsigned src, unsigned dst) {
-    for(unsigned i = 0; i < ped->num_members(); ++i) {
-        data[_offset(i, dst, MATERNAL)] = d.get(i, src, MATERNAL);
-        data[_offset(i, dst, PATERNAL)] = d.get(i, src, PATERNAL);
+    if((layout == LOCUS_MAJOR) and (d.layout == LOCUS_MAJOR)) {
+        const uint64_t* from = d.data + (src * row_words);
+        uint64_t* to = data + (dst * row_words);
+        
+        if(not equal(from, from + row_words, to)) {
+            copy(from, from + row_words, to);
+            _changed(dst);
+        }
+        return;
+    }
+    
+    for(int i = 0; i < graph_size; ++i) {
+        size_t from = d._index(src, i);
+        size_t to = _index(dst, i);
+        
+        if(((d.data[from >> 6] & d._bit(from)) != 0) != ((data[to >> 6] & _bit(to)) != 0)) {
+            _flip_index(to);
+            _changed(dst);
+        }
     }
 }
 
+// the samplers set every meiosis they look at, so only an actual change
+// counts as one
 void DescentGraph::set(unsigned person_id, unsigned locus, enum parentage p, int value) {
-    data[_offset(person_id, locus, p)] = value;
+    if(get(person_id, locus, p) != value) {
+        _set_index(_index(locus, (person_id * 2) + p), value);
+        _changed(locus);
+    }
 }
 
 void DescentGraph::flip(unsigned person_id, unsigned locus, enum parentage p) {
-	flip_bit(_offset(person_id, locus, p));
+    _flip_index(_index(locus, (person_id * 2) + p));
+    _changed(locus);
 }
 
 // this only works because the founders are guaranteed to be at the start of
@@ -181,10 +486,33 @@ int DescentGraph::get_founderallele(unsigned person_id, unsigned locus, enum par
     }
 }
 
+// every term is cached per map and only loci that have changed since the
+// last call are recomputed. the terms are still summed in locus order, so
+// the result is exactly what recomputing everything would give
 double DescentGraph::get_likelihood() {
-    prob = log_product(_transmission_prob(), _sum_prior_prob());
-    //fprintf(stderr, "TP = %f, SPP = %f\n", _transmission_prob(), _sum_prior_prob());
-    //prob = _transmission_prob();
+    likelihood_terms& t = _get_terms();
+    
+    if(not _update_terms(t)) {
+        prob = LOG_ZERO;
+        return prob;
+    }
+    
+    double recombination_prob = 0.0;
+    double prior_prob = 0.0;
+    
+    recombinations = 0;
+    
+    for(unsigned i = 0; i < (map->num_markers() - 1); ++i) {
+        recombination_prob += t.recombination[i];
+        recombinations += t.crossovers[i];
+    }
+    
+    for(unsigned i = 0; i < map->num_markers(); ++i) {
+        prior_prob += t.prior[i];
+    }
+    
+    prob = log_product(marker_transmission + recombination_prob, prior_prob);
+    
     return prob;
 }
 /*
@@ -193,77 +521,155 @@ double DescentGraph::get_haplotype_likelihood() {
     return prob;
 }
 */
-double DescentGraph::_transmission_prob() {
-    return marker_transmission + _recombination_prob();
+void DescentGraph::invalidate() {
+    terms.clear();
+    id = _next_id();
 }
 
-double DescentGraph::_recombination_prob() {
-    double tmp = 0.0;
+likelihood_terms& DescentGraph::_get_terms() {
+    unsigned oldest = 0;
     
-    recombinations = 0;
-	
-	for(unsigned i = 0; i < (map->num_markers() - 1); ++i) { // every loci	
-        tmp += get_recombination_prob(i, true);
+    ++terms_clock;
+    
+    for(unsigned i = 0; i < terms.size(); ++i) {
+        if(terms[i].map_version == map->get_version()) {
+            terms[i].last_used = terms_clock;
+            return terms[i];
+        }
+        
+        if(terms[i].last_used < terms[oldest].last_used) {
+            oldest = i;
+        }
     }
     
-    return tmp;
+    if(terms.size() < LIKELIHOOD_TERMS_SLOTS) {
+        oldest = terms.size();
+        terms.push_back(likelihood_terms());
+    }
+    
+    likelihood_terms& t = terms[oldest];
+    
+    t.map_version = map->get_version();
+    t.last_used = terms_clock;
+    t.prior.assign(map->num_markers(), 0.0);
+    t.recombination.assign(map->num_markers(), 0.0);
+    t.crossovers.assign(map->num_markers(), 0);
+    t.dirty.assign(map->num_markers(), 1);
+    
+    return t;
 }
 
-double DescentGraph::get_recombination_prob(unsigned locus, bool count_crossovers) {
-    double tmp = 0.0;
-	enum parentage parent;
-	bool crossover;
-	Person* p;
-
-    double theta = map->get_theta_log(locus);
-    double antitheta = map->get_inversetheta_log(locus);
-
-    unsigned num_alleles = sex_linked ? 1 : 2;
-
-    for(unsigned i = 0; i < ped->num_members(); ++i) { // every person
-        p = ped->get_by_index(i);
-
-        if(p->isfounder())
-            continue;
-
-        for(unsigned j = 0; j < num_alleles; ++j) { // mother and father, just mother (0) for sex-linked
-            parent = static_cast<enum parentage>(j);
-            crossover = get(i, locus, parent) != get(i, locus + 1, parent);
-
-            if(count_crossovers and crossover) {
-                ++recombinations;
+// recomputes the dirty loci and the intervals either side of them, returns
+// false if the graph is illegal (nothing is marked clean)
+bool DescentGraph::_update_terms(likelihood_terms& t) {
+    unsigned num_markers = map->num_markers();
+    unsigned first = 0;
+    
+    while((first < num_markers) and (not t.dirty[first])) {
+        ++first;
+    }
+    
+    if(first == num_markers) {
+        return true;
+    }
+    
+    // the dirty loci are evaluated FOUNDERALLELEGRAPH_BLOCK at a time
+    int dirty = count(t.dirty.begin() + first, t.dirty.end(), 1);
+    vector<FounderAlleleGraph4> graphs(min(dirty, FOUNDERALLELEGRAPH_BLOCK), FounderAlleleGraph4(ped, map, sex_linked));
+    FounderAlleleGraph4* block[FOUNDERALLELEGRAPH_BLOCK];
+    double probs[FOUNDERALLELEGRAPH_BLOCK];
+    FounderAlleleGraphBlock fb(ped);
+    int loaded = 0;
+    
+    fb.set_sequence(&seq);
+    
+    for(unsigned i = first; i < num_markers; ++i) {
+        if(t.dirty[i]) {
+            graphs[loaded].set_locus(i);
+            block[loaded] = &graphs[loaded];
+            ++loaded;
+        }
+        
+        if((loaded == int(graphs.size())) or ((i == (num_markers - 1)) and (loaded != 0))) {
+            fb.evaluate(*this, block, loaded, probs);
+            
+            for(int j = 0; j < loaded; ++j) {
+                unsigned locus = graphs[j].get_locus();
+                
+                if(probs[j] == 0.0) {
+                    FounderAlleleGraph4 f(ped, map, sex_linked);
+                    
+                    f.set_sequence(&seq);
+                    f.set_locus(locus);
+                    f.reset(*this);
+                    
+                    fprintf(stderr, "error: descent graph illegal at locus %d\n", int(locus));
+                    fprintf(stderr, "%s\n", f.debug_string().c_str());
+                    fprintf(stderr, "%s\n", debug_string().c_str());
+                    return false;
+                }
+                
+                t.prior[locus] = log(probs[j]);
             }
-
-            tmp += (crossover ? theta : antitheta) ;
+            
+            loaded = 0;
         }
     }
     
-    return tmp;
-}
-
-double DescentGraph::_sum_prior_prob() {
-    double tmp_prob;
-	double return_prob = 0.0;
-    FounderAlleleGraph4 f(ped, map, sex_linked);
+    for(unsigned i = first; i < (num_markers - 1); ++i) {
+        if(t.dirty[i] or t.dirty[i+1]) {
+            t.crossovers[i] = _crossovers(i);
+            t.recombination[i] = _recombination_prob(i, t.crossovers[i]);
+        }
+    }
     
-    f.set_sequence(&seq);
+    fill(t.dirty.begin() + first, t.dirty.end(), 0);
     
-    for(unsigned i = 0; i < map->num_markers(); ++i) {
-        f.set_locus(i);
-        f.reset(*this);
+    return true;
+}
+
+// a crossover is a meiosis that differs between adjacent loci, so in the
+// locus-major layout they can be counted a word at a time
+int DescentGraph::_crossovers(unsigned locus) const {
+    int crossovers = 0;
+
+    if(layout == LOCUS_MAJOR) {
+        const uint64_t* left = data + (locus * row_words);
+        const uint64_t* right = left + row_words;
         
-        if((tmp_prob = f.likelihood()) == 0.0) {
-            fprintf(stderr, "error: descent graph illegal at locus %d\n", int(i));
-            fprintf(stderr, "%s\n", f.debug_string().c_str());
-            fprintf(stderr, "%s\n", debug_string().c_str());
-			return LOG_ZERO;
+        for(int i = 0; i < row_words; ++i) {
+            crossovers += popcount64((left[i] ^ right[i]) & meiosis_mask[i]);
         }
-        
-		return_prob += log(tmp_prob);
     }
+    else {
+        for(int i = 0; i < graph_size; ++i) {
+            if(meiosis_mask[i >> 6] & _bit(i)) {
+                size_t left = _index(locus, i);
+                size_t right = left + locus_stride;
+                
+                crossovers += (((data[left >> 6] >> (left & 63)) ^ (data[right >> 6] >> (right & 63))) & 1);
+            }
+        }
+    }
+    
+    return crossovers;
+}
+
+double DescentGraph::_recombination_prob(unsigned locus, int crossovers) const {
+    double theta = map->get_theta_log(locus);
+    double antitheta = map->get_inversetheta_log(locus);
     
-    return return_prob;
+    return (crossovers * theta) + ((num_meioses - crossovers) * antitheta);
+}
+
+double DescentGraph::get_recombination_prob(unsigned locus, bool count_crossovers) {
+    int crossovers = _crossovers(locus);
+
+    if(count_crossovers) {
+        recombinations += crossovers;
+    }
     
+    return _recombination_prob(locus, crossovers);
 }
 
 /*
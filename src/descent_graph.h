@@ -5,6 +5,8 @@ using namespace std;
 
 #include <limits>
 #include <string>
+#include <vector>
+#include <stdint.h>
 
 #include "types.h"
 #include "logarithms.h"
@@ -12,29 +14,84 @@ using namespace std;
 
 class Pedigree;
 
+// the log likelihood terms of every locus under one map, see get_likelihood()
+struct likelihood_terms {
+    unsigned long map_version;
+    unsigned long last_used;
+    vector<double> prior;           // sum over founder allele assignments
+    vector<double> recombination;   // transmission to the next locus
+    vector<int> crossovers;
+    vector<char> dirty;             // locus changed since it was computed
+    
+    likelihood_terms() :
+        map_version(0),
+        last_used(0),
+        prior(),
+        recombination(),
+        crossovers(),
+        dirty() {}
+};
+
+// one bit per meiosis per locus, stored either locus-major (every locus is a
+// row of words, the default) or meiosis-major (every meiosis is a row of
+// words). the locus sampler and the lod scores read whole loci, the meiosis
+// sampler walks one meiosis along the whole map, so which is faster depends
+// on the pedigree and the map. rows always start on a new word
+//
+// in the locus-major layout threads working on different loci never share a
+// word, in the meiosis-major layout they do, so writes are made atomic
 class DescentGraph {
 
-	int* data;
+	uint64_t* data;
 	Pedigree* ped;
 	GeneticMap* map;
 	double prob;
     double marker_transmission; // cache for transmission prob
     int graph_size; 			// size of descent graph at one loci, 
 								// for indexing data
+	enum graph_layout layout;
+	int row_words;              // words per row (locus or meiosis)
+	size_t locus_stride;        // in bits
+	size_t meiosis_stride;
 	int recombinations;
     bool sex_linked;
 	
 	vector<int> seq;
+	vector<uint64_t> meiosis_mask;  // meioses that can recombine (non-founders)
+	int num_meioses;                // bits set in meiosis_mask
+	
+	vector<likelihood_terms> terms; // one per map, least recently used is reused
+	unsigned long terms_clock;
+	
+	unsigned long id;                   // unique to this graph's history
+	vector<unsigned int> locus_changes; // per locus, for copy_changed()
+	unsigned long source_id;            // what copy_changed() last copied
+	vector<unsigned int> source_changes;
 	
     void _invalidate_paternal_x();
-	double _transmission_prob();
-	double _recombination_prob();
-    double _best_prior_prob();
-	double _sum_prior_prob();
-    //int _offset(unsigned person_id, unsigned locus, enum parentage p) const ;
-	inline int _offset(unsigned person_id, unsigned locus, enum parentage p) const {
-	    return (graph_size * locus) + (person_id * 2) + p;
+    void _init_meiosis_mask();
+    void _init_layout(enum graph_layout l);
+    size_t _data_length() const;
+    int _crossovers(unsigned locus) const;
+    double _recombination_prob(unsigned locus, int crossovers) const;
+    likelihood_terms& _get_terms();
+    bool _update_terms(likelihood_terms& t);
+    inline void _changed(unsigned locus) {
+        for(unsigned i = 0; i < terms.size(); ++i) {
+            terms[i].dirty[locus] = 1;
+        }
+        ++locus_changes[locus];
     }
+    static unsigned long _next_id();
+    double _best_prior_prob();
+	inline size_t _index(unsigned locus, unsigned meiosis) const {
+	    return (locus * locus_stride) + (meiosis * meiosis_stride);
+	}
+	inline uint64_t _bit(size_t index) const {
+	    return uint64_t(1) << (index & 63);
+	}
+	void _set_index(size_t index, int value);
+	void _flip_index(size_t index);
 	int _founder_allele(unsigned person_id, enum parentage p) const;
 	void find_founderallelegraph_ordering();
 
@@ -43,6 +100,13 @@ class DescentGraph {
 	DescentGraph(const DescentGraph& d);
     ~DescentGraph();
 	DescentGraph& operator=(const DescentGraph& d);
+	
+	// exchanges the contents of two graphs without copying them
+	void swap(DescentGraph& d);
+	
+	// makes this graph a copy of d, if the last copy_changed() was also from
+	// d then only the loci that have changed since are copied
+	void copy_changed(DescentGraph& d);
     
     bool operator<(const DescentGraph& a) const {
         return prob < a.prob;
@@ -50,13 +114,14 @@ class DescentGraph {
 	
 	//void copy_from(DescentGraph& d, unsigned start, unsigned end);
     
-    //int get(unsigned person_id, unsigned locus, enum parentage p) const ;
     inline int get(unsigned person_id, unsigned locus, enum parentage p) const {
-        return data[_offset(person_id, locus, p)];
+        size_t index = _index(locus, (person_id * 2) + p);
+        return (data[index >> 6] & _bit(index)) ? 1 : 0;
     }
     void set(unsigned person_id, unsigned locus, enum parentage p, int value);
     void flip(unsigned person_id, unsigned locus, enum parentage p);
     
+    // i indexes the graph as if it were unpacked (see unpack())
     int get_bit(unsigned i) const ;
     void set_bit(unsigned i, int b);
     void flip_bit(unsigned i);
@@ -64,8 +129,20 @@ class DescentGraph {
     void copy_locus(unsigned src, unsigned dst);
     void copy_locus(DescentGraph& d, unsigned src, unsigned dst);
 
+    // transposes the graph in place if the layout is different
+    void set_layout(enum graph_layout l);
+    enum graph_layout get_layout() const { return layout; }
+
+    // one row of the graph regardless of layout, bit i of the result is
+    // meiosis i at that locus or locus i of that meiosis
+    void get_locus(unsigned locus, vector<uint64_t>& row) const;
+    void get_meiosis(unsigned meiosis, vector<uint64_t>& row) const;
+
     int get_founderallele(unsigned person_id, unsigned loci, enum parentage p) const;
     
+    // parents before children, for FounderAlleleGraph4::set_sequence()
+    vector<int>* get_founderallelegraph_ordering() { return &seq; }
+    
     bool random_descentgraph();
     bool illegal() const { return prob == LOG_ILLEGAL; }
 	int num_recombinations() const { return recombinations; }
@@ -73,7 +150,19 @@ class DescentGraph {
 	double get_marker_transmission() const { return marker_transmission; }
 	double get_recombination_prob(unsigned int locus, bool count_crossovers);
     double get_haplotype_likelihood();
+    
+    // only the loci that have changed since the last call with the same map
+    // are recomputed
     double get_likelihood();
+    
+    // changes that do not go through this class (e.g. writing to 
+    // get_internal_ptr()) need to be followed by invalidate()
+    void invalidate();
+    
+    // a locus has not changed since these were read if the id and its 
+    // count of changes are both the same, swap() takes the id with it
+    unsigned long get_id() const { return id; }
+    unsigned int get_changes(unsigned locus) const { return locus_changes[locus]; }
 
     double get_likelihood2(GeneticMap* m) {
         GeneticMap* tmp = map;
@@ -85,11 +174,24 @@ class DescentGraph {
     
     string debug_string();
     
-    int* get_internal_ptr() { return data; }
+    // the packed representation in the current layout, for checkpointing
+    uint64_t* get_internal_ptr() { return data; }
     size_t get_internal_size() { 
-        return sizeof(int) * graph_size * map->num_markers();
+        return sizeof(uint64_t) * _data_length();
+    }
+
+    // one int per meiosis, locus by locus (person * 2 + parent within
+    // a locus), this is the layout the GPU code expects
+    size_t get_unpacked_size() const {
+        return graph_size * map->num_markers();
     }
+    void unpack(vector<int>& v) const;
+    void pack(const vector<int>& v);
 };
 
+inline void swap(DescentGraph& a, DescentGraph& b) {
+    a.swap(b);
+}
+
 #endif
 
@@ -31,416 +31,585 @@ string FounderAlleleGraph4::debug_string() {
     return ss.str();
 }
 
+// founder alleles that share a typed person are in the same component,
+// components are kept in a union-find forest (union by rank, path 
+// compression) where each founder allele also stores whether its allele 
+// assignments are swapped relative to its parent's. allele_assignment[k][fa]
+// is only ever written when fa joins a component (relative to the root), 
+// so the assignment of fa under the component's k-th hypothesis is 
+// allele_assignment[k ^ parity][fa], where parity is fa's parity relative 
+// to the root. component data (fixed, prob, size etc) lives at the root
+//
+// components are multiplied together in the order they were created, the
+// same order as when they were relabelled on every merge, so the result 
+// does not depend on which root survives a merge
 double FounderAlleleGraph4::likelihood() {
-    Person* p;
     int tmp;
-    enum unphased_genotype g;
-    enum unphased_genotype tmp0, tmp1;
-    int mat_fa;
-    int pat_fa;
-    int num_groups;
-    //int group_index;
-    int group1, group2;
-    int fixed1, fixed2;
-    bool legal0, legal1, legal2, legal3;
-    
-    // reset everything
-    num_groups = 0;
-    group_index = 0;
     
-    group_membership.assign(founder_alleles, DEFAULT_COMPONENT);
-    group_fixed.assign(founder_alleles, -1);
-    group_active.assign(founder_alleles, false);
-    
-    //prob[0].assign(founder_alleles, 1.0);
-    //prob[1].assign(founder_alleles, 1.0);
+    // nothing has changed since the last call or since the components 
+    // were saved
+    if(complete or valid) {
+        return total_likelihood;
+    }
     
+    start_components();
     
     // calculate likelihood, the founder allele graph is only
     // constrained by typed members of the pedigree
     for(unsigned i = 0; i < ped->num_members(); ++i) {
-        p = ped->get_by_index(i);
-        if(not p->istyped())
-            continue;
+        tmp = i * 2;
         
-        g = p->get_marker(locus);
+        if(not add_person(i, ped->get_by_index(i)->get_genotype(locus), edge_list[tmp], edge_list[tmp+1])) {
+#ifdef LKG_DEBUG
+            check_likelihood(0.0, edge_list, __func__);
+#endif
+            return 0.0;
+        }
+    }
+    
+    total_likelihood = components_likelihood();
+    complete = true;
+    
+#ifdef LKG_DEBUG
+    check_likelihood(total_likelihood, edge_list, __func__);
+#endif
+    
+    return total_likelihood;
+}
+
+// saves the components of the whole graph for flip_likelihood(), reusing 
+// the last call to likelihood() if nothing has happened since, returns 
+// false if the graph is illegal
+bool FounderAlleleGraph4::save_graph() {
+    if((not complete) and (likelihood() == 0.0)) {
+        return false;
+    }
+    
+    for(unsigned i = 0; i < roots.size(); ++i) {
+        root_members[roots[i]].clear();
+    }
+    
+    roots.clear();
+    fa_component.assign(founder_alleles, DEFAULT_COMPONENT);
+    affected.clear();
+    
+    for(unsigned i = 0; i < ped->num_members(); ++i) {
+        Person* p = ped->get_by_index(i);
         
-        if(g == UNTYPED)
-            continue;
+        if(p->istyped() and (p->get_marker(locus) != UNTYPED)) {
+            affected.push_back(i);
+        }
+    }
+    
+    save_components(affected);
+    
+    valid = true;
+    
+    return true;
+}
+
+// reset everything, stamps mean nothing needs to be cleared
+void FounderAlleleGraph4::start_components() {
+    group_index = 0;
+    complete = false;
+    
+    if(++stamp == 0) {
+        uf_stamp.assign(founder_alleles, 0);
+        stamp = 1;
+    }
+}
+
+// adds the constraints from person i, who has genotype g and carries founder 
+// alleles mat_fa and pat_fa, returns false if they cannot be satisfied
+bool FounderAlleleGraph4::add_person(unsigned int i, enum unphased_genotype g, int mat_fa, int pat_fa) {
+    Person* p = ped->get_by_index(i);
+    enum unphased_genotype tmp0, tmp1;
+    int group1, group2;
+    int par1, par2;
+    int fixed1, fixed2;
+    bool legal0, legal1, legal2, legal3;
+    
+    if(g == UNTYPED)
+        return true;
+    
+    // pat_fa does not exist if p is male and X-linked
+    
+    // autozygous or
+    // for every male, the maternal founder allele just gets assigned 
+    // because there is no ambiguity due to lack of phase
+    if((mat_fa == pat_fa) or (sex_linked and p->ismale())) {
+        if(g == HETERO) {
+            return false;
+        }
         
-        tmp = i * 2;
-        mat_fa = edge_list[tmp];
-        pat_fa = edge_list[tmp+1]; // <---- does not exist if p is male and X-linked
+        group1 = find_component(mat_fa, par1);
         
-        //fprintf(stderr, "person = %d (%s)\n", i, p->ismale() ? "M" : "F");
-
-        // autozygous or
-        // for every male, the maternal founder allele just gets assigned 
-        // because there is no ambiguity due to lack of phase
-        if((mat_fa == pat_fa) or (sex_linked and p->ismale())) {
-            if(g == HETERO) {
-                //fprintf(stderr, "FAG: %s:%d\n", __FILE__, __LINE__);
-                return 0.0;
+        if(group1 != DEFAULT_COMPONENT) {
+            // already belongs to a component
+            fixed1 = group_fixed[group1];
+            if(fixed1 != -1) {
+                if(g != allele_assignment[fixed1 ^ par1][mat_fa]) {
+                    return false;
+                }
             }
-            
-            group1 = group_membership[mat_fa];
-            
-            if(group1 != DEFAULT_COMPONENT) {
-                // already belongs to a component
-                fixed1 = group_fixed[group1];
-                if(fixed1 != -1) {
-                    if(g != allele_assignment[fixed1][mat_fa]) {
-                        //fprintf(stderr, "FAG: %s:%d\n", __FILE__, __LINE__);
-                        return 0.0;
-                    }
+            else {
+                if(allele_assignment[par1][mat_fa] == g) {
+                    group_fixed[group1] = 0;
+                    prob[1][group1] = 0.0;
+                }
+                else if(allele_assignment[1 ^ par1][mat_fa] == g) {
+                    group_fixed[group1] = 1;
+                    prob[0][group1] = 0.0;
                 }
                 else {
-                    if(allele_assignment[0][mat_fa] == g) {
-                        group_fixed[group1] = 0;
-                        prob[1][group1] = 0.0;
-                    }
-                    else if(allele_assignment[1][mat_fa] == g) {
-                        group_fixed[group1] = 1;
-                        prob[0][group1] = 0.0;
-                    }
-                    else {
-                        //fprintf(stderr, "FAG: %s:%d\n", __FILE__, __LINE__);
-                        return 0.0;
-                    }
+                    return false;
                 }
             }
-            else {
-                group_membership[mat_fa] = group_index;
-                group_fixed[group_index] = 0;
-                group_active[group_index] = true;
-                group_size[group_index] = 1;
-                allele_assignment[0][mat_fa] = g;
-                prob[0][group_index] = get_freq(g);
-                prob[1][group_index] = 0.0;
-                
-                ++group_index;
-                ++num_groups;
-            }
         }
-        // not autozygous
         else {
-            group1 = group_membership[mat_fa];
-            group2 = group_membership[pat_fa];
+            group1 = new_component(mat_fa);
+            group_fixed[group1] = 0;
+            group_size[group1] = 1;
+            allele_assignment[0][mat_fa] = g;
+            prob[0][group1] = get_freq(g);
+            prob[1][group1] = 0.0;
+        }
+    }
+    // not autozygous
+    else {
+        group1 = find_component(mat_fa, par1);
+        group2 = find_component(pat_fa, par2);
+        
+        if(group1 != DEFAULT_COMPONENT) {
             
-            if(group1 != DEFAULT_COMPONENT) {
-                
-                fixed1 = group_fixed[group1];
-                
-                if(group2 != DEFAULT_COMPONENT) {
-                    // both in the same group
-                    if(group1 == group2) {
-                        if(fixed1 != -1) {
-                            // fixed, check if legit
-                            if(not legal(g, allele_assignment[fixed1][mat_fa], allele_assignment[fixed1][pat_fa])) {
-                                //fprintf(stderr, "FAG: %s:%d\n", __FILE__, __LINE__);
-                                return 0.0;
-                            }
-                        }
-                        else {
-                            // not fixed, check if still the case
-                            legal0 = legal(g, allele_assignment[0][mat_fa], allele_assignment[0][pat_fa]);
-                            legal1 = legal(g, allele_assignment[1][mat_fa], allele_assignment[1][pat_fa]);
-                            
-                            if(legal0) {
-                                if(not legal1) {
-                                    group_fixed[group1] = 0;
-                                    prob[1][group1] = 0.0;
-                                }
-                            }
-                            else {
-                                if(legal1) {
-                                    group_fixed[group1] = 1;
-                                    prob[0][group1] = 0.0;
-                                }
-                                else {
-                                    //fprintf(stderr, "FAG: %s:%d\n", __FILE__, __LINE__);
-                                    return 0.0;
-                                }
-                            }
+            fixed1 = group_fixed[group1];
+            
+            if(group2 != DEFAULT_COMPONENT) {
+                // both in the same group
+                if(group1 == group2) {
+                    if(fixed1 != -1) {
+                        // fixed, check if legit
+                        if(not legal(g, allele_assignment[fixed1 ^ par1][mat_fa], allele_assignment[fixed1 ^ par2][pat_fa])) {
+                            return false;
                         }
                     }
                     else {
-                        // in different groups
-                        fixed2 = group_fixed[group2];
+                        // not fixed, check if still the case
+                        legal0 = legal(g, allele_assignment[par1][mat_fa], allele_assignment[par2][pat_fa]);
+                        legal1 = legal(g, allele_assignment[1 ^ par1][mat_fa], allele_assignment[1 ^ par2][pat_fa]);
                         
-                        if(fixed1 != -1) {
-                            if(fixed2 != -1) {
-                                // fixed, check if legit
-                                if(not legal(g, allele_assignment[fixed1][mat_fa], allele_assignment[fixed2][pat_fa])) {
-                                    //fprintf(stderr, "FAG: %s:%d\n", __FILE__, __LINE__);
-                                    return 0.0;
-                                }
+                        if(legal0) {
+                            if(not legal1) {
+                                group_fixed[group1] = 0;
+                                prob[1][group1] = 0.0;
+                            }
+                        }
+                        else {
+                            if(legal1) {
+                                group_fixed[group1] = 1;
+                                prob[0][group1] = 0.0;
                             }
                             else {
-                                // group1 is fixed, which assignment for group 2 works
-                                legal0 = legal(g, allele_assignment[fixed1][mat_fa], allele_assignment[0][pat_fa]);
-                                legal1 = legal(g, allele_assignment[fixed1][mat_fa], allele_assignment[1][pat_fa]);
-                                
-                                if(legal0)
-                                    fixed2 = 0;
-                                else if(legal1)
-                                    fixed2 = 1;
-                                else {
-                                    //fprintf(stderr, "FAG: %s:%d\n", __FILE__, __LINE__);
-                                    return 0.0;
-                                }
+                                return false;
                             }
                         }
-                        else if(fixed2 != -1) {
-                            // group2 is fixed, which assignment for group 1 works
-                            legal0 = legal(g, allele_assignment[0][mat_fa], allele_assignment[fixed2][pat_fa]);
-                            legal1 = legal(g, allele_assignment[1][mat_fa], allele_assignment[fixed2][pat_fa]);
-                            
-                            if(legal0)
-                                fixed1 = 0;
-                            else if(legal1)
-                                fixed1 = 1;
-                            else {
-                                //fprintf(stderr, "FAG: %s:%d\n", __FILE__, __LINE__);
-                                return 0.0;
+                    }
+                }
+                else {
+                    // in different groups
+                    fixed2 = group_fixed[group2];
+                    
+                    if(fixed1 != -1) {
+                        if(fixed2 != -1) {
+                            // fixed, check if legit
+                            if(not legal(g, allele_assignment[fixed1 ^ par1][mat_fa], allele_assignment[fixed2 ^ par2][pat_fa])) {
+                                return false;
                             }
                         }
                         else {
-                            // neither group1 nor group2 are fixed
-                            legal0 = legal(g, allele_assignment[0][mat_fa], allele_assignment[0][pat_fa]);
-                            legal1 = legal(g, allele_assignment[1][mat_fa], allele_assignment[0][pat_fa]);
-                            legal2 = legal(g, allele_assignment[0][mat_fa], allele_assignment[1][pat_fa]);
-                            legal3 = legal(g, allele_assignment[1][mat_fa], allele_assignment[1][pat_fa]);
+                            // group1 is fixed, which assignment for group 2 works
+                            legal0 = legal(g, allele_assignment[fixed1 ^ par1][mat_fa], allele_assignment[par2][pat_fa]);
+                            legal1 = legal(g, allele_assignment[fixed1 ^ par1][mat_fa], allele_assignment[1 ^ par2][pat_fa]);
                             
-                            if(not (legal0 or legal1 or legal2 or legal3)) {
-                                //fprintf(stderr, "FAG: %s:%d\n", __FILE__, __LINE__);
-                                return 0.0;
-                            }
-                            
-                            if(legal0 and not(legal1 or legal2 or legal3)) {
-                                // fixed, allele 0, no swap
-                                fixed1 = fixed2 = 0;
-                            }
-                            else if(legal1 and not(legal0 or legal2 or legal3)) {
-                                // fixed, swap assignment in one group
-                                fixed1 = 1;
+                            if(legal0)
                                 fixed2 = 0;
-                            }
-                            else if(legal2 and not(legal0 or legal1 or legal3)) {
-                                // fixed, swap assignment in one group
-                                fixed1 = 0;
+                            else if(legal1)
                                 fixed2 = 1;
-                            }
-                            else if(legal3 and not(legal0 or legal1 or legal2)) {
-                                // fixed, allele 1, no swap
-                                fixed1 = fixed2 = 1;
-                            }
-                            else if(legal0 and legal3 and not (legal1 or legal2)){
-                                // still unfixed, assignments don't need swapping
-                                fixed1 = fixed2 = -1;
-                            }
-                            else if(legal1 and legal2 and not (legal0 or legal3)){
-                                // still unfixed, swap assignment in one group
-                                fixed1 = fixed2 = -2;
-                            }
                             else {
-                                // all true, assignments don't need swapping
-                                fixed1 = fixed2 = -1;
+                                return false;
                             }
                         }
+                    }
+                    else if(fixed2 != -1) {
+                        // group2 is fixed, which assignment for group 1 works
+                        legal0 = legal(g, allele_assignment[par1][mat_fa], allele_assignment[fixed2 ^ par2][pat_fa]);
+                        legal1 = legal(g, allele_assignment[1 ^ par1][mat_fa], allele_assignment[fixed2 ^ par2][pat_fa]);
                         
-
-
-                        if(fixed1 != fixed2) {
-                            // XXX for now, always keep group1
-                            group_fixed[group1] = fixed1;
-                            prob[1-fixed1][group1] = 0.0;
-                            prob[1-fixed2][group2] = 0.0;
-                            combine_components(group1, group2, true);
-                        }
+                        if(legal0)
+                            fixed1 = 0;
+                        else if(legal1)
+                            fixed1 = 1;
                         else {
-                            if(fixed1 == -2) {
-                                group_fixed[group1] = -1;
-                                combine_components(group1, group2, true);
-                            }
-                            else {
-                                group_fixed[group1] = fixed1;
-                                if(fixed1 != -1) {
-                                    prob[1-fixed1][group1] = 0.0;
-                                    prob[1-fixed2][group2] = 0.0;
-                                }
-                                combine_components(group1, group2, false);
-
-                            }
+                            return false;
                         }
-                        
-                        --num_groups;
                     }
-                }
-                else {
-                    if(fixed1 != -1) {
-                        tmp0 = get_other_allele(g, allele_assignment[fixed1][mat_fa]);
+                    else {
+                        // neither group1 nor group2 are fixed
+                        legal0 = legal(g, allele_assignment[par1][mat_fa], allele_assignment[par2][pat_fa]);
+                        legal1 = legal(g, allele_assignment[1 ^ par1][mat_fa], allele_assignment[par2][pat_fa]);
+                        legal2 = legal(g, allele_assignment[par1][mat_fa], allele_assignment[1 ^ par2][pat_fa]);
+                        legal3 = legal(g, allele_assignment[1 ^ par1][mat_fa], allele_assignment[1 ^ par2][pat_fa]);
+                        
+                        if(not (legal0 or legal1 or legal2 or legal3)) {
+                            return false;
+                        }
                         
-                        if(tmp0 == UNTYPED) {
-                            //fprintf(stderr, "FAG: %s:%d\n", __FILE__, __LINE__);
-                            return 0.0;
+                        if(legal0 and not(legal1 or legal2 or legal3)) {
+                            // fixed, allele 0, no swap
+                            fixed1 = fixed2 = 0;
+                        }
+                        else if(legal1 and not(legal0 or legal2 or legal3)) {
+                            // fixed, swap assignment in one group
+                            fixed1 = 1;
+                            fixed2 = 0;
+                        }
+                        else if(legal2 and not(legal0 or legal1 or legal3)) {
+                            // fixed, swap assignment in one group
+                            fixed1 = 0;
+                            fixed2 = 1;
+                        }
+                        else if(legal3 and not(legal0 or legal1 or legal2)) {
+                            // fixed, allele 1, no swap
+                            fixed1 = fixed2 = 1;
+                        }
+                        else if(legal0 and legal3 and not (legal1 or legal2)){
+                            // still unfixed, assignments don't need swapping
+                            fixed1 = fixed2 = -1;
+                        }
+                        else if(legal1 and legal2 and not (legal0 or legal3)){
+                            // still unfixed, swap assignment in one group
+                            fixed1 = fixed2 = -2;
                         }
                         else {
-                            allele_assignment[fixed1][pat_fa] = tmp0;
-                            prob[fixed1][group1] *= get_freq(tmp0);
+                            // all true, assignments don't need swapping
+                            fixed1 = fixed2 = -1;
                         }
                     }
+                    
+                    if(fixed1 != fixed2) {
+                        group_fixed[group1] = fixed1;
+                        prob[1-fixed1][group1] = 0.0;
+                        prob[1-fixed2][group2] = 0.0;
+                        combine_components(group1, group2, true);
+                    }
                     else {
-                        tmp0 = get_other_allele(g, allele_assignment[0][mat_fa]);
-                        tmp1 = get_other_allele(g, allele_assignment[1][mat_fa]);
-                        
-                        if(tmp0 != UNTYPED) {
-                            if(tmp1 != UNTYPED) {
-                                allele_assignment[0][pat_fa] = tmp0;
-                                allele_assignment[1][pat_fa] = tmp1;
-                                prob[0][group1] *= get_freq(tmp0);
-                                prob[1][group1] *= get_freq(tmp1);
-                            }
-                            else {
-                                allele_assignment[0][pat_fa] = tmp0;
-                                prob[0][group1] *= get_freq(tmp0);
-                                prob[1][group1] = 0.0;
-                                group_fixed[group1] = 0;
-                            }
+                        if(fixed1 == -2) {
+                            group_fixed[group1] = -1;
+                            combine_components(group1, group2, true);
                         }
                         else {
-                            if(tmp1 != UNTYPED) {
-                                allele_assignment[1][pat_fa] = tmp1;
-                                prob[1][group1] *= get_freq(tmp1);
-                                prob[0][group1] = 0.0;
-                                group_fixed[group1] = 1;
-                            }
-                            else {
-                                //fprintf(stderr, "FAG: %s:%d\n", __FILE__, __LINE__);
-                                return 0.0;
+                            group_fixed[group1] = fixed1;
+                            if(fixed1 != -1) {
+                                prob[1-fixed1][group1] = 0.0;
+                                prob[1-fixed2][group2] = 0.0;
                             }
+                            combine_components(group1, group2, false);
                         }
                     }
-                    
-                    group_membership[pat_fa] = group1;
-                    group_size[group1] += 1;
                 }
             }
-            else if(group2 != DEFAULT_COMPONENT) {
-                
-                fixed2 = group_fixed[group2];
-                
-                if(fixed2 != -1) {
-                    tmp0 = get_other_allele(g, allele_assignment[fixed2][pat_fa]);
+            else {
+                if(fixed1 != -1) {
+                    tmp0 = get_other_allele(g, allele_assignment[fixed1 ^ par1][mat_fa]);
                     
                     if(tmp0 == UNTYPED) {
-                        //fprintf(stderr, "FAG: %s:%d\n", __FILE__, __LINE__);
-                        return 0.0;
+                        return false;
                     }
                     else {
-                        allele_assignment[fixed2][mat_fa] = tmp0;
-                        prob[fixed2][group2] *= get_freq(tmp0);
+                        allele_assignment[fixed1][pat_fa] = tmp0;
+                        prob[fixed1][group1] *= get_freq(tmp0);
                     }
                 }
                 else {
-                    tmp0 = get_other_allele(g, allele_assignment[0][pat_fa]);
-                    tmp1 = get_other_allele(g, allele_assignment[1][pat_fa]);
+                    tmp0 = get_other_allele(g, allele_assignment[par1][mat_fa]);
+                    tmp1 = get_other_allele(g, allele_assignment[1 ^ par1][mat_fa]);
                     
                     if(tmp0 != UNTYPED) {
                         if(tmp1 != UNTYPED) {
-                            allele_assignment[0][mat_fa] = tmp0;
-                            allele_assignment[1][mat_fa] = tmp1;
-                            prob[0][group2] *= get_freq(tmp0);
-                            prob[1][group2] *= get_freq(tmp1);
+                            allele_assignment[0][pat_fa] = tmp0;
+                            allele_assignment[1][pat_fa] = tmp1;
+                            prob[0][group1] *= get_freq(tmp0);
+                            prob[1][group1] *= get_freq(tmp1);
                         }
                         else {
-                            allele_assignment[0][mat_fa] = tmp0;
-                            prob[0][group2] *= get_freq(tmp0);
-                            prob[1][group2] = 0.0;
-                            group_fixed[group2] = 0;
+                            allele_assignment[0][pat_fa] = tmp0;
+                            prob[0][group1] *= get_freq(tmp0);
+                            prob[1][group1] = 0.0;
+                            group_fixed[group1] = 0;
                         }
                     }
                     else {
                         if(tmp1 != UNTYPED) {
-                            allele_assignment[1][mat_fa] = tmp1;
-                            prob[1][group2] *= get_freq(tmp1);
-                            prob[0][group2] = 0.0;
-                            group_fixed[group2] = 1;
+                            allele_assignment[1][pat_fa] = tmp1;
+                            prob[1][group1] *= get_freq(tmp1);
+                            prob[0][group1] = 0.0;
+                            group_fixed[group1] = 1;
                         }
                         else {
-                            //fprintf(stderr, "FAG: %s:%d\n", __FILE__, __LINE__);
-                            return 0.0;
+                            return false;
                         }
                     }
                 }
                 
-                group_membership[mat_fa] = group2;
-                group_size[group2] += 1;
+                add_to_component(pat_fa, group1);
             }
-            else {
-                if(g == HETERO) {
-                    allele_assignment[0][mat_fa] = allele_assignment[1][pat_fa] = HOMOZ_A;
-                    allele_assignment[1][mat_fa] = allele_assignment[0][pat_fa] = HOMOZ_B;
-                    prob[0][group_index] = \
-                        prob[1][group_index] = major_freq * minor_freq;
-                    group_fixed[group_index] = -1;
+        }
+        else if(group2 != DEFAULT_COMPONENT) {
+            
+            fixed2 = group_fixed[group2];
+            
+            if(fixed2 != -1) {
+                tmp0 = get_other_allele(g, allele_assignment[fixed2 ^ par2][pat_fa]);
+                
+                if(tmp0 == UNTYPED) {
+                    return false;
                 }
                 else {
-                    allele_assignment[0][mat_fa] = allele_assignment[0][pat_fa] = g;
-                    prob[0][group_index] = get_freq(g) * get_freq(g);
-                    prob[1][group_index] = 0.0;
-                    group_fixed[group_index] = 0;
+                    allele_assignment[fixed2][mat_fa] = tmp0;
+                    prob[fixed2][group2] *= get_freq(tmp0);
                 }
-                
-                // neither in a group
-                group_membership[mat_fa] = \
-                    group_membership[pat_fa] = group_index;
-                group_size[group_index] = 2;
-                group_active[group_index] = true;
-                ++group_index;
-                ++num_groups;
             }
-        }
-        
-#ifdef LKG_DEBUG
-        // check probs
-        for(int j = 0; j < group_index; ++j) {
-            if(group_active[j]) {
-                if(group_fixed[j] == -1) {
-                    if((prob[0][j] <= 0.0) or (prob[0][j] > 1.0) or (prob[1][j] <= 0.0) or (prob[1][j] > 1.0)) {
-                        fprintf(stderr, "founder allele graph is corrupt %s:%d\n", __FILE__, __LINE__);
-                        abort();
+            else {
+                tmp0 = get_other_allele(g, allele_assignment[par2][pat_fa]);
+                tmp1 = get_other_allele(g, allele_assignment[1 ^ par2][pat_fa]);
+                
+                if(tmp0 != UNTYPED) {
+                    if(tmp1 != UNTYPED) {
+                        allele_assignment[0][mat_fa] = tmp0;
+                        allele_assignment[1][mat_fa] = tmp1;
+                        prob[0][group2] *= get_freq(tmp0);
+                        prob[1][group2] *= get_freq(tmp1);
+                    }
+                    else {
+                        allele_assignment[0][mat_fa] = tmp0;
+                        prob[0][group2] *= get_freq(tmp0);
+                        prob[1][group2] = 0.0;
+                        group_fixed[group2] = 0;
                     }
                 }
                 else {
-                    if((prob[group_fixed[j]][j] <= 0.0) or (prob[group_fixed[j]][j] > 1.0) or (prob[1-group_fixed[j]][j]) != 0.0) {
-                        fprintf(stderr, "founder allele graph is corrupt %s:%d\n", __FILE__, __LINE__);
-                        abort();
+                    if(tmp1 != UNTYPED) {
+                        allele_assignment[1][mat_fa] = tmp1;
+                        prob[1][group2] *= get_freq(tmp1);
+                        prob[0][group2] = 0.0;
+                        group_fixed[group2] = 1;
+                    }
+                    else {
+                        return false;
                     }
                 }
             }
+            
+            add_to_component(mat_fa, group2);
+        }
+        else {
+            // neither in a group
+            group1 = new_component(mat_fa);
+            add_to_component(pat_fa, group1);
+            
+            if(g == HETERO) {
+                allele_assignment[0][mat_fa] = allele_assignment[1][pat_fa] = HOMOZ_A;
+                allele_assignment[1][mat_fa] = allele_assignment[0][pat_fa] = HOMOZ_B;
+                prob[0][group1] = \
+                    prob[1][group1] = major_freq * minor_freq;
+                group_fixed[group1] = -1;
+            }
+            else {
+                allele_assignment[0][mat_fa] = allele_assignment[0][pat_fa] = g;
+                prob[0][group1] = get_freq(g) * get_freq(g);
+                prob[1][group1] = 0.0;
+                group_fixed[group1] = 0;
+            }
+            
+            group_size[group1] = 2;
         }
-#endif
     }
     
-    // calculate likelihood
-    double ret_prob = 1.0;
-    
-    for(int i = 0; i < group_index; ++i) {
-        if(group_active[i] /*and (group_size[i] > 1)*/) {
-            fixed1 = group_fixed[i];
-            if(fixed1 != -1) {
-                ret_prob *= prob[fixed1][i];
+#ifdef LKG_DEBUG
+    // check probs
+    for(int j = 0; j < group_index; ++j) {
+        int k = components[j];
+        
+        if(group_active[k]) {
+            if(group_fixed[k] == -1) {
+                if((prob[0][k] <= 0.0) or (prob[0][k] > 1.0) or (prob[1][k] <= 0.0) or (prob[1][k] > 1.0)) {
+                    fprintf(stderr, "founder allele graph is corrupt %s:%d\n", __FILE__, __LINE__);
+                    abort();
+                }
             }
             else {
-                ret_prob *= (prob[0][i] + prob[1][i]);
+                if((prob[group_fixed[k]][k] <= 0.0) or (prob[group_fixed[k]][k] > 1.0) or (prob[1-group_fixed[k]][k]) != 0.0) {
+                    fprintf(stderr, "founder allele graph is corrupt %s:%d\n", __FILE__, __LINE__);
+                    abort();
+                }
             }
         }
     }
+#endif
+    
+    return true;
+}
+
+double FounderAlleleGraph4::component_likelihood(int root) {
+    int fixed = group_fixed[root];
+    
+    return (fixed != -1) ? prob[fixed][root] : (prob[0][root] + prob[1][root]);
+}
+
+// product of every component created since start_components()
+double FounderAlleleGraph4::components_likelihood() {
+    double ret_prob = 1.0;
+    
+    for(int i = 0; i < group_index; ++i) {
+        int root = components[i];
+        
+        if(group_active[root]) {
+            ret_prob *= component_likelihood(root);
+        }
+    }
     
     return ret_prob;
 }
 
+// records the components created since start_components() from the typed
+// people in 'people', whose founder alleles must not belong to any saved
+// component
+void FounderAlleleGraph4::save_components(vector<int>& people) {
+    int par;
+    
+    for(unsigned i = 0; i < people.size(); ++i) {
+        int tmp = people[i] * 2;
+        int root = find_component(edge_list[tmp], par);
+        
+        root_members[root].push_back(people[i]);
+        fa_component[edge_list[tmp]] = root;
+        
+        if(not (sex_linked and ped->get_by_index(people[i])->ismale())) {
+            fa_component[edge_list[tmp + 1]] = root;
+        }
+    }
+    
+    for(int i = 0; i < group_index; ++i) {
+        int root = components[i];
+        
+        if(group_active[root]) {
+            roots.push_back(root);
+            root_likelihood[root] = component_likelihood(root);
+        }
+    }
+}
+
+void FounderAlleleGraph4::remove_root(int root) {
+    vector<int>::iterator it = find(roots.begin(), roots.end(), root);
+    
+    *it = roots.back();
+    roots.pop_back();
+    
+    root_members[root].clear();
+}
+
+// returns the root of the component fa is in (and fa's parity relative to
+// it) or DEFAULT_COMPONENT if fa has not been seen during this call, every
+// founder allele on the path is pointed straight at the root
+int FounderAlleleGraph4::find_component(int fa, int& parity) {
+    if(uf_stamp[fa] != stamp) {
+        parity = 0;
+        return DEFAULT_COMPONENT;
+    }
+    
+    int root = fa;
+    int root_parity = 0;
+    
+    while(uf_parent[root] != root) {
+        root_parity ^= uf_parity[root];
+        root = uf_parent[root];
+    }
+    
+    int node = fa;
+    int node_parity = root_parity;
+    
+    while(node != root) {
+        int next = uf_parent[node];
+        int next_parity = node_parity ^ uf_parity[node];
+        
+        uf_parent[node] = root;
+        uf_parity[node] = node_parity;
+        
+        node = next;
+        node_parity = next_parity;
+    }
+    
+    parity = root_parity;
+    return root;
+}
+
+int FounderAlleleGraph4::new_component(int fa) {
+    uf_stamp[fa] = stamp;
+    uf_parent[fa] = fa;
+    uf_parity[fa] = 0;
+    uf_rank[fa] = 0;
+    
+    group_active[fa] = true;
+    group_order[fa] = group_index;
+    components[group_index] = fa;
+    ++group_index;
+    
+    return fa;
+}
+
+// fa is new, so its allele assignments are written relative to root (a 
+// single founder allele never outranks a root, so root stays the root)
+void FounderAlleleGraph4::add_to_component(int fa, int root) {
+    uf_stamp[fa] = stamp;
+    uf_rank[fa] = 0;
+    
+    link_components(root, fa, false);
+    
+    group_size[root] += 1;
+}
+
+// component2 goes under component1 unless its tree is taller, returns the
+// surviving root
+int FounderAlleleGraph4::link_components(int component1, int component2, bool flip) {
+    int root = component1;
+    int child = component2;
+    
+    if(uf_rank[component1] < uf_rank[component2]) {
+        root = component2;
+        child = component1;
+    }
+    else if(uf_rank[component1] == uf_rank[component2]) {
+        uf_rank[component1] += 1;
+    }
+    
+    uf_parent[child] = root;
+    uf_parity[child] = flip ? 1 : 0;
+    
+    group_active[root] = true;
+    group_active[child] = false;
+    
+    // root takes over component1's place, its old place now holds a 
+    // founder allele that is no longer a root
+    if(root != component1) {
+        components[group_order[root]] = child;
+    }
+    
+    group_order[root] = group_order[component1];
+    components[group_order[root]] = root;
+    
+    return root;
+}
+
 // should be cached, this is temporary
 double FounderAlleleGraph4::get_freq(enum unphased_genotype g) {
     return (g == HOMOZ_A) ? major_freq : minor_freq;
@@ -499,45 +668,37 @@ void FounderAlleleGraph4::valid_genotype(enum unphased_genotype g) {
 }
 
 // merge component2 into component1
-// flip means that you should swap the allele assignments for things that
-// were in component2
+// flip means that the allele assignments of component2 are the other way 
+// around to those of component1, the merged component is described in 
+// terms of component1 whichever root survives
 void FounderAlleleGraph4::combine_components(int component1, int component2, bool flip) {
-    enum unphased_genotype tmp;
-    
-    //fprintf(stderr, "combine\n");
+    double prob0, prob1;
+    int fixed = group_fixed[component1];
+    int size = group_size[component1] + group_size[component2];
     
-    for(unsigned int i = 0; i < founder_alleles; ++i) {
-        if(group_membership[i] == component2) {
-            group_membership[i] = component1;
-            
-            if(flip) {
-                tmp = allele_assignment[0][i];
-                allele_assignment[0][i] = allele_assignment[1][i];
-                allele_assignment[1][i] = tmp;
-            }
-        }
+    if(flip) {
+        prob0 = prob[0][component1] * prob[1][component2];
+        prob1 = prob[1][component1] * prob[0][component2];
     }
-    
-    /*
-    if((group_fixed[component1] != -1) and (group_fixed[component2] != -1)) {
-        prob[group_fixed[component1]][component1] *= prob[group_fixed[component2]][component2];
+    else { 
+        prob0 = prob[0][component1] * prob[0][component2];
+        prob1 = prob[1][component1] * prob[1][component2];
     }
-    else {
-    */
-        if(flip) {
-            prob[0][component1] *= prob[1][component2];
-            prob[1][component1] *= prob[0][component2];
-        }
-        else { 
-            prob[0][component1] *= prob[0][component2];
-            prob[1][component1] *= prob[1][component2];
-        }
-    //}
     
+    int root = link_components(component1, component2, flip);
     
-    group_size[component1] += group_size[component2];
+    if((root == component2) and flip) {
+        swap(prob0, prob1);
+        
+        if(fixed != -1) {
+            fixed = 1 - fixed;
+        }
+    }
     
-    group_active[component2] = false;
+    prob[0][root] = prob0;
+    prob[1][root] = prob1;
+    group_fixed[root] = fixed;
+    group_size[root] = size;
 }
 
 void FounderAlleleGraph4::reset(DescentGraph& dg) {
@@ -566,33 +727,394 @@ void FounderAlleleGraph4::reset(DescentGraph& dg) {
 	        edge_list[tmp + 1] = edge_list[(p->get_paternalid() * 2) + parent_allele];
 	    }
 	}
+	
+	valid = false;
+	complete = false;
 }
 
-void FounderAlleleGraph4::flip(DescentGraph& dg, unsigned int personid, enum parentage allele) {
-    Person* p = ped->get_by_index(personid);
+// a flip moves the people below personid that inherited old_fa onto new_fa,
+// so the only typed people that can change component are those in the 
+// components of old_fa and new_fa, every other component is unaffected. the
+// likelihood of the flipped graph is those people evaluated on their own 
+// (with the proposed founder alleles) times the saved likelihoods of the 
+// other components, nothing needs to be flipped back afterwards
+//
+// people are added in the same order as in likelihood() (components keep 
+// their members sorted), the result of add_person() depends on the order
+double FounderAlleleGraph4::flip_likelihood(DescentGraph& dg, unsigned int personid, enum parentage allele) {
+    double ret_prob = incremental_flip_likelihood(dg, personid, allele);
+    
+#ifdef LKG_DEBUG
+    check_flip_likelihood(dg, personid, allele, ret_prob);
+#endif
     
-    enum parentage allele_value = static_cast<enum parentage>(dg.get(personid, locus, allele));
+    return ret_prob;
+}
+
+double FounderAlleleGraph4::incremental_flip_likelihood(DescentGraph& dg, unsigned int personid, enum parentage allele) {
+    Person* p = ped->get_by_index(personid);
     
     int tmp = p->get_parentid(allele) * 2;
     int old_fa = edge_list[(personid * 2) + allele];
     int new_fa = ((edge_list[tmp] == old_fa) ? edge_list[tmp + 1] : edge_list[tmp]);
+    int component1 = DEFAULT_COMPONENT;
+    int component2 = DEFAULT_COMPONENT;
+    
+    if(not valid) {
+        save_graph();
+    }
+    
+    if(old_fa == new_fa) {
+        return valid ? total_likelihood : 0.0;
+    }
+    
+    affected.clear();
+    
+    if(valid) {
+        component1 = fa_component[old_fa];
+        component2 = fa_component[new_fa];
+        
+        // only untyped people change
+        if(component1 == DEFAULT_COMPONENT) {
+            return total_likelihood;
+        }
+        
+        affected.insert(affected.end(), root_members[component1].begin(), root_members[component1].end());
+        
+        if((component2 != DEFAULT_COMPONENT) and (component2 != component1)) {
+            affected.insert(affected.end(), root_members[component2].begin(), root_members[component2].end());
+            inplace_merge(affected.begin(), affected.begin() + root_members[component1].size(), affected.end());
+        }
+    }
+    else {
+        // the current graph is illegal, so there is nothing to start from
+        for(unsigned i = 0; i < ped->num_members(); ++i) {
+            affected.push_back(i);
+        }
+    }
+    
+    if(++proposal == 0) {
+        proposal_stamp.assign(proposal_stamp.size(), 0);
+        proposal = 1;
+    }
+    
+    propagate_fa_update(dg, personid, allele, new_fa, true);
+    
+    start_components();
+    
+    for(unsigned i = 0; i < affected.size(); ++i) {
+        tmp = affected[i] * 2;
+        
+        if(not add_person(affected[i], ped->get_by_index(affected[i])->get_genotype(locus), proposed_edge(tmp), proposed_edge(tmp + 1))) {
+            return 0.0;
+        }
+    }
+    
+    double ret_prob = components_likelihood();
     
-    propagate_fa_update(dg, p, allele, allele_value, new_fa);
+    if(valid) {
+        for(unsigned i = 0; i < roots.size(); ++i) {
+            if((roots[i] != component1) and (roots[i] != component2)) {
+                ret_prob *= root_likelihood[roots[i]];
+            }
+        }
+    }
+    
+    return ret_prob;
 }
 
-void FounderAlleleGraph4::propagate_fa_update(DescentGraph& dg, Person* p, enum parentage allele, 
-                                                enum parentage allele_value, int new_fa) {
+// if the components are valid they are updated in the same way as in 
+// flip_likelihood()
+void FounderAlleleGraph4::flip(DescentGraph& dg, unsigned int personid, enum parentage allele) {
+    Person* p = ped->get_by_index(personid);
+    
+    int tmp = p->get_parentid(allele) * 2;
+    int old_fa = edge_list[(personid * 2) + allele];
+    int new_fa = ((edge_list[tmp] == old_fa) ? edge_list[tmp + 1] : edge_list[tmp]);
+    int component1 = valid ? fa_component[old_fa] : DEFAULT_COMPONENT;
+    int component2 = valid ? fa_component[new_fa] : DEFAULT_COMPONENT;
+    
+    if(old_fa == new_fa) {
+        return;
+    }
     
-    if(dg.get(p->get_internalid(), locus, allele) != allele_value) {
+    // if the components are valid, only untyped people are affected
+    if(component1 == DEFAULT_COMPONENT) {
+        propagate_fa_update(dg, personid, allele, new_fa, false);
+        
+        if(not valid) {
+            complete = false;
+        }
+        
         return;
     }
     
-    enum parentage new_allele = p->isfemale() ? MATERNAL : PATERNAL;
+    affected.assign(root_members[component1].begin(), root_members[component1].end());
+    remove_root(component1);
     
-    for(unsigned i = 0; i < p->num_children(); ++i) {
-        propagate_fa_update(dg, p->get_child(i), new_allele, allele, new_fa);
+    if((component2 != DEFAULT_COMPONENT) and (component2 != component1)) {
+        affected.insert(affected.end(), root_members[component2].begin(), root_members[component2].end());
+        inplace_merge(affected.begin(), affected.end() - root_members[component2].size(), affected.end());
+        remove_root(component2);
     }
     
-    edge_list[(p->get_internalid() * 2) + allele] = new_fa;
+    for(unsigned i = 0; i < affected.size(); ++i) {
+        tmp = affected[i] * 2;
+        
+        fa_component[edge_list[tmp]] = DEFAULT_COMPONENT;
+        
+        if(not (sex_linked and ped->get_by_index(affected[i])->ismale())) {
+            fa_component[edge_list[tmp + 1]] = DEFAULT_COMPONENT;
+        }
+    }
+    
+    propagate_fa_update(dg, personid, allele, new_fa, false);
+    
+    start_components();
+    
+    for(unsigned i = 0; i < affected.size(); ++i) {
+        tmp = affected[i] * 2;
+        
+        if(not add_person(affected[i], ped->get_by_index(affected[i])->get_genotype(locus), edge_list[tmp], edge_list[tmp + 1])) {
+            valid = false;
+#ifdef LKG_DEBUG
+            check_likelihood(0.0, edge_list, __func__);
+#endif
+            return;
+        }
+    }
+    
+    save_components(affected);
+    
+    total_likelihood = 1.0;
+    
+    for(unsigned i = 0; i < roots.size(); ++i) {
+        total_likelihood *= root_likelihood[roots[i]];
+    }
+    
+#ifdef LKG_DEBUG
+    check_likelihood(total_likelihood, edge_list, __func__);
+#endif
 }
 
+// probs[c] is the likelihood with meiosis i flipped for every bit i set in 
+// c, the combinations are visited in gray code order, so each one is a 
+// single flip() from the last and the graph ends up as it started
+//
+// flipping one meiosis must not change which founder allele another of 
+// them carries or which of them a descendant inherits (e.g. the meioses 
+// of a sibship), dg is not changed so propagate_fa_update() would not see it
+void FounderAlleleGraph4::flip_combinations(DescentGraph& dg, int n, const unsigned int* people, const enum parentage* alleles, double* probs) {
+    int combinations = 1 << n;
+    
+    if(not valid) {
+        save_graph();
+    }
+    
+    probs[0] = likelihood();
+    
+    for(int i = 1; i < combinations; ++i) {
+        int bit = 0;
+        
+        while(((i >> bit) & 1) == 0) {
+            ++bit;
+        }
+        
+        // flip() can only update the components incrementally from a 
+        // legal graph
+        if((not valid) and (probs[(i - 1) ^ ((i - 1) >> 1)] != 0.0)) {
+            save_graph();
+        }
+        
+        bool was_valid = valid;
+        
+        flip(dg, people[bit], alleles[bit]);
+        
+        // flip() found the new graph to be illegal
+        probs[i ^ (i >> 1)] = (was_valid and not valid) ? 0.0 : likelihood();
+    }
+    
+    // the last gray code only has the top bit set
+    flip(dg, people[n - 1], alleles[n - 1]);
+}
+
+// every descendant that inherited the flipped founder allele (all the way 
+// down from personid) now carries new_fa instead, children are taken from 
+// the pedigree's flat child lists and the traversal uses an explicit stack, 
+// a child is only visited if its meiosis picked the allele that changed
+//
+// if proposed is true the new founder alleles are only recorded for 
+// proposed_edge(), edge_list is left as it is
+void FounderAlleleGraph4::propagate_fa_update(DescentGraph& dg, unsigned int personid, enum parentage allele, 
+                                                int new_fa, bool proposed) {
+    
+    pending.clear();
+    pending.push_back((personid * 2) + allele);
+    
+    while(not pending.empty()) {
+        int index = pending.back();
+        int pid = index / 2;
+        int inherited = index % 2;  // which of pid's alleles changed
+        
+        pending.pop_back();
+        
+        if(proposed) {
+            proposal_stamp[index] = proposal;
+            proposal_fa[index] = new_fa;
+        }
+        else {
+            edge_list[index] = new_fa;
+        }
+        
+        for(int j = ped->children_begin(pid); j < ped->children_end(pid); ++j) {
+            int child = ped->get_child_meiosis(j);
+            
+            if(dg.get(child / 2, locus, static_cast<enum parentage>(child % 2)) == inherited) {
+                pending.push_back(child);
+            }
+        }
+    }
+}
+
+#ifdef LKG_DEBUG
+// the likelihood of the graph with founder alleles 'edges' worked out from 
+// scratch, with a search over each component instead of the union-find, 
+// so that likelihood(), flip() and flip_likelihood() can be checked against 
+// it (build with -DLKG_DEBUG), the products are not taken in the same order
+// so they are only compared within a tolerance
+double FounderAlleleGraph4::reference_likelihood(const vector<int>& edges) {
+    unsigned int n = edges.size();
+    vector<vector<pair<int, enum unphased_genotype> > > adjacent(n);
+    vector<enum unphased_genotype> fixed(n, UNTYPED);
+    vector<enum unphased_genotype> assignment(n, UNTYPED);
+    vector<bool> used(n, false);
+    vector<bool> seen(n, false);
+    vector<int> members;
+    double total = 1.0;
+    
+    for(unsigned i = 0; i < ped->num_members(); ++i) {
+        Person* p = ped->get_by_index(i);
+        enum unphased_genotype g = p->get_genotype(locus);
+        int mat_fa = edges[i * 2];
+        int pat_fa = edges[(i * 2) + 1];
+        
+        if(g == UNTYPED)
+            continue;
+        
+        used[mat_fa] = true;
+        
+        if((mat_fa == pat_fa) or (sex_linked and p->ismale())) {
+            if((g == HETERO) or ((fixed[mat_fa] != UNTYPED) and (fixed[mat_fa] != g))) {
+                return 0.0;
+            }
+            
+            fixed[mat_fa] = g;
+        }
+        else {
+            used[pat_fa] = true;
+            adjacent[mat_fa].push_back(make_pair(pat_fa, g));
+            adjacent[pat_fa].push_back(make_pair(mat_fa, g));
+        }
+    }
+    
+    for(unsigned start = 0; start < n; ++start) {
+        if((not used[start]) or seen[start])
+            continue;
+        
+        // breadth-first, so every member after the first is assigned by 
+        // one that comes before it
+        members.assign(1, start);
+        seen[start] = true;
+        
+        for(unsigned j = 0; j < members.size(); ++j) {
+            for(unsigned k = 0; k < adjacent[members[j]].size(); ++k) {
+                int fa = adjacent[members[j]][k].first;
+                
+                if(not seen[fa]) {
+                    seen[fa] = true;
+                    members.push_back(fa);
+                }
+            }
+        }
+        
+        double component = 0.0;
+        
+        for(int a = 0; a < 2; ++a) {
+            bool legal_assignment = true;
+            double tmp = 1.0;
+            
+            for(unsigned j = 0; j < members.size(); ++j) {
+                assignment[members[j]] = UNTYPED;
+            }
+            
+            assignment[start] = (a == 0) ? HOMOZ_A : HOMOZ_B;
+            
+            for(unsigned j = 0; legal_assignment and (j < members.size()); ++j) {
+                int fa = members[j];
+                
+                if((fixed[fa] != UNTYPED) and (fixed[fa] != assignment[fa])) {
+                    legal_assignment = false;
+                    break;
+                }
+                
+                for(unsigned k = 0; k < adjacent[fa].size(); ++k) {
+                    int other = adjacent[fa][k].first;
+                    enum unphased_genotype g = get_other_allele(adjacent[fa][k].second, assignment[fa]);
+                    
+                    if((g == UNTYPED) or ((assignment[other] != UNTYPED) and (assignment[other] != g))) {
+                        legal_assignment = false;
+                        break;
+                    }
+                    
+                    assignment[other] = g;
+                }
+                
+                tmp *= get_freq(assignment[fa]);
+            }
+            
+            if(legal_assignment) {
+                component += tmp;
+            }
+        }
+        
+        total *= component;
+    }
+    
+    return total;
+}
+
+void FounderAlleleGraph4::check_likelihood(double value, const vector<int>& edges, const char* caller) {
+    double expected = reference_likelihood(edges);
+    
+    if(fabs(value - expected) > (1e-9 * max(value, expected))) {
+        fprintf(stderr, "error: founder allele graph likelihood at locus %d is %e in %s(), but %e when rebuilt (%s:%d)\n", 
+                locus, value, caller, expected, __FILE__, __LINE__);
+        abort();
+    }
+}
+
+// the founder alleles of the proposed graph are found again with 
+// propagate_fa_update(), which does not touch edge_list or the components
+void FounderAlleleGraph4::check_flip_likelihood(DescentGraph& dg, unsigned int personid, enum parentage allele, double value) {
+    Person* p = ped->get_by_index(personid);
+    
+    int tmp = p->get_parentid(allele) * 2;
+    int old_fa = edge_list[(personid * 2) + allele];
+    int new_fa = ((edge_list[tmp] == old_fa) ? edge_list[tmp + 1] : edge_list[tmp]);
+    
+    if(++proposal == 0) {
+        proposal_stamp.assign(proposal_stamp.size(), 0);
+        proposal = 1;
+    }
+    
+    propagate_fa_update(dg, personid, allele, new_fa, true);
+    
+    vector<int> edges(edge_list.size());
+    
+    for(unsigned i = 0; i < edges.size(); ++i) {
+        edges[i] = proposed_edge(i);
+    }
+    
+    check_likelihood(value, edges, "flip_likelihood");
+}
+#endif
@@ -14,6 +14,8 @@ class DescentGraph;
 #define DEFAULT_COMPONENT -1
 
 class FounderAlleleGraph4 {
+    
+    friend class FounderAlleleGraphBlock;
 	
     Pedigree* ped;
     GeneticMap* map;
@@ -22,12 +24,22 @@ class FounderAlleleGraph4 {
     double major_freq;
     double minor_freq;
     
-    int group_index;
+    int group_index;         // number of components created
     vector<int> edge_list;
-    vector<int> group_membership;
+    
+    // union-find over founder alleles, see likelihood()
+    unsigned int stamp;             // founder alleles seen in this call
+    vector<unsigned int> uf_stamp;  // have uf_stamp == stamp
+    vector<int> uf_parent;
+    vector<int> uf_rank;
+    vector<int> uf_parity;          // assignments swapped wrt the parent
+    vector<int> components;         // roots, in order of creation
+    
+    // indexed by root
     vector<int> group_fixed; // -1,0 or 1 - ie: -1 unfixed, 0,1 fixed to that index
     vector<bool> group_active;
     vector<int> group_size;
+    vector<int> group_order;        // index into components
     vector<vector<enum unphased_genotype> > allele_assignment;
     vector<vector<double> > prob;
     
@@ -35,13 +47,49 @@ class FounderAlleleGraph4 {
 
     bool sex_linked;
     
+    // the components of the whole graph, kept up to date by flip() so that
+    // flip_likelihood() only has to look at the components a flip touches
+    bool complete;                  // union-find holds all of edge_list
+    bool valid;
+    double total_likelihood;
+    vector<int> fa_component;       // root, or DEFAULT_COMPONENT if untouched
+    vector<int> roots;
+    vector<double> root_likelihood;
+    vector<vector<int> > root_members;  // typed people, indexed by root
+    vector<int> affected;
+    
+    // founder alleles a proposed flip would change, have proposal_stamp == 
+    // proposal
+    unsigned int proposal;
+    vector<unsigned int> proposal_stamp;
+    vector<int> proposal_fa;
+    vector<int> pending;            // edge list indices left to update, see propagate_fa_update()
+    
     
     bool legal(enum unphased_genotype obs, enum unphased_genotype a1, enum unphased_genotype a2);
     enum unphased_genotype get_other_allele(enum unphased_genotype obs, enum unphased_genotype a1);
+    int find_component(int fa, int& parity);
+    int new_component(int fa);
+    void add_to_component(int fa, int root);
+    int link_components(int component1, int component2, bool flip);
     void combine_components(int component1, int component2, bool flip);
-    void propagate_fa_update(DescentGraph& dg, Person* p, enum parentage allele, enum parentage allele_value, int new_fa);
+    bool save_graph();
+    void start_components();
+    bool add_person(unsigned int i, enum unphased_genotype g, int mat_fa, int pat_fa);
+    double component_likelihood(int root);
+    double components_likelihood();
+    void save_components(vector<int>& people);
+    void remove_root(int root);
+    int proposed_edge(int index) { return (proposal_stamp[index] == proposal) ? proposal_fa[index] : edge_list[index]; }
+    void propagate_fa_update(DescentGraph& dg, unsigned int personid, enum parentage allele, int new_fa, bool proposed);
     double get_freq(enum unphased_genotype g);
     void valid_genotype(enum unphased_genotype g);
+    double incremental_flip_likelihood(DescentGraph& dg, unsigned int personid, enum parentage p);
+#ifdef LKG_DEBUG
+    double reference_likelihood(const vector<int>& edges);
+    void check_likelihood(double value, const vector<int>& edges, const char* caller);
+    void check_flip_likelihood(DescentGraph& dg, unsigned int personid, enum parentage p, double value);
+#endif
     
  public :
 	FounderAlleleGraph4(Pedigree* p, GeneticMap* g, bool sex_linked) :
@@ -53,14 +101,32 @@ class FounderAlleleGraph4 {
         minor_freq(g->get_minor(locus)),
         group_index(0),
         edge_list(p->num_members() * 2, 0),
-        group_membership(founder_alleles, DEFAULT_COMPONENT),
+        stamp(0),
+        uf_stamp(founder_alleles, 0),
+        uf_parent(founder_alleles, 0),
+        uf_rank(founder_alleles, 0),
+        uf_parity(founder_alleles, 0),
+        components(founder_alleles, 0),
         group_fixed(founder_alleles, -1),
         group_active(founder_alleles, false),
         group_size(founder_alleles, 0),
+        group_order(founder_alleles, 0),
         allele_assignment(2, vector<enum unphased_genotype>(founder_alleles, UNTYPED)),
         prob(2, vector<double>(founder_alleles, 1.0)),
         sequence(NULL),
-        sex_linked(sex_linked) {}
+        sex_linked(sex_linked),
+        complete(false),
+        valid(false),
+        total_likelihood(0.0),
+        fa_component(founder_alleles, DEFAULT_COMPONENT),
+        roots(),
+        root_likelihood(founder_alleles, 1.0),
+        root_members(founder_alleles),
+        affected(),
+        proposal(0),
+        proposal_stamp(p->num_members() * 2, 0),
+        proposal_fa(p->num_members() * 2, 0),
+        pending() {}
     
 	FounderAlleleGraph4(const FounderAlleleGraph4& f) :
         ped(f.ped),
@@ -71,14 +137,32 @@ class FounderAlleleGraph4 {
         minor_freq(f.minor_freq),
         group_index(f.group_index),
         edge_list(f.edge_list),
-        group_membership(f.group_membership),
+        stamp(f.stamp),
+        uf_stamp(f.uf_stamp),
+        uf_parent(f.uf_parent),
+        uf_rank(f.uf_rank),
+        uf_parity(f.uf_parity),
+        components(f.components),
         group_fixed(f.group_fixed),
         group_active(f.group_active),
         group_size(f.group_size),
+        group_order(f.group_order),
         allele_assignment(f.allele_assignment),
         prob(f.prob),
         sequence(f.sequence),
-        sex_linked(f.sex_linked) {}
+        sex_linked(f.sex_linked),
+        complete(f.complete),
+        valid(f.valid),
+        total_likelihood(f.total_likelihood),
+        fa_component(f.fa_component),
+        roots(f.roots),
+        root_likelihood(f.root_likelihood),
+        root_members(f.root_members),
+        affected(f.affected),
+        proposal(f.proposal),
+        proposal_stamp(f.proposal_stamp),
+        proposal_fa(f.proposal_fa),
+        pending(f.pending) {}
     
 	~FounderAlleleGraph4() {}
     
@@ -93,16 +177,35 @@ class FounderAlleleGraph4 {
             group_index = rhs.group_index;
             
             edge_list = rhs.edge_list;
-            group_membership = rhs.group_membership;
+            stamp = rhs.stamp;
+            uf_stamp = rhs.uf_stamp;
+            uf_parent = rhs.uf_parent;
+            uf_rank = rhs.uf_rank;
+            uf_parity = rhs.uf_parity;
+            components = rhs.components;
             group_fixed = rhs.group_fixed;
             group_active = rhs.group_active;
             group_size = rhs.group_size;
+            group_order = rhs.group_order;
             allele_assignment = rhs.allele_assignment;
             prob = rhs.prob;
             
             sequence = rhs.sequence;
 
             sex_linked = rhs.sex_linked;
+            
+            complete = rhs.complete;
+            valid = rhs.valid;
+            total_likelihood = rhs.total_likelihood;
+            fa_component = rhs.fa_component;
+            roots = rhs.roots;
+            root_likelihood = rhs.root_likelihood;
+            root_members = rhs.root_members;
+            affected = rhs.affected;
+            proposal = rhs.proposal;
+            proposal_stamp = rhs.proposal_stamp;
+            proposal_fa = rhs.proposal_fa;
+            pending = rhs.pending;
         }
         
         return *this;
@@ -113,11 +216,16 @@ class FounderAlleleGraph4 {
         locus = newlocus;
         major_freq = map->get_major(locus);
         minor_freq = map->get_minor(locus);
+        complete = false;
+        valid = false;
     }
+    unsigned int get_locus() const { return locus; }
     
     void reset(DescentGraph& dg);
     double likelihood();
+    double flip_likelihood(DescentGraph& dg, unsigned int personid, enum parentage p);
     void flip(DescentGraph& dg, unsigned int personid, enum parentage p);
+    void flip_combinations(DescentGraph& dg, int n, const unsigned int* people, const enum parentage* alleles, double* probs);
     
     string debug_string();
 };
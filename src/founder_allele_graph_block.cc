@@ -0,0 +1,116 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "types.h"
+#include "person.h"
+#include "pedigree.h"
+#include "descent_graph.h"
+#include "founder_allele_graph4.h"
+#include "founder_allele_graph_block.h"
+
+using namespace std;
+
+
+FounderAlleleGraphBlock::FounderAlleleGraphBlock(Pedigree* p) :
+    ped(p),
+    sequence(NULL),
+    edges(p->num_members() * 2 * FOUNDERALLELEGRAPH_BLOCK, 0),
+    typed() {
+
+    for(unsigned i = 0; i < ped->num_members(); ++i) {
+        if(ped->get_by_index(i)->istyped()) {
+            typed.push_back(i);
+        }
+    }
+}
+
+void FounderAlleleGraphBlock::evaluate(DescentGraph& dg, FounderAlleleGraph4** graphs, int count, double* probs) {
+    const int width = FOUNDERALLELEGRAPH_BLOCK;
+    int bits[FOUNDERALLELEGRAPH_BLOCK];
+    bool legal[FOUNDERALLELEGRAPH_BLOCK];
+
+    if((count < 1) or (count > width)) {
+        fprintf(stderr, "error: bad founder allele graph block size %d (%s:%d)\n", count, __FILE__, __LINE__);
+        abort();
+    }
+
+    for(int j = 0; j < width; ++j) {
+        bits[j] = 0;
+    }
+
+    // edges for every locus in the block, parents before children
+    for(unsigned i = 0; i < ped->num_members(); ++i) {
+        int pid = (*sequence)[i];
+        Person* p = ped->get_by_index(pid);
+        int* e = &edges[pid * 2 * width];
+
+        if(p->isfounder()) {
+            for(int j = 0; j < width; ++j) {
+                e[j] = pid * 2;
+                e[width + j] = (pid * 2) + 1;
+            }
+            continue;
+        }
+
+        for(int k = 0; k < 2; ++k) {
+            enum parentage allele = static_cast<enum parentage>(k);
+            const int* parent = &edges[p->get_parentid(allele) * 2 * width];
+            int* out = e + (k * width);
+
+            // <---- if p is male, the paternal allele does not exist!
+            for(int j = 0; j < count; ++j) {
+                bits[j] = dg.get(pid, graphs[j]->locus, allele);
+            }
+
+            for(int j = 0; j < width; ++j) {
+                out[j] = parent[j] ^ ((parent[width + j] ^ parent[j]) & -bits[j]);
+            }
+        }
+    }
+
+    for(int j = 0; j < count; ++j) {
+        FounderAlleleGraph4& f = *graphs[j];
+
+        for(unsigned i = 0; i < f.edge_list.size(); ++i) {
+            f.edge_list[i] = edges[(i * width) + j];
+        }
+
+        f.valid = false;
+        f.start_components();
+        legal[j] = true;
+    }
+
+    // the same order as FounderAlleleGraph4::likelihood()
+    for(int j = 0; j < count; ++j) {
+        FounderAlleleGraph4& f = *graphs[j];
+
+        for(unsigned i = 0; i < typed.size(); ++i) {
+            int pid = typed[i];
+            const int* e = &edges[pid * 2 * width];
+
+            if(not f.add_person(pid, ped->get_by_index(pid)->get_genotype(f.locus), e[j], e[width + j])) {
+                legal[j] = false;
+                break;
+            }
+        }
+    }
+
+    for(int j = 0; j < count; ++j) {
+        FounderAlleleGraph4& f = *graphs[j];
+
+        if(legal[j]) {
+            f.total_likelihood = f.components_likelihood();
+            f.complete = true;
+            probs[j] = f.total_likelihood;
+        }
+        else {
+            probs[j] = 0.0;
+        }
+
+#ifdef LKG_DEBUG
+        f.check_likelihood(probs[j], f.edge_list, __func__);
+#endif
+    }
+}
+
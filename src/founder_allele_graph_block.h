@@ -0,0 +1,67 @@
+#ifndef LKG_FOUNDERALLELEGRAPHBLOCK_H_
+#define LKG_FOUNDERALLELEGRAPHBLOCK_H_
+
+using namespace std;
+
+#include <vector>
+
+
+class Pedigree;
+class DescentGraph;
+class FounderAlleleGraph4;
+
+// number of loci evaluated together
+const int FOUNDERALLELEGRAPH_BLOCK = 8;
+
+// rebuilds and evaluates the founder allele graphs of up to
+// FOUNDERALLELEGRAPH_BLOCK loci in one pass over the pedigree
+//
+// the edge lists are built in structure-of-arrays layout (one entry per
+// locus for each founder allele slot), so each person's edges for all the
+// loci in the block are a select between their parent's, which the compiler
+// can vectorise. the union-find work itself is too branchy to vectorise, so
+// the graphs are then evaluated one locus after another (interleaving the
+// loci person by person was slower, each graph's working set is evicted by
+// the others)
+//
+// the graphs are left as if reset() and likelihood() had been called on each
+// of them, results are identical to doing that
+class FounderAlleleGraphBlock {
+
+    Pedigree* ped;
+    vector<int>* sequence;
+    vector<int> edges;      // [((person * 2) + allele) * FOUNDERALLELEGRAPH_BLOCK + lane]
+    vector<int> typed;      // people with any genotypes, in order
+
+ public :
+    FounderAlleleGraphBlock(Pedigree* p);
+
+    FounderAlleleGraphBlock(const FounderAlleleGraphBlock& rhs) :
+        ped(rhs.ped),
+        sequence(rhs.sequence),
+        edges(rhs.edges),
+        typed(rhs.typed) {}
+
+    ~FounderAlleleGraphBlock() {}
+
+    FounderAlleleGraphBlock& operator=(const FounderAlleleGraphBlock& rhs) {
+        if(this != &rhs) {
+            ped = rhs.ped;
+            sequence = rhs.sequence;
+            edges = rhs.edges;
+            typed = rhs.typed;
+        }
+
+        return *this;
+    }
+
+    // parents before children, see DescentGraph::get_founderallelegraph_ordering()
+    void set_sequence(vector<int>* seq) { sequence = seq; }
+
+    // graphs[0 .. count) can be for any loci, likelihoods are written to
+    // probs[0 .. count)
+    void evaluate(DescentGraph& dg, FounderAlleleGraph4** graphs, int count, double* probs);
+};
+
+#endif
+
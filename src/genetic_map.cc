@@ -11,6 +11,16 @@
 using namespace std;
 
 
+static unsigned long last_map_version = 0;
+
+void GeneticMap::_changed() {
+    #pragma omp critical(genetic_map_version)
+    {
+        version = ++last_map_version;
+    }
+}
+
+
 bool GeneticMap::sanity_check() {
     double tmp;
 
@@ -60,6 +70,8 @@ bool GeneticMap::sanity_check() {
         partial_thetas.push_back(tmp);
     }
     
+    _changed();
+    
     return true;
 }
 
@@ -114,6 +126,8 @@ void GeneticMap::set_temperature(double t) {
 
         tmp.set_minor_freq((temperature * minor_freq) + ((1 - temperature) * 0.5));
     }
+    
+    _changed();
 }
 
 double GeneticMap::get_genetic_position(unsigned int index, unsigned int offset) const {
@@ -99,6 +99,9 @@ class GeneticMap {
     vector<double> partial_thetas;
     double temperature;
     unsigned int partial_theta_count; // must be greater than zero
+    unsigned long version;            // changes whenever the map does
+    
+    void _changed();
 
     //double haldane(double m) const ;
     //double inverse_haldane(double m) const;
@@ -110,7 +113,11 @@ class GeneticMap {
         inversethetas(),
         partial_thetas(),
         temperature(1.0),
-        partial_theta_count(partial_theta_count) {}
+        partial_theta_count(partial_theta_count),
+        version(0) {
+        
+        _changed();
+    }
     
     ~GeneticMap() {}
     
@@ -120,7 +127,8 @@ class GeneticMap {
         inversethetas(rhs.inversethetas),
         partial_thetas(rhs.partial_thetas),
         temperature(rhs.temperature),
-        partial_theta_count(rhs.partial_theta_count) {}
+        partial_theta_count(rhs.partial_theta_count),
+        version(rhs.version) {}
 
     GeneticMap& operator=(const GeneticMap& rhs) {
         if(this != &rhs) {
@@ -130,6 +138,7 @@ class GeneticMap {
             partial_thetas = rhs.partial_thetas;
             temperature = rhs.temperature;
             partial_theta_count = rhs.partial_theta_count;
+            version = rhs.version;
         }
         return *this;
     }
@@ -147,6 +156,7 @@ class GeneticMap {
     
     void add(Snp& s) {
         map.push_back(s);
+        _changed();
     }
     
     void add_theta(double d) {
@@ -154,6 +164,7 @@ class GeneticMap {
         //inverse_thetas.push_back(log1p(-d));
         thetas.push_back(d);
         inversethetas.push_back(1.0 - d);
+        _changed();
     }
     
     Snp& get_marker(unsigned int i) {
@@ -207,6 +218,13 @@ class GeneticMap {
         return map.size();
     }
     
+    // copies share a version until one of them is changed, no two maps
+    // with different contents have the same version, so it can be used
+    // to tell if something computed from a map is still valid
+    unsigned long get_version() const {
+        return version;
+    }
+    
     bool sanity_check();
 	string debug_string();
     
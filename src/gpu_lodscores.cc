@@ -538,6 +538,12 @@ void GPULodscores::copy_from_gpu(DescentGraph& dg) {
     }
 }
 
+// the device works on the unpacked graph, one int per meiosis
+void GPULodscores::graph_to_gpu(DescentGraph& dg) {
+    dg.unpack(host_graph);
+    CUDA_CALLANDTEST(cudaMemcpy(dev_graph, &host_graph[0], sizeof(int) * host_graph.size(), cudaMemcpyHostToDevice));
+}
+
 int GPULodscores::optimal_lodscore_threads() {
         
     int threadcount[] = {32, 64, 96, 128, 160, 192, 224, 256};
@@ -599,7 +605,7 @@ void GPULodscores::calculate(DescentGraph& dg) {
 
     block_until_finished();
 
-    CUDA_CALLANDTEST(cudaMemcpy(dev_graph, dg.get_internal_ptr(), dg.get_internal_size(), cudaMemcpyHostToDevice));
+    graph_to_gpu(dg);
     
     run_gpu_lodscore_kernel(map->num_markers() - 1, num_lodscore_threads, dev_state);
     
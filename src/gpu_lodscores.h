@@ -27,6 +27,7 @@ class GPULodscores {
     struct gpu_state* dev_state;
     int* dev_graph;
     double* dev_lodscores;
+    vector<int> host_graph;     // unpacked descent graph
     
     unsigned int num_lodscore_threads;
     unsigned int count;
@@ -51,6 +52,7 @@ class GPULodscores {
     
     void copy_to_gpu(DescentGraph& dg);
     void copy_from_gpu(DescentGraph& dg);
+    void graph_to_gpu(DescentGraph& dg);
     
     void select_best_gpu();
     
@@ -71,7 +73,8 @@ class GPULodscores {
         dev_lodscores(NULL),
         num_lodscore_threads(128),
         count(0),
-        trait_likelihood(trait_prob) {
+        trait_likelihood(trait_prob),
+        host_graph() {
         
         vector<PeelOperation>& ops = psg->get_peel_order();
         
@@ -90,7 +93,8 @@ class GPULodscores {
         dev_lodscores(rhs.dev_lodscores),
         num_lodscore_threads(rhs.num_lodscore_threads),
         count(rhs.count),
-        trait_likelihood(rhs.trait_likelihood) {}
+        trait_likelihood(rhs.trait_likelihood),
+        host_graph(rhs.host_graph) {}
     
     ~GPULodscores() {
         kill_everything();
@@ -111,6 +115,7 @@ class GPULodscores {
             num_lodscore_threads = rhs.num_lodscore_threads;
             count = rhs.count;
             trait_likelihood = rhs.trait_likelihood;
+            host_graph = rhs.host_graph;
         }
         return *this;
     }
@@ -854,6 +854,18 @@ void GPUMarkovChain::copy_from_gpu(DescentGraph& dg) {
     }
 }
 
+// the device works on the unpacked graph, one int per meiosis
+void GPUMarkovChain::graph_to_gpu(DescentGraph& dg) {
+    dg.unpack(host_graph);
+    CUDA_CALLANDTEST(cudaMemcpy(dev_graph, &host_graph[0], sizeof(int) * host_graph.size(), cudaMemcpyHostToDevice));
+}
+
+void GPUMarkovChain::graph_from_gpu(DescentGraph& dg) {
+    host_graph.resize(dg.get_unpacked_size());
+    CUDA_CALLANDTEST(cudaMemcpy(&host_graph[0], dev_graph, sizeof(int) * host_graph.size(), cudaMemcpyDeviceToHost));
+    dg.pack(host_graph);
+}
+
 int GPUMarkovChain::windowed_msampler_blocks(int window_length) {
     int half_markers = map->num_markers() / 2;
     return (half_markers / window_length) + ((half_markers % window_length) == 0 ? 0 : 1);
@@ -1046,7 +1058,7 @@ LODscores* GPUMarkovChain::run(DescentGraph& dg) {
     //run_gpu_print_kernel(dev_state);
     
     
-    CUDA_CALLANDTEST(cudaMemcpy(dev_graph, dg.get_internal_ptr(), dg.get_internal_size(), cudaMemcpyHostToDevice));
+    graph_to_gpu(dg);
     
     int lodscore_threads = optimal_lodscore_threads();
     int lsampler_threads = optimal_lsampler_threads();
@@ -1081,7 +1093,7 @@ LODscores* GPUMarkovChain::run(DescentGraph& dg) {
         
     printf("requesting %.2f KB (%d bytes) of shared memory per block\n", shared_mem / 1024.0, (int)shared_mem);
     
-    CUDA_CALLANDTEST(cudaMemcpy(dev_graph, dg.get_internal_ptr(), dg.get_internal_size(), cudaMemcpyHostToDevice));
+    graph_to_gpu(dg);
     
     Progress p("CUDA MCMC: ", options.iterations + options.burnin);
     
@@ -1093,7 +1105,7 @@ LODscores* GPUMarkovChain::run(DescentGraph& dg) {
             
 #ifdef HYBRID_CPUGPU
             if(not gpu_active) {
-                CUDA_CALLANDTEST(cudaMemcpy(dev_graph, dg.get_internal_ptr(), dg.get_internal_size(), cudaMemcpyHostToDevice));
+                graph_to_gpu(dg);
                 gpu_active = true;
             }
 #endif
@@ -1187,7 +1199,7 @@ LODscores* GPUMarkovChain::run(DescentGraph& dg) {
             
 #ifdef GPU_DEBUG
             // test legality of descent graph
-            CUDA_CALLANDTEST(cudaMemcpy(dg.get_internal_ptr(), dev_graph, dg.get_internal_size(), cudaMemcpyDeviceToHost));
+            graph_from_gpu(dg);
             
             if(dg.get_likelihood() == LOG_ILLEGAL) {
                 fprintf(stderr, "error: descent graph illegal after l-sampler (%d)\n", i);
@@ -1198,7 +1210,7 @@ LODscores* GPUMarkovChain::run(DescentGraph& dg) {
         else {
 #ifdef HYBRID_CPUGPU
             if(gpu_active) {
-                CUDA_CALLANDTEST(cudaMemcpy(dg.get_internal_ptr(), dev_graph, dg.get_internal_size(), cudaMemcpyDeviceToHost));
+                graph_from_gpu(dg);
                 gpu_active = false;
             }
 
@@ -1260,7 +1272,7 @@ LODscores* GPUMarkovChain::run(DescentGraph& dg) {
                 
 #ifdef GPU_DEBUG
                 // test legality of descent graph
-                CUDA_CALLANDTEST(cudaMemcpy(dg.get_internal_ptr(), dev_graph, dg.get_internal_size(), cudaMemcpyDeviceToHost));
+                graph_from_gpu(dg);
                 
                 if(dg.get_likelihood() == LOG_ILLEGAL) {
                     fprintf(stderr, "error: descent graph illegal after m-sampler (meiosis %d) (%d)\n", j, i);
@@ -1293,7 +1305,7 @@ LODscores* GPUMarkovChain::run(DescentGraph& dg) {
 //#define CODA_OUTPUT 1
 #ifdef CODA_OUTPUT
             if(gpu_active) {
-                CUDA_CALLANDTEST(cudaMemcpy(dg.get_internal_ptr(), dev_graph, dg.get_internal_size(), cudaMemcpyDeviceToHost));
+                graph_from_gpu(dg);
                 gpu_active = false;
             }
             
@@ -1317,7 +1329,7 @@ LODscores* GPUMarkovChain::run(DescentGraph& dg) {
             
 #ifdef HYBRID_CPUGPU
             if(not gpu_active) {
-                CUDA_CALLANDTEST(cudaMemcpy(dev_graph, dg.get_internal_ptr(), dg.get_internal_size(), cudaMemcpyHostToDevice));
+                graph_to_gpu(dg);
                 gpu_active = true;
             }
 #endif
@@ -30,6 +30,7 @@ class GPUMarkovChain {
     struct gpu_state* dev_state;
     int* dev_graph;
     fp_type* dev_lodscores;
+    vector<int> host_graph;     // unpacked descent graph
     
     size_t calculate_memory_requirements(vector<PeelOperation>& ops);
     unsigned num_samplers();
@@ -63,6 +64,8 @@ class GPUMarkovChain {
     
     void copy_to_gpu(DescentGraph& dg);
     void copy_from_gpu(DescentGraph& dg);
+    void graph_to_gpu(DescentGraph& dg);
+    void graph_from_gpu(DescentGraph& dg);
     
     void select_best_gpu();
     
@@ -81,7 +84,8 @@ class GPUMarkovChain {
         loc_state(NULL),
         dev_state(NULL),
         dev_graph(NULL),
-        dev_lodscores(NULL) {
+        dev_lodscores(NULL),
+        host_graph() {
         
         vector<PeelOperation>& ops = psg->get_peel_order();
         
@@ -100,7 +104,8 @@ class GPUMarkovChain {
         loc_state(rhs.loc_state),
         dev_state(rhs.dev_state),
         dev_graph(rhs.dev_graph),
-        dev_lodscores(rhs.dev_lodscores) {}
+        dev_lodscores(rhs.dev_lodscores),
+        host_graph(rhs.host_graph) {}
     
     ~GPUMarkovChain() {
         kill_everything();
@@ -118,6 +123,7 @@ class GPUMarkovChain {
             dev_state = rhs.dev_state;
             dev_graph = rhs.dev_graph;
             dev_lodscores = rhs.dev_lodscores;
+            host_graph = rhs.host_graph;
         }
         return *this;
     }
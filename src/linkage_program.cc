@@ -4,6 +4,7 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
 #include "descent_graph.h"
 #include "linkage_program.h"
@@ -17,15 +18,18 @@
 #include "sequential_imputation.h"
 //#include "gpu_markov_chain.h"
 #include "lod_score.h"
+#include "peel_sequence_generator.h"
+#include "peel_codegen.h"
+#include "omp_facade.h"
 
 #include "mc3.h"
+#include "checkpoint.h"
 
 using namespace std;
 
 
 bool LinkageProgram::run() {
     vector<LODscores*> all_scores;
-    LODscores* tmp;
     bool ret = true;
     LinkageWriter lw(&map, outfile, options.verbose);
 
@@ -38,6 +42,7 @@ bool LinkageProgram::run() {
                     "\tsampling iterations = %d\n"
                     "\tsampling period = %d\n"
                     "\tlocus sampler prob = %.3f\n"
+                    "\tblock sampler prob = %.3f\n"
                     "\tnumber of runs = %d\n\n",
                     dm.get_penetrance(TRAIT_HOMO_U),
                     dm.get_penetrance(TRAIT_HETERO),
@@ -48,6 +53,7 @@ bool LinkageProgram::run() {
                     options.iterations,
                     options.scoring_period,
                     options.lsampler_prob,
+                    options.block_prob,
                     options.mcmc_runs);
 
 
@@ -58,23 +64,32 @@ bool LinkageProgram::run() {
     else {
         seed_random_explicit(options.random_filename);
     }
-    
+
+    options.sex_linked = dm.is_sexlinked();
+
+    // peeling sequences are needed up front to estimate how long each pedigree will take
     for(unsigned int i = 0; i < pedigrees.size(); ++i) {
-        
-        if(options.verbose) {
-            fprintf(stderr, "%s\n", pedigrees[i].debug_string().c_str());
+        psgs.push_back(build_peel_sequence(pedigrees[i]));
+    }
+    
+    if(((pedigrees.size() > 1) or (options.mcmc_runs > 1)) and (options.thread_count > 1) and (not options.use_gpu)) {
+        run_pedigrees_concurrent(all_scores);
+    }
+    else {
+        for(unsigned int i = 0; i < pedigrees.size(); ++i) {
+            all_scores.push_back(run_pedigree_average(pedigrees[i], *(psgs[i]), options));
         }
-        
+    }
+
+    for(unsigned int i = 0; i < all_scores.size(); ++i) {
         // it cannot actually be NULL, the program will call
         // abort() at the slightest hint of a problem
-        if((tmp = run_pedigree_average(pedigrees[i], options.mcmc_runs)) == NULL) {
+        if(all_scores[i] == NULL) {
             fprintf(stderr, "error: pedigree '%s' failed\n", pedigrees[i].get_id().c_str());
             
             ret = false;
             goto die;
         }
-        
-        all_scores.push_back(tmp);
     }
     
     //LinkageWriter lw(&map, outfile, options.verbose);
@@ -89,28 +104,18 @@ die:
     for(unsigned int i = 0; i < all_scores.size(); ++i) {
         delete all_scores[i];
     }
-    
-    return ret;
-}
 
-LODscores* LinkageProgram::run_pedigree_average(Pedigree& p, int repeats) {
-    LODscores *ret, *tmp;
-
-    ret = run_pedigree(p, 0);
-
-    for(int i = 1; i < repeats; ++i) {
-        tmp = run_pedigree(p, i);
-        ret->merge_results(tmp);
-        delete tmp;
+    for(unsigned int i = 0; i < psgs.size(); ++i) {
+        delete psgs[i];
     }
-
+    
     return ret;
 }
 
-LODscores* LinkageProgram::run_pedigree(Pedigree& p, int sequence_number) {
-    
+PeelSequenceGenerator* LinkageProgram::build_peel_sequence(Pedigree& p) {
+
     if(options.verbose) {
-        fprintf(stderr, "processing pedigree %s\n", p.get_id().c_str());
+        fprintf(stderr, "%s\n", p.debug_string().c_str());
     }
 
     if(options.affected_only) {
@@ -123,8 +128,239 @@ LODscores* LinkageProgram::run_pedigree(Pedigree& p, int sequence_number) {
         }
     }
 
+    PeelSequenceGenerator* psg = new PeelSequenceGenerator(&p, &map, dm.is_sexlinked(), options.verbose);
+
+    if(not (options.resume and load_peel_sequence(p, *psg))) {
+        psg->build_peel_sequence(options.peelopt_iterations);
+
+        if(options.checkpoint_period > 0) {
+            save_peel_sequence(p, *psg);
+        }
+    }
+
+    if(options.codegen_dir != "") {
+        PeelCodeGenerator pcg(&p, psg, dm.is_sexlinked(), options.codegen_dir);
+        pcg.load();
+    }
+
+    if(options.verbose) {
+        fprintf(stderr, "\n\n%s\n\n", psg->debug_string().c_str());
+    }
+
+    return psg;
+}
+
+// the peel sequence search is randomised and can take a long time, so it
+// is saved alongside the chain checkpoints (see MarkovChain::checkpoint)
+bool LinkageProgram::load_peel_sequence(Pedigree& p, PeelSequenceGenerator& psg) {
+    Checkpoint c(options.checkpoint_prefix + ".ped" + p.get_id() + ".peel");
+    vector<unsigned int> seq;
+
+    if(not c.exists()) {
+        return false;
+    }
+
+    if(not (c.read() and c.get_vector(seq) and psg.set_sequence(seq))) {
+        fprintf(stderr, "error: peel sequence in '%s' does not match pedigree %s\n", c.get_filename().c_str(), p.get_id().c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    printf("read peel sequence for pedigree %s from '%s'\n", p.get_id().c_str(), c.get_filename().c_str());
+
+    return true;
+}
+
+void LinkageProgram::save_peel_sequence(Pedigree& p, PeelSequenceGenerator& psg) {
+    Checkpoint c(options.checkpoint_prefix + ".ped" + p.get_id() + ".peel");
+
+    c.put_vector(psg.get_sequence());
+
+    if(not c.write()) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+// options for a chain running on a team of team_size threads
+struct mcmc_options LinkageProgram::team_options(int team_size) {
+    struct mcmc_options run_options = options;
+    run_options.thread_count = team_size;
+    
+    // split the scoring threads proportionately, but always leave one core for sampling
+    if(options.scoring_threads > 0) {
+        run_options.scoring_threads = max(1, (options.scoring_threads * team_size) / options.thread_count);
+        if(run_options.scoring_threads >= team_size) {
+            run_options.scoring_threads = 0;
+        }
+    }
+
+    return run_options;
+}
+
+// rough estimate of how long one run of a pedigree will take, it is used
+// to order the runs and to decide how many threads each team gets
+double LinkageProgram::estimate_cost(PeelSequenceGenerator& psg) {
+    return double(psg.get_peeling_cost()) * \
+           double(map.num_markers()) * \
+           double(options.iterations + options.burnin);
+}
+
+// the queue is sorted largest first and team i starts on run i, a run that
+// is worth at least two threads' share of the remaining work gets a team
+// in proportion to its cost (all of the threads if it dwarfs everything
+// else), then whatever threads are left are spread as evenly as possible
+// over teams for the cheaper runs
+void LinkageProgram::plan_teams(vector<pair<double, int> >& queue, vector<int>& team_sizes) {
+    int threads = options.thread_count;
+    int num_runs = queue.size();
+    double total = 0.0;
+    int i;
+
+    for(i = 0; i < num_runs; ++i) {
+        total -= queue[i].first;
+    }
+
+    team_sizes.clear();
+
+    for(i = 0; (i < num_runs) and (threads > 0); ++i) {
+        double cost = -queue[i].first;
+        double share = (total > 0.0) ? ((threads * cost) / total) : 0.0;
+
+        if(share < 2.0) {
+            break;
+        }
+
+        int size = (i == (num_runs - 1)) ? threads : min(threads, int(share + 0.5));
+
+        team_sizes.push_back(size);
+        threads -= size;
+        total -= cost;
+    }
+
+    if(threads > 0) {
+        int num_teams = min(num_runs - i, threads);
+
+        for(int j = 0; j < num_teams; ++j) {
+            team_sizes.push_back((threads / num_teams) + ((j < (threads % num_teams)) ? 1 : 0));
+        }
+    }
+}
+
+// every run of every pedigree is a separate item in the queue, sorted by
+// cost and handed out largest first to teams of threads sized by plan_teams().
+// whichever team finishes first takes the next run in the queue, which may
+// be another run of a pedigree that is still going on a different team, so
+// no team is left holding a backlog while the others sit idle. a run cannot
+// change its number of threads once its samplers are built, so this is as
+// fine grained as the sharing gets
+void LinkageProgram::run_pedigrees_concurrent(vector<LODscores*>& all_scores) {
+    int num_pedigrees = pedigrees.size();
+    int repeats = options.mcmc_runs;
+    int num_runs = num_pedigrees * repeats;
+    int max_levels = get_max_active_levels();
+    int next;
+    vector<pair<double, int> > queue;
+    vector<int> team_sizes;
+    vector<LODscores*> results(num_runs, (LODscores*) NULL);
+
+    for(int i = 0; i < num_runs; ++i) {
+        queue.push_back(make_pair(-estimate_cost(*(psgs[i / repeats])), i));
+    }
+
+    sort(queue.begin(), queue.end());
+
+    plan_teams(queue, team_sizes);
+
+    int num_teams = team_sizes.size();
+
+    printf("running %d pedigree%s (%d run%s) concurrently on %d team%s of threads (",
+           num_pedigrees, num_pedigrees == 1 ? "" : "s",
+           num_runs, num_runs == 1 ? "" : "s",
+           num_teams, num_teams == 1 ? "" : "s");
+    for(int i = 0; i < num_teams; ++i) {
+        printf("%s%d", i == 0 ? "" : ", ", team_sizes[i]);
+    }
+    printf(")\n");
+
+    // pedigrees -> sampling/scoring -> worker pool
+    set_max_active_levels(3);
+    set_random_teams(team_sizes);
+
+    next = num_teams;
+
+    #pragma omp parallel num_threads(num_teams)
+    {
+        int* counter = &next;
+        int team = get_thread_num();
+        int index = team;
+        struct mcmc_options run_options = team_options(team_sizes[team]);
+
+        set_num_threads(team_sizes[team]);
+
+        while(index < num_runs) {
+            int run = queue[index].second;
+            int ped = run / repeats;
+
+            if(run_options.verbose) {
+                fprintf(stderr, "processing pedigree %s run %d\n", pedigrees[ped].get_id().c_str(), run % repeats);
+            }
+
+            results[run] = run_pedigree(pedigrees[ped], *(psgs[ped]), run_options, run % repeats);
+
+            #pragma omp atomic capture
+            index = (*counter)++;
+        }
+    }
+
+    set_random_team_size(0);
+    set_max_active_levels(max_levels);
+
+    // merge in the order of the runs so the result does not depend on scheduling
+    all_scores.assign(num_pedigrees, (LODscores*) NULL);
+
+    for(int i = 0; i < num_pedigrees; ++i) {
+        all_scores[i] = results[i * repeats];
+
+        for(int j = 1; j < repeats; ++j) {
+            all_scores[i]->merge_results(results[(i * repeats) + j]);
+            delete results[(i * repeats) + j];
+        }
+    }
+}
+
+LODscores* LinkageProgram::run_pedigree_average(Pedigree& p, PeelSequenceGenerator& psg, struct mcmc_options& run_options) {
+    LODscores *ret, *tmp;
+    int repeats = run_options.mcmc_runs;
+
+    if(run_options.verbose) {
+        fprintf(stderr, "processing pedigree %s\n", p.get_id().c_str());
+    }
+
+    ret = run_pedigree(p, psg, run_options, 0);
+
+    for(int i = 1; i < repeats; ++i) {
+        tmp = run_pedigree(p, psg, run_options, i);
+        ret->merge_results(tmp);
+        delete tmp;
+    }
+
+    return ret;
+}
+
+LODscores* LinkageProgram::run_pedigree(Pedigree& p, PeelSequenceGenerator& psg, struct mcmc_options& run_options, int sequence_number) {
+
+    if(run_options.mc3_number_of_chains > 1) {
+        Mc3 chains(&p, &map, &psg, run_options);
+        return chains.run();
+    }
 
     DescentGraph dg(&p, &map, dm.is_sexlinked());
+    MarkovChain chain(&p, &map, &psg, run_options, sequence_number);
+
+    // the descent graph from the checkpoint replaces sequential imputation
+    if(run_options.resume and chain.resume(dg)) {
+        return chain.run(dg);
+    }
+
     dg.random_descentgraph(); // just in case the user selects zero sequential imputation iterations
     
     if(dg.get_likelihood() == LOG_ZERO) {
@@ -132,32 +368,25 @@ LODscores* LinkageProgram::run_pedigree(Pedigree& p, int sequence_number) {
         abort();
     }
 
-    
-    PeelSequenceGenerator psg(&p, &map, dm.is_sexlinked(), options.verbose);
-    psg.build_peel_sequence(options.peelopt_iterations);
-
-    if(options.verbose) {
-        fprintf(stderr, "\n\n%s\n\n", psg.debug_string().c_str());
-    }
-
 
     SequentialImputation si(&p, &map, &psg, dm.is_sexlinked());
-    //si.run(dg, options.si_iterations);
-    si.parallel_run(dg, options.si_iterations);
+    //si.run(dg, run_options.si_iterations);
+    si.parallel_run(dg, run_options.si_iterations);
 
     if(dg.get_likelihood() == LOG_ZERO) {
         fprintf(stderr, "error, bad descent graph %s:%d\n", __FILE__, __LINE__);
         abort();
     }
 
+    dg.set_layout(run_options.graph_layout);
 
     /*
-    if(not options.use_gpu) {
-        MarkovChain chain(&p, &map, &psg, options);
+    if(not run_options.use_gpu) {
+        MarkovChain chain(&p, &map, &psg, run_options);
         return chain.run(dg);
     }
     else {
-        GPUMarkovChain chain(&p, &map, &psg, options);
+        GPUMarkovChain chain(&p, &map, &psg, run_options);
         return chain.run(dg);
     }
     
@@ -165,12 +394,8 @@ LODscores* LinkageProgram::run_pedigree(Pedigree& p, int sequence_number) {
     abort();
     */
     
-    options.sex_linked = dm.is_sexlinked();
-
-    MarkovChain chain(&p, &map, &psg, options, sequence_number);
     return chain.run(dg);
 
-    //Mc3 chain(&p, &map, &psg, options);
+    //Mc3 chain(&p, &map, &psg, run_options);
     //return chain.run();
 }
-
@@ -7,15 +7,38 @@
 class Pedigree;
 class Peeler;
 class LODscores;
+class PeelSequenceGenerator;
 
 class LinkageProgram : public Program {
+
+    vector<PeelSequenceGenerator*> psgs;
     
-    LODscores* run_pedigree(Pedigree& p, int sequence_num);
-    LODscores* run_pedigree_average(Pedigree& p, int repeats);
+    PeelSequenceGenerator* build_peel_sequence(Pedigree& p);
+    bool load_peel_sequence(Pedigree& p, PeelSequenceGenerator& psg);
+    void save_peel_sequence(Pedigree& p, PeelSequenceGenerator& psg);
+    struct mcmc_options team_options(int team_size);
+    double estimate_cost(PeelSequenceGenerator& psg);
+    void plan_teams(vector<pair<double, int> >& queue, vector<int>& team_sizes);
+    void run_pedigrees_concurrent(vector<LODscores*>& all_scores);
+    LODscores* run_pedigree(Pedigree& p, PeelSequenceGenerator& psg, struct mcmc_options& run_options, int sequence_num);
+    LODscores* run_pedigree_average(Pedigree& p, PeelSequenceGenerator& psg, struct mcmc_options& run_options);
 
  public :
     LinkageProgram(char* ped, char* map, char* dat, char* outputfile, struct mcmc_options options) : 
-        Program(ped, map, dat, outputfile, options) {}
+        Program(ped, map, dat, outputfile, options),
+        psgs() {}
+
+    LinkageProgram(const LinkageProgram& rhs) :
+        Program(rhs),
+        psgs(rhs.psgs) {}
+
+    LinkageProgram& operator=(const LinkageProgram& rhs) {
+        if(&rhs != this) {
+            Program::operator=(rhs);
+            psgs = rhs.psgs;
+        }
+        return *this;
+    }
     
 	~LinkageProgram() {}
     
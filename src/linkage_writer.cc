@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <cmath>
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -49,22 +50,25 @@ bool LinkageWriter::write(vector<LODscores*>& all_scores) {
 	}
 	*/
 
-    f << "marker\tposition\tlod\n";
+    f << "marker\tposition\tlod\tse\n";
 	
 	for(unsigned int i = 0; i < (map->num_markers() - 1); ++i) {
         f << map->get_name(i) << "\t" << 100.0 * map->get_genetic_position(i, 0) << "\n";
 	    
         for(unsigned int j = 0; j < map->get_lodscore_count(); ++j) {
 	        double tmp = all_scores[0]->get(i, j);
+            double var = pow(all_scores[0]->get_se(i, j), 2);
             for(unsigned int k = 1; k < all_scores.size(); ++k) {
                 tmp += all_scores[k]->get(i,j);
+                var += pow(all_scores[k]->get_se(i, j), 2);
             }
             
             stringstream ss;
 
-            // genetic position + total LOD
+            // genetic position + total LOD + standard error
             // (get_genetic_position needs j+1 because it treats j as an offset, ie: indexed from 1)
-            ss << "-\t" << 100 * map->get_genetic_position(i, j+1) << "\t" << tmp;
+            // (families are independent, so their variances add)
+            ss << "-\t" << 100 * map->get_genetic_position(i, j+1) << "\t" << tmp << "\t" << sqrt(var);
             
             // more than one family
             if(all_scores.size() > 1) {
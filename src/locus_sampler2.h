@@ -2,6 +2,7 @@
 #define LKG_LOCUSSAMPLER_H_
 
 #include <vector>
+#include <algorithm>
 
 #include "descent_graph.h"
 #include "trait.h"
@@ -67,6 +68,17 @@ class LocusSampler : Sampler {
         return *this;        
     }
     
+    // see Peeler::swap()
+    void swap(LocusSampler& rhs) {
+        std::swap(ped, rhs.ped);
+        std::swap(map, rhs.map);
+        rfunctions.swap(rhs.rfunctions);
+        std::swap(locus, rhs.locus);
+        std::swap(ignore_left, rhs.ignore_left);
+        std::swap(ignore_right, rhs.ignore_right);
+        std::swap(sex_linked, rhs.sex_linked);
+    }
+    
     virtual void step(DescentGraph& dg, unsigned parameter);
     
     double locus_by_locus(DescentGraph& dg);
@@ -78,5 +90,9 @@ class LocusSampler : Sampler {
     void set_locus_minimal(unsigned int locus);
 };
 
+inline void swap(LocusSampler& a, LocusSampler& b) {
+    a.swap(b);
+}
+
 #endif
 
@@ -0,0 +1,49 @@
+#include <vector>
+#include <algorithm>
+#include <string>
+
+#include "locus_scheduler.h"
+#include "random.h"
+
+using namespace std;
+
+
+void LocusScheduler::shuffle() {
+    RandomInt rng;
+    unsigned int offset = get_random_int(num_colours);
+    int index = 0;
+
+    round_start.clear();
+
+    // the offset randomises which colour goes first, empty colours only
+    // happen when there are fewer loci than colours and are skipped
+    for(unsigned int i = 0; i < num_colours; ++i) {
+        unsigned int first = (i + offset) % num_colours;
+
+        if(first >= num_loci)
+            continue;
+
+        round_start.push_back(index);
+
+        for(unsigned int j = first; j < num_loci; j += num_colours) {
+            schedule[index++] = j;
+        }
+
+        random_shuffle(schedule.begin() + round_start.back(), schedule.begin() + index, rng);
+    }
+
+    round_start.push_back(index);
+
+    cursor.assign(round_start.begin(), round_start.end() - 1);
+}
+
+int LocusScheduler::claim(int r) {
+    int* next = &cursor[r];
+    int index;
+
+    #pragma omp atomic capture
+    index = (*next)++;
+
+    return (index < round_start[r+1]) ? schedule[index] : -1;
+}
+
@@ -0,0 +1,78 @@
+#ifndef LKG_LOCUSSCHEDULER_H_
+#define LKG_LOCUSSCHEDULER_H_
+
+using namespace std;
+
+#include <vector>
+
+
+// hands out loci to the parallel locus sampler without locking
+//
+// the locus sampler reads the meiosis indicators of the loci immediately to the
+// left and right of the one being sampled, so two threads can only work at the
+// same time on loci that are not adjacent. loci are coloured (locus + offset) % k
+// which guarantees that no two loci in the same colour (round) are neighbours,
+// then each round is shuffled. threads claim loci from the current round with
+// an atomic counter and wait at a barrier before starting the next round
+class LocusScheduler {
+
+    unsigned int num_loci;
+    unsigned int num_colours;
+    vector<int> schedule;       // all loci, grouped by round
+    vector<int> round_start;    // offset into schedule for each round (+ sentinel)
+    vector<int> cursor;         // next unclaimed index into schedule for each round
+
+ public :
+    LocusScheduler(unsigned int num_loci, unsigned int num_colours=2) :
+        num_loci(num_loci),
+        num_colours(num_colours < 2 ? 2 : num_colours),
+        schedule(num_loci, 0),
+        round_start(),
+        cursor() {
+
+        shuffle();
+    }
+
+    LocusScheduler(const LocusScheduler& rhs) :
+        num_loci(rhs.num_loci),
+        num_colours(rhs.num_colours),
+        schedule(rhs.schedule),
+        round_start(rhs.round_start),
+        cursor(rhs.cursor) {}
+
+    ~LocusScheduler() {}
+
+    LocusScheduler& operator=(const LocusScheduler& rhs) {
+        if(this != &rhs) {
+            num_loci = rhs.num_loci;
+            num_colours = rhs.num_colours;
+            schedule = rhs.schedule;
+            round_start = rhs.round_start;
+            cursor = rhs.cursor;
+        }
+        return *this;
+    }
+
+    // create a new random schedule, must be called outside of a parallel region
+    void shuffle();
+
+    // returns the next locus in round r or -1 if the round is exhausted,
+    // safe to call from any number of threads concurrently
+    int claim(int r);
+
+    int num_rounds() const {
+        return int(round_start.size()) - 1;
+    }
+
+    int round_size(int r) const {
+        return round_start[r+1] - round_start[r];
+    }
+
+    // for callers that divide up a round themselves instead of using claim()
+    int get_locus(int r, int i) const {
+        return schedule[round_start[r] + i];
+    }
+};
+
+#endif
+
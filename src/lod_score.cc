@@ -0,0 +1,196 @@
+#include <cmath>
+#include <vector>
+#include <limits>
+#include <algorithm>
+
+#include "lod_score.h"
+#include "logarithms.h"
+#include "checkpoint.h"
+
+using namespace std;
+
+
+// merge neighbouring batches, an odd batch at the end is dropped
+static void halve_batches(vector<double>& b) {
+    for(unsigned int i = 0; i < (b.size() / 2); ++i) {
+        b[i] = log_sum(b[2 * i], b[(2 * i) + 1]);
+    }
+
+    b.resize(b.size() / 2);
+}
+
+void LODscores::add_batch(unsigned int index, double prob) {
+    double* b = &batches[index * MAX_BATCHES];
+    unsigned int n = samples[index];
+
+    if(n == (MAX_BATCHES * batch_size[index])) {
+        for(unsigned int i = 0; i < (MAX_BATCHES / 2); ++i) {
+            b[i] = log_sum(b[2 * i], b[(2 * i) + 1]);
+        }
+
+        batch_size[index] *= 2;
+    }
+
+    unsigned int current = n / batch_size[index];
+
+    b[current] = ((n % batch_size[index]) == 0) ? prob : log_sum(b[current], prob);
+
+    ++samples[index];
+}
+
+// the chains are independent, so the complete batches from both can be
+// concatenated once they are the same size
+void LODscores::merge_batches(LODscores* tmp) {
+    
+    for(unsigned int i = 0; i < num_scores; ++i) {
+        unsigned int size1 = batch_size[i];
+        unsigned int size2 = tmp->batch_size[i];
+        
+        vector<double> b1(&batches[i * MAX_BATCHES], 
+                          &batches[i * MAX_BATCHES] + (samples[i] / size1));
+        vector<double> b2(&tmp->batches[i * MAX_BATCHES], 
+                          &tmp->batches[i * MAX_BATCHES] + (tmp->samples[i] / size2));
+
+        while(size1 < size2) {
+            halve_batches(b1);
+            size1 *= 2;
+        }
+
+        while(size2 < size1) {
+            halve_batches(b2);
+            size2 *= 2;
+        }
+
+        b1.insert(b1.end(), b2.begin(), b2.end());
+
+        while(b1.size() > MAX_BATCHES) {
+            halve_batches(b1);
+            size1 *= 2;
+        }
+
+        copy(b1.begin(), b1.end(), &batches[i * MAX_BATCHES]);
+        samples[i] = b1.size() * size1;
+        batch_size[i] = size1;
+    }
+}
+
+double LODscores::get_lod(unsigned int index) const {
+    return (scores[index] - log(count) - trait_prob) / log(10.0);
+}
+
+// batch means are scaled by the largest one (the batch size and the trait
+// likelihood cancel out), the standard error of the mean is then converted 
+// into the standard error of its log10 with the delta method
+double LODscores::get_se(unsigned int index) const {
+    const double* b = &batches[index * MAX_BATCHES];
+    unsigned int k = samples[index] / batch_size[index];
+    
+    if(k < 2) {
+        return numeric_limits<double>::quiet_NaN();
+    }
+
+    double largest = *max_element(b, b + k);
+    double mean = 0.0;
+    double var = 0.0;
+
+    if(largest == LOG_ZERO) {
+        return numeric_limits<double>::quiet_NaN();
+    }
+
+    for(unsigned int i = 0; i < k; ++i) {
+        mean += exp_relative(b[i], largest);
+    }
+    mean /= k;
+
+    for(unsigned int i = 0; i < k; ++i) {
+        double tmp = exp_relative(b[i], largest) - mean;
+        var += (tmp * tmp);
+    }
+    var /= (k - 1);
+
+    return sqrt(var / k) / (mean * log(10.0));
+}
+
+double LODscores::get_max_se(unsigned int num_peaks) const {
+    vector<pair<double, unsigned int> > peaks;
+
+    for(unsigned int i = 0; i < num_scores; ++i) {
+        double lod = get_lod(i);
+
+        if(num_peaks != 0) {
+            if((i != 0) and (get_lod(i - 1) > lod))
+                continue;
+
+            if((i != (num_scores - 1)) and (get_lod(i + 1) > lod))
+                continue;
+        }
+
+        peaks.push_back(make_pair(lod, i));
+    }
+
+    sort(peaks.begin(), peaks.end());
+    reverse(peaks.begin(), peaks.end());
+
+    if((num_peaks != 0) and (peaks.size() > num_peaks)) {
+        peaks.resize(num_peaks);
+    }
+
+    double largest = 0.0;
+
+    for(unsigned int i = 0; i < peaks.size(); ++i) {
+        double se = get_se(peaks[i].second);
+        
+        if(se != se) {
+            return numeric_limits<double>::infinity();
+        }
+
+        largest = max(largest, se);
+    }
+
+    return largest;
+}
+
+void LODscores::save(Checkpoint& c) const {
+    vector<char> tmp(initialised.begin(), initialised.end());
+
+    c.put(count);
+    c.put(trait_prob);
+    c.put_vector(scores);
+    c.put_vector(tmp);
+    c.put_vector(last);
+    c.put_vector(batches);
+    c.put_vector(samples);
+    c.put_vector(batch_size);
+}
+
+bool LODscores::load(Checkpoint& c) {
+    LODscores tmp(*this);
+    vector<char> tmp_initialised;
+
+    if(not (c.get(tmp.count) and
+            c.get(tmp.trait_prob) and
+            c.get_vector(tmp.scores) and
+            c.get_vector(tmp_initialised) and
+            c.get_vector(tmp.last) and
+            c.get_vector(tmp.batches) and
+            c.get_vector(tmp.samples) and
+            c.get_vector(tmp.batch_size))) {
+        return false;
+    }
+
+    // different map or number of lod scores per marker
+    if((tmp.scores.size() != num_scores) or 
+       (tmp_initialised.size() != num_scores) or
+       (tmp.last.size() != num_scores) or
+       (tmp.batches.size() != (num_scores * MAX_BATCHES)) or
+       (tmp.samples.size() != num_scores) or
+       (tmp.batch_size.size() != num_scores)) {
+        return false;
+    }
+
+    tmp.initialised.assign(tmp_initialised.begin(), tmp_initialised.end());
+
+    *this = tmp;
+
+    return true;
+}
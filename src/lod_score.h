@@ -5,6 +5,7 @@ using namespace std;
 
 #include <cstdio>
 #include <vector>
+#include <algorithm>
 #include <cmath>
 #include <sstream>
 #include <iomanip>
@@ -12,9 +13,17 @@ using namespace std;
 #include "genetic_map.h"
 #include "logarithms.h"
 
+class Checkpoint;
 
+// lod scores are the log of the average trait likelihood over all the
+// descent graphs sampled, so each interval also keeps the (log) sums of
+// consecutive batches of samples to estimate the Monte Carlo standard error
+// by batch means. when all MAX_BATCHES are full neighbouring batches are
+// merged, so the batch size doubles and the memory used stays constant
 class LODscores {
     
+    static const unsigned int MAX_BATCHES = 32;
+
     GeneticMap* map;
     unsigned int num_scores_per_marker;
     unsigned int num_scores;
@@ -22,6 +31,14 @@ class LODscores {
     double trait_prob;
     vector<double> scores;
     vector<bool> initialised;
+    vector<double> last;    // most recent sample, for convergence diagnostics
+    vector<double> batches; // log sum of each batch, MAX_BATCHES per interval
+    vector<unsigned int> samples;
+    vector<unsigned int> batch_size;
+
+    void add_batch(unsigned int index, double prob);
+    void merge_batches(LODscores* tmp);
+    double get_lod(unsigned int index) const;
     
   public:
     LODscores(GeneticMap* map) : 
@@ -31,7 +48,11 @@ class LODscores {
         count(0),
         trait_prob(0.0),
         scores(num_scores),
-        initialised(num_scores) {}
+        initialised(num_scores),
+        last(num_scores, 0.0),
+        batches(num_scores * MAX_BATCHES, LOG_ZERO),
+        samples(num_scores, 0),
+        batch_size(num_scores, 1) {}
         
     ~LODscores() {}
     
@@ -42,7 +63,11 @@ class LODscores {
         count(rhs.count),
         trait_prob(rhs.trait_prob),
         scores(rhs.scores),
-        initialised(rhs.initialised) {}
+        initialised(rhs.initialised),
+        last(rhs.last),
+        batches(rhs.batches),
+        samples(rhs.samples),
+        batch_size(rhs.batch_size) {}
     
     LODscores& operator=(const LODscores& rhs) {
         
@@ -54,11 +79,29 @@ class LODscores {
             trait_prob = rhs.trait_prob;
             scores = rhs.scores;
             initialised = rhs.initialised;
+            last = rhs.last;
+            batches = rhs.batches;
+            samples = rhs.samples;
+            batch_size = rhs.batch_size;
         }
         
         return *this;
     }
     
+    void swap(LODscores& rhs) {
+        std::swap(map, rhs.map);
+        std::swap(num_scores_per_marker, rhs.num_scores_per_marker);
+        std::swap(num_scores, rhs.num_scores);
+        std::swap(count, rhs.count);
+        std::swap(trait_prob, rhs.trait_prob);
+        scores.swap(rhs.scores);
+        initialised.swap(rhs.initialised);
+        last.swap(rhs.last);
+        batches.swap(rhs.batches);
+        samples.swap(rhs.samples);
+        batch_size.swap(rhs.batch_size);
+    }
+    
     void set_trait_prob(double prob) {
         trait_prob = prob;
     }
@@ -74,6 +117,8 @@ class LODscores {
     void add(unsigned int locus, unsigned int offset, double prob) {
         unsigned int index = (locus * num_scores_per_marker) + offset;
         scores[index] = initialised[index] ? log_sum(prob, scores[index]) : prob, initialised[index] = true;
+        last[index] = prob;
+        add_batch(index, prob);
         
         if((locus == 0) and (offset == 0))
             ++count;
@@ -82,11 +127,26 @@ class LODscores {
     double get_raw(unsigned int index) {
         return scores[index];
     }
+
+    double get_last(unsigned int index) const {
+        return last[index];
+    }
     
     double get(unsigned int locus, unsigned int offset) const {
         return (scores[(locus * num_scores_per_marker) + offset] - log(count) - trait_prob) / log(10.0);
     }
     
+    // standard error of get(locus, offset), NaN until there are two batches
+    double get_se(unsigned int locus, unsigned int offset) const {
+        return get_se((locus * num_scores_per_marker) + offset);
+    }
+
+    double get_se(unsigned int index) const;
+
+    // the largest standard error at the num_peaks highest peaks in the lod
+    // score curve, or over every interval if num_peaks is zero
+    double get_max_se(unsigned int num_peaks) const;
+    
     double get_genetic_position(unsigned int locus, unsigned int offset) {
         return map->get_genetic_position(locus, offset);
     }
@@ -102,6 +162,8 @@ class LODscores {
         }
 
         count += tmp->get_count();
+
+        merge_batches(tmp);
     }
     
     void set_count(unsigned int c) { count = c; }
@@ -112,6 +174,9 @@ class LODscores {
         initialised[index] = true;
     }
 
+    void save(Checkpoint& c) const;
+    bool load(Checkpoint& c);
+
     string debug_string() {
         stringstream ss;
 
@@ -124,5 +189,9 @@ class LODscores {
     }
 };
 
+inline void swap(LODscores& a, LODscores& b) {
+    a.swap(b);
+}
+
 #endif
 
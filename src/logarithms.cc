@@ -32,3 +32,7 @@ double log_mean(double a, double b) {
     return log_sum(a, b) - log(2.0);
 }
 
+double exp_relative(double a, double largest) {
+    return ((a == LOG_ZERO) or ((a - largest) < -100.0)) ? 0.0 : exp(a - largest);
+}
+
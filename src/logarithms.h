@@ -12,5 +12,9 @@ double log_sum(double a, double b);
 double log_product(double a, double b);
 double log_mean(double a, double b);
 
+// exp(a - largest), flushed to zero when it is too small to matter so that it
+// cannot underflow (main() enables floating point exceptions)
+double exp_relative(double a, double largest);
+
 #endif
 
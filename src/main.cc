@@ -60,19 +60,32 @@ void _usage(char *prog) {
 "  -s NUM,     --sequentialimputation=NUM  (default = %d)\n"
 "  -x NUM,     --scoringperiod=NUM         (default = %d)\n"
 "  -l FLOAT,   --lsamplerprobability=FLOAT (default = %.1f)\n"
+"  -J FLOAT,   --blocksamplerprobability=FLOAT (default = %.1f)\n"
 "  -n NUM,     --lodscores=NUM             (default = %d)\n"
 "  -R NUM,     --runs=NUM                  (default = %d)\n"
+"  -z NUM,     --chains=NUM                (default = %d)\n"
 "\n"
 "MCMC diagnostic options:\n"
 "  -T,         --trace\n"
 "  -P PREFIX,  --traceprefix=PREFIX        (default = '%s')\n"
+"  -A,         --autostop\n"
+"  -H FLOAT,   --rhat=FLOAT                (default = %.2f)\n"
+"  -E NUM,     --ess=NUM                   (default = %d)\n"
+"  -Q FLOAT,   --targetse=FLOAT\n"
+"  -K NUM,     --targetpeaks=NUM           (default = %d, ie: every interval)\n"
+"\n"
+"Checkpoint options:\n"
+"  -F NUM,     --checkpointperiod=NUM      (default = off)\n"
+"  -Y PREFIX,  --checkpointprefix=PREFIX   (default = '%s')\n"
+"  -U,         --resume\n"
+"\n"
+"Metropolis-coupled MCMC options:\n"
+"  -M,         --mcmcmc\n"
+"  -y NUM,     --exchangeperiod=NUM        (default = %d)\n"
+"  -W FLOAT,   --exchangetarget=FLOAT      (default = %.3f)\n"
+"  -t FLOAT,FLOAT,... --temperatures=FLOAT,FLOAT,... (default = adaptive)\n"
+"  -j FILE,    --exchangefile=FILE\n"
 "\n"
-//"Metropolis-coupled MCMC options:\n"
-//"  -M,         --mcmcmc\n"
-//"  -z NUM,     --chains=NUM                (default = %d)\n"
-//"  -y NUM,     --exchangeperiod=NUM        (default = %d)\n"
-//"  -t FLOAT,FLOAT,... --temperatures=FLOAT,FLOAT,...\n"
-//"\n"
 "ELOD options:\n"
 "  -e          --elod\n"
 "  -f FLOAT    --frequency=FLOAT           (default = %.1e)\n"
@@ -87,6 +100,14 @@ void _usage(char *prog) {
 #else
 "  -g,         --gpu\n"
 #endif
+"  -N,         --nopool\n"
+"  -S NUM,     --scoringthreads=NUM        (default = %d)\n"
+"  -B NUM,     --snapshots=NUM             (default = %d)\n"
+"  -D,         --dropsnapshots\n"
+"  -C FILE,    --tuningcache=FILE          (cache thread tuning in FILE)\n"
+"  -O,         --onlinetuning\n"
+"  -L LAYOUT,  --graphlayout=LAYOUT        (default = 'locus', or 'meiosis')\n"
+"  -G DIR,     --codegen=DIR               (compile peel kernels, cached in DIR)\n"
 "\n"
 "Misc:\n"
 "  -X,         --sexlinked\n"
@@ -104,11 +125,17 @@ DEFAULT_MCMC_BURNIN,
 DEFAULT_SEQUENTIALIMPUTATION_RUNS,
 DEFAULT_MCMC_SCORING_PERIOD,
 DEFAULT_LSAMPLER_PROB,
+DEFAULT_BLOCK_PROB,
 DEFAULT_LODSCORES,
 DEFAULT_MCMC_RUNS,
+DEFAULT_MCMC_CHAINS,
 DEFAULT_CODA_PREFIX,
-//DEFAULT_MCMC_CHAINS,
-//DEFAULT_MCMC_EXCHANGE_PERIOD,
+DEFAULT_RHAT_THRESHOLD,
+DEFAULT_MIN_ESS,
+DEFAULT_TARGET_PEAKS,
+DEFAULT_CHECKPOINT_PREFIX,
+DEFAULT_MCMC_EXCHANGE_PERIOD,
+DEFAULT_MCMC_EXCHANGE_TARGET,
 DEFAULT_ELOD_FREQUENCY,
 DEFAULT_ELOD_SEPARATION,
 DEFAULT_ELOD_PENETRANCE[0],
@@ -116,6 +143,8 @@ DEFAULT_ELOD_PENETRANCE[1],
 DEFAULT_ELOD_PENETRANCE[2],
 DEFAULT_ELOD_REPLICATES,
 DEFAULT_THREAD_COUNT,
+DEFAULT_SCORING_THREADS,
+DEFAULT_SNAPSHOT_BUFFER,
 DEFAULT_PEELOPT_ITERATIONS
 );
 }
@@ -198,9 +227,10 @@ void _handle_args(int argc, char **argv) {
             {"gpu",                 no_argument,        0,      'g'},
             {"help",                no_argument,        0,      'h'},
             {"iterations",          required_argument,  0,      'i'},
-            //{"exchangefile",        required_argument,  0,      'j'},
+            {"exchangefile",        required_argument,  0,      'j'},
             {"penetrance",          required_argument,  0,      'k'},
             {"lsamplerprobability", required_argument,  0,      'l'},
+            {"blocksamplerprobability", required_argument, 0,   'J'},
             {"map",                 required_argument,  0,      'm'},
             {"lodscores",           required_argument,  0,      'n'},
             {"output",              required_argument,  0,      'o'},
@@ -208,18 +238,35 @@ void _handle_args(int argc, char **argv) {
             {"peelseqiter",         required_argument,  0,      'q'},
             {"randomseeds",         required_argument,  0,      'r'},
             {"sequentialimputation",required_argument,  0,      's'},
-            //{"temperatures",        required_argument,  0,      't'},
+            {"temperatures",        required_argument,  0,      't'},
             {"replicates",          required_argument,  0,      'u'},
 	        {"verbose",             no_argument,        0,      'v'},
             {"separation",          required_argument,  0,      'w'},
             {"scoringperiod",       required_argument,  0,      'x'},
-            //{"exchangeperiod",      required_argument,  0,      'y'},
-            //{"chains",              required_argument,  0,      'z'},
-            //{"mcmcmc",              no_argument,        0,      'M'},
+            {"exchangeperiod",      required_argument,  0,      'y'},
+            {"exchangetarget",      required_argument,  0,      'W'},
+            {"chains",              required_argument,  0,      'z'},
+            {"mcmcmc",              no_argument,        0,      'M'},
             {"sexlinked",           no_argument,        0,      'X'},
             {"runs",                required_argument,  0,      'R'},
+            {"nopool",              no_argument,        0,      'N'},
+            {"scoringthreads",      required_argument,  0,      'S'},
+            {"snapshots",           required_argument,  0,      'B'},
+            {"dropsnapshots",       no_argument,        0,      'D'},
+            {"tuningcache",         required_argument,  0,      'C'},
+            {"onlinetuning",        no_argument,        0,      'O'},
+            {"graphlayout",         required_argument,  0,      'L'},
+            {"codegen",             required_argument,  0,      'G'},
             {"trace",               no_argument,        0,      'T'},
             {"traceprefix",         required_argument,  0,      'P'},
+            {"autostop",            no_argument,        0,      'A'},
+            {"rhat",                required_argument,  0,      'H'},
+            {"ess",                 required_argument,  0,      'E'},
+            {"targetse",            required_argument,  0,      'Q'},
+            {"targetpeaks",         required_argument,  0,      'K'},
+            {"checkpointperiod",    required_argument,  0,      'F'},
+            {"checkpointprefix",    required_argument,  0,      'Y'},
+            {"resume",              no_argument,        0,      'U'},
             {0, 0, 0, 0}
 	    };
     
@@ -227,7 +274,7 @@ void _handle_args(int argc, char **argv) {
     
 	while ((ch = getopt_long(argc, argv, 
                     //":p:d:m:o:i:b:s:l:c:x:q:r:n:vhcgz:y:t:ew:k:f:u:j:aMX", 
-                    ":p:d:m:o:i:b:s:l:c:x:q:r:n:vhcgew:k:f:u:aXR:TP:",
+                    ":p:d:m:o:i:b:s:l:J:c:x:q:r:n:vhcgew:k:f:u:aXR:TP:NS:B:DC:Oz:AH:E:Q:K:F:Y:Uy:t:j:MW:L:G:",
                     long_options, &option_index)) != -1) {
 		switch (ch) {
 			case 'p':
@@ -316,6 +363,17 @@ void _handle_args(int argc, char **argv) {
                 }
                 break;
                 
+            case 'J':
+                if(not str2float(options.block_prob, optarg)) {
+                    fprintf(stderr, "%s: option '-J' requires a float (>=0, <= 1) as an argument ('%s' given)\n", argv[0], optarg);
+                    exit(EXIT_FAILURE);
+                }
+                if((options.block_prob < 0.0) or (options.block_prob > 1.0)) {
+                    fprintf(stderr, "%s: option '-J' requires an argument >= 0 and <= 1 (%.3f given)\n", argv[0], options.block_prob);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+                
             case 'n':
                 if(not str2int(options.lodscores, optarg)) {
                     fprintf(stderr, "%s: option '-n' requires an int as an argument ('%s' given)\n", argv[0], optarg);
@@ -335,6 +393,48 @@ void _handle_args(int argc, char **argv) {
                 fprintf(stderr, "Error: SwiftLink was compiled without CUDA support, exiting...\n");
                 exit(EXIT_FAILURE);
 #endif
+
+            case 'N':
+                options.use_pool = false;
+                break;
+
+            case 'S':
+                if(not str2int(options.scoring_threads, optarg)) {
+                    fprintf(stderr, "%s: option '-S' requires an int as an argument ('%s' given)\n", argv[0], optarg);
+                    exit(EXIT_FAILURE);
+                }
+                if(options.scoring_threads < 0) {
+                    fprintf(stderr, "%s: number of scoring threads cannot be negative (%d given)\n", argv[0], options.scoring_threads);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'B':
+                if(not str2int(options.snapshot_buffer, optarg)) {
+                    fprintf(stderr, "%s: option '-B' requires an int as an argument ('%s' given)\n", argv[0], optarg);
+                    exit(EXIT_FAILURE);
+                }
+                if(options.snapshot_buffer < 1) {
+                    fprintf(stderr, "%s: snapshot buffer must have at least one slot (%d given)\n", argv[0], options.snapshot_buffer);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'D':
+                options.snapshot_drop = true;
+                break;
+
+            case 'C':
+                options.tuning_cache = string(optarg);
+                break;
+
+            case 'O':
+                options.online_tuning = true;
+                break;
+
+            case 'G':
+                options.codegen_dir = string(optarg);
+                break;
                 
             case 'q':
                 if(not str2int(options.peelopt_iterations, optarg)) {
@@ -378,10 +478,6 @@ void _handle_args(int argc, char **argv) {
 			case 'h':
 				_usage(argv[0]);
 				exit(EXIT_SUCCESS);
-	        /*
-            case 'j':
-                options.exchange_filename = string(optarg);
-                break;
 
             case 'z':
                 if(not str2int(options.mc3_number_of_chains, optarg)) {
@@ -394,6 +490,77 @@ void _handle_args(int argc, char **argv) {
                 }
                 break;
 
+            case 'A':
+                options.autostop = true;
+                break;
+
+            case 'H':
+                if(not str2float(options.rhat_threshold, optarg)) {
+                    fprintf(stderr, "%s: option '-H' requires a float as an argument ('%s' given)\n", argv[0], optarg);
+                    exit(EXIT_FAILURE);
+                }
+                if(options.rhat_threshold <= 1.0) {
+                    fprintf(stderr, "%s: R-hat threshold must be greater than 1.0 ('%f' given)\n", argv[0], options.rhat_threshold);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'E':
+                if(not str2int(options.min_ess, optarg)) {
+                    fprintf(stderr, "%s: option '-E' requires an int as an argument ('%s' given)\n", argv[0], optarg);
+                    exit(EXIT_FAILURE);
+                }
+                if(options.min_ess < 1) {
+                    fprintf(stderr, "%s: effective sample size must be greater than zero ('%d' given)\n", argv[0], options.min_ess);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'Q':
+                if(not str2float(options.target_se, optarg)) {
+                    fprintf(stderr, "%s: option '-Q' requires a float as an argument ('%s' given)\n", argv[0], optarg);
+                    exit(EXIT_FAILURE);
+                }
+                if(options.target_se <= 0.0) {
+                    fprintf(stderr, "%s: target standard error must be greater than zero ('%f' given)\n", argv[0], options.target_se);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'K':
+                if(not str2int(options.target_peaks, optarg)) {
+                    fprintf(stderr, "%s: option '-K' requires an int as an argument ('%s' given)\n", argv[0], optarg);
+                    exit(EXIT_FAILURE);
+                }
+                if(options.target_peaks < 0) {
+                    fprintf(stderr, "%s: number of peaks cannot be negative ('%d' given)\n", argv[0], options.target_peaks);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'F':
+                if(not str2int(options.checkpoint_period, optarg)) {
+                    fprintf(stderr, "%s: option '-F' requires an int as an argument ('%s' given)\n", argv[0], optarg);
+                    exit(EXIT_FAILURE);
+                }
+                if(options.checkpoint_period < 1) {
+                    fprintf(stderr, "%s: checkpoint period must be greater than zero ('%d' given)\n", argv[0], options.checkpoint_period);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
+            case 'Y':
+                options.checkpoint_prefix = string(optarg);
+                break;
+
+            case 'U':
+                options.resume = true;
+                break;
+
+            case 'j':
+                options.exchange_filename = string(optarg);
+                break;
+
             case 'y':
                 if(not str2int(options.mc3_exchange_period, optarg)) {
                     fprintf(stderr, "%s: option '-y' requires an int as an argument ('%s' given)\n", argv[0], optarg);
@@ -422,10 +589,34 @@ void _handle_args(int argc, char **argv) {
 
                 break;
             
+            case 'W':
+                if(not str2float(options.mc3_exchange_target, optarg)) {
+                    fprintf(stderr, "%s: option '-W' requires a float as an argument ('%s' given)\n", argv[0], optarg);
+                    exit(EXIT_FAILURE);
+                }
+                if((options.mc3_exchange_target <= 0.0) or (options.mc3_exchange_target >= 1.0)) {
+                    fprintf(stderr, "%s: exchange acceptance target must be between 0.0 and 1.0 exclusive ('%f' given)\n", argv[0], options.mc3_exchange_target);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
             case 'M':
                 options.mc3 = true;
                 break;
-            */
+
+            case 'L':
+                if(strcmp(optarg, "locus") == 0) {
+                    options.graph_layout = LOCUS_MAJOR;
+                }
+                else if(strcmp(optarg, "meiosis") == 0) {
+                    options.graph_layout = MEIOSIS_MAJOR;
+                }
+                else {
+                    fprintf(stderr, "%s: option '-L' can only accept 'locus' or 'meiosis' as arguments ('%s' given)\n", argv[0], optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+
             case 'a':
                 options.affected_only = true;
                 break;
@@ -531,6 +722,48 @@ void _handle_args(int argc, char **argv) {
     if(options.elod and pedfile != NULL)
         return;
 
+    if((options.scoring_threads > 0) and (options.scoring_threads >= options.thread_count)) {
+        fprintf(stderr, "Error: at least one core must be left for sampling (%d cores, %d scoring threads)\n", 
+                options.thread_count, options.scoring_threads);
+        exit(EXIT_FAILURE);
+    }
+
+    if((options.scoring_threads > 0) and ((not options.use_pool) or options.use_gpu)) {
+        fprintf(stderr, "Error: separate scoring threads are only supported with the worker pool\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if((options.lsampler_prob + options.block_prob) > 1.0) {
+        fprintf(stderr, "Error: the locus sampler and block sampler probabilities add up to more than one (%.3f + %.3f)\n", 
+                options.lsampler_prob, options.block_prob);
+        exit(EXIT_FAILURE);
+    }
+
+    if((options.block_prob > 0.0) and options.use_gpu) {
+        fprintf(stderr, "Error: the block sampler is not supported on the GPU\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(options.autostop and (options.mc3_number_of_chains < 2)) {
+        fprintf(stderr, "Error: convergence diagnostics need at least two chains (see '-z')\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(options.mc3 and (options.mc3_number_of_chains < 2)) {
+        fprintf(stderr, "Error: Metropolis-coupled MCMC needs at least two chains (see '-z')\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(options.mc3 and options.autostop) {
+        fprintf(stderr, "Error: convergence diagnostics need independent chains, they cannot be used with '-M'\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if(((options.checkpoint_period > 0) or options.resume) and ((options.mc3_number_of_chains > 1) or options.use_gpu)) {
+        fprintf(stderr, "Error: checkpointing is not supported with multiple chains (-z) or on the GPU\n");
+        exit(EXIT_FAILURE);
+    }
+
     if(options.use_gpu and options.sex_linked) {
         fprintf(stderr, "Error: we do not current support sex-linked analysis on GPU\n");
         exit(EXIT_FAILURE);
@@ -1,4 +1,5 @@
 #include <cstdio>
+#include <cstdlib>
 #include <cmath>
 #include <vector>
 #include <algorithm>
@@ -20,6 +21,10 @@
 #include "random.h"
 #include "lod_score.h"
 #include "omp_facade.h"
+#include "worker_pool.h"
+#include "snapshot_buffer.h"
+#include "tuning_cache.h"
+#include "checkpoint.h"
 
 #ifdef USE_CUDA
   #include "gpu_lodscores.h"
@@ -30,6 +35,104 @@ using namespace std;
 
 //#define CODA_OUTPUT 1
 
+// tasks for the worker pool, each thread uses its own LocusSampler/Peeler
+class LocusSamplerTask : public WorkerTask {
+    vector<LocusSampler*>& lsamplers;
+    LocusScheduler& lscheduler;
+    DescentGraph& dg;
+    int round;
+
+ public :
+    LocusSamplerTask(vector<LocusSampler*>& lsamplers, LocusScheduler& lscheduler, DescentGraph& dg, int round) :
+        lsamplers(lsamplers),
+        lscheduler(lscheduler),
+        dg(dg),
+        round(round) {}
+
+    void operator()(int index, int thread_num) {
+        int locus = lscheduler.get_locus(round, index);
+        lsamplers[thread_num]->set_locus_minimal(locus);
+        lsamplers[thread_num]->step(dg, locus);
+    }
+};
+
+class MeiosisResetTask : public WorkerTask {
+    MeiosisSampler& msampler;
+    DescentGraph& dg;
+    unsigned int parameter;
+
+ public :
+    MeiosisResetTask(MeiosisSampler& msampler, DescentGraph& dg, unsigned int parameter) :
+        msampler(msampler),
+        dg(dg),
+        parameter(parameter) {}
+
+    void operator()(int index, int /*thread_num*/) {
+        msampler.reset_block(dg, parameter, index);
+    }
+};
+
+class MeiosisStepTask : public WorkerTask {
+    MeiosisSampler& msampler;
+    DescentGraph& dg;
+    unsigned int parameter;
+
+ public :
+    MeiosisStepTask(MeiosisSampler& msampler, DescentGraph& dg, unsigned int parameter) :
+        msampler(msampler),
+        dg(dg),
+        parameter(parameter) {}
+
+    void operator()(int index, int /*thread_num*/) {
+        msampler.step_locus(dg, parameter, index);
+    }
+};
+
+class MeiosisUpdateTask : public WorkerTask {
+    MeiosisSampler& msampler;
+    DescentGraph& dg;
+
+ public :
+    MeiosisUpdateTask(MeiosisSampler& msampler, DescentGraph& dg) :
+        msampler(msampler),
+        dg(dg) {}
+
+    void operator()(int index, int /*thread_num*/) {
+        msampler.update_block(dg, index);
+    }
+};
+
+class MeiosisBlockTask : public WorkerTask {
+    MeiosisSampler& msampler;
+    DescentGraph& dg;
+    unsigned int block;
+
+ public :
+    MeiosisBlockTask(MeiosisSampler& msampler, DescentGraph& dg, unsigned int block) :
+        msampler(msampler),
+        dg(dg),
+        block(block) {}
+
+    void operator()(int index, int /*thread_num*/) {
+        msampler.step_meiosis_block_locus(dg, block, index);
+    }
+};
+
+class PeelerTask : public WorkerTask {
+    vector<Peeler*>& peelers;
+    DescentGraph& dg;
+
+ public :
+    PeelerTask(vector<Peeler*>& peelers, DescentGraph& dg) :
+        peelers(peelers),
+        dg(dg) {}
+
+    void operator()(int index, int thread_num) {
+        peelers[thread_num]->set_locus(index);
+        peelers[thread_num]->process(&dg);
+    }
+};
+
 void MarkovChain::_init() {
     // heat up the map
     map.set_temperature(temperature);
@@ -79,6 +182,11 @@ void MarkovChain::_init() {
         }
     }
 
+    // ordering for the meiosis block sampler
+    for(unsigned int i = 0; i < msampler.num_meiosis_blocks(); ++i) {
+        b_ordering.push_back(i);
+    }
+
     // create coda file if necessary
     if(options.coda_logging) {
         //string fname = options.coda_prefix + ".ped" + ped->get_id() + ".run" + to_string(seq_num); // does not work on gcc 4.8.X
@@ -104,47 +212,35 @@ void MarkovChain::_kill() {
     }
 }
 
+// used by Mc3 to adjust the temperature ladder during burnin, the map is
+// assigned in place because the samplers hold pointers to it
+void MarkovChain::set_temperature(GeneticMap* cold_map, double temp) {
+    GeneticMap tmp(*cold_map);
+
+    if(temp != 1.0) {
+        tmp.set_temperature(temp);
+    }
+
+    map = tmp;
+    msampler.update_frequencies();
+    temperature = temp;
+}
+
 void MarkovChain::step(DescentGraph& dg, int start_iteration, int step_size) {
+    RandomInt rng;
     int thread_num = 0;
 
     for(int i = start_iteration; i < start_iteration + step_size; ++i) {
-        if(get_random() < options.lsampler_prob) {
-            
-            random_shuffle(l_ordering.begin(), l_ordering.end());
-            vector<int> thread_assignments(get_max_threads(), -1);
-            vector<int> tmp(l_ordering);
-
-            #pragma omp parallel
-            {
-                thread_num = get_thread_num(); 
-
-                while(1) {
-                    #pragma omp critical 
-                    {
-                        int locus = -1;
-                        if(not tmp.empty()) {
-                            for(int j = int(tmp.size()-1); j >= 0; --j) {
-                                if(noninterferring(thread_assignments, tmp[j], thread_num)) {
-                                    locus = tmp[j];
-                                    tmp.erase(tmp.begin() + j);
-                                    break;
-                                }
-                            }
-                        }
-
-                        thread_assignments[thread_num] = locus;
-                    }
-                    
-                    if(thread_assignments[thread_num] == -1)
-                        break;
-                    
-                    lsamplers[thread_num]->set_locus_minimal(thread_assignments[thread_num]);
-                    lsamplers[thread_num]->step(dg, thread_assignments[thread_num]);
-                }
-            }
+        double move = get_random();
+        
+        if(move < options.lsampler_prob) {
+            run_old_lsampler(dg);
+        }
+        else if((move < (options.lsampler_prob + options.block_prob)) and (b_ordering.size() != 0)) {
+            run_block_sampler(dg);
         }
         else {
-            random_shuffle(m_ordering.begin(), m_ordering.end());
+            random_shuffle(m_ordering.begin(), m_ordering.end(), rng);
             
             msampler.reset(dg, m_ordering[0]);
             for(unsigned int j = 0; j < m_ordering.size(); ++j) {
@@ -207,9 +303,10 @@ void MarkovChain::step(DescentGraph& dg, int start_iteration, int step_size) {
 }
 
 void MarkovChain::run_scalable_lsampler(DescentGraph& dg, vector<int>& lgroups, int num_lgroups) {
+    RandomInt rng;
     int thread_num = 0;
 
-    random_shuffle(lgroups.begin(), lgroups.end());
+    random_shuffle(lgroups.begin(), lgroups.end(), rng);
 
     for(int j = 0; j < num_lgroups; ++j) {
         #pragma omp parallel num_threads(lsamplers.size()) private(thread_num)
@@ -227,45 +324,91 @@ void MarkovChain::run_scalable_lsampler(DescentGraph& dg, vector<int>& lgroups,
 
 void MarkovChain::run_old_lsampler(DescentGraph& dg) {
     int thread_num = 0;
-    random_shuffle(l_ordering.begin(), l_ordering.end());
-    vector<int> thread_assignments(lsamplers.size(), -1);
-    vector<int> tmp(l_ordering);
+    int locus;
 
-    #pragma omp parallel num_threads(lsamplers.size()) private(thread_num)
+    lscheduler.shuffle();
+
+    #pragma omp parallel num_threads(lsamplers.size()) private(thread_num, locus)
     {
         thread_num = get_thread_num();
 
-        while(1) {
-            #pragma omp critical 
-            {
-                int locus = -1;
-                if(not tmp.empty()) {
-                    for(int j = int(tmp.size()-1); j >= 0; --j) {
-                        if(noninterferring(thread_assignments, tmp[j], thread_num)) {
-                            locus = tmp[j];
-                            tmp.erase(tmp.begin() + j);
-                            break;
-                        }
-                    }
-                }
-
-                thread_assignments[thread_num] = locus;
+        for(int r = 0; r < lscheduler.num_rounds(); ++r) {
+            while((locus = lscheduler.claim(r)) != -1) {
+                lsamplers[thread_num]->set_locus_minimal(locus);
+                lsamplers[thread_num]->step(dg, locus);
             }
-                    
-            if(thread_assignments[thread_num] == -1)
-                break;
-                    
-            lsamplers[thread_num]->set_locus_minimal(thread_assignments[thread_num]);
-            lsamplers[thread_num]->step(dg, thread_assignments[thread_num]);
 
-            #pragma omp critical
-            {
-                thread_assignments[thread_num] = -1;
-            }
+            // loci in the next round are adjacent to loci in this one
+            #pragma omp barrier
         }
     }
 }
 
+// unlike m_ordering this is not carried over from one step to the next, so 
+// it does not need checkpointing
+void MarkovChain::shuffle_blocks() {
+    RandomInt rng;
+
+    for(unsigned int i = 0; i < b_ordering.size(); ++i) {
+        b_ordering[i] = i;
+    }
+
+    random_shuffle(b_ordering.begin(), b_ordering.end(), rng);
+}
+
+void MarkovChain::run_block_sampler(DescentGraph& dg) {
+    shuffle_blocks();
+
+    msampler.update_graphs(dg);
+
+    for(unsigned int j = 0; j < b_ordering.size(); ++j) {
+        msampler.step_meiosis_block(dg, b_ordering[j]);
+    }
+}
+
+vector<int> MarkovChain::make_lgroups(int num_lgroups) {
+    vector<int> lgroups;
+
+    for(int i = 0; i < num_lgroups; ++i) {
+        lgroups.push_back(i);
+    }
+
+    return lgroups;
+}
+
+void MarkovChain::run_lsampler(DescentGraph& dg, vector<int>& lgroups, int num_lgroups) {
+    if(num_lgroups == -1) {
+        run_old_lsampler(dg);
+    }
+    else {
+        run_scalable_lsampler(dg, lgroups, num_lgroups);
+    }
+}
+
+// candidates were timed round robin, so the first (steps % candidates)
+// of them have been timed one more time than the rest
+int MarkovChain::best_num_lgroups(vector<int>& candidates, vector<double>& timings, int steps) {
+    int num_candidates = candidates.size();
+    int best_index = -1;
+    double best_time = 0.0;
+
+    for(int i = 0; i < num_candidates; ++i) {
+        int count = (steps / num_candidates) + ((i < (steps % num_candidates)) ? 1 : 0);
+
+        if(count == 0)
+            continue;
+
+        double run_time = timings[i] / count;
+
+        if((best_index == -1) or (run_time < best_time)) {
+            best_index = i;
+            best_time = run_time;
+        }
+    }
+
+    return (best_index == -1) ? -1 : candidates[best_index];
+}
+
 int MarkovChain::optimal_num_lgroups(DescentGraph& dg) {
     int best_num_lgroups = -1;
     double best_time, start_time, run_time;
@@ -310,40 +453,448 @@ int MarkovChain::optimal_num_lgroups(DescentGraph& dg) {
     return best_num_lgroups;
 }
 
+// a single parallel region for the whole chain, the master thread makes all
+// the random choices + does the book-keeping and the team only meets at barriers
+//
+// if snapshots is not NULL, then instead of scoring the descent graph in place
+// a copy is handed to the scoring threads (see score_worker_pool)
+void MarkovChain::sample_worker_pool(DescentGraph& dg, Progress& p, SnapshotBuffer* snapshots, int num_threads) {
+    RandomInt rng;
+    WorkerPool pool(num_threads);
+    int num_markers = map.num_markers();
+    bool lsampler_step = false;
+    bool block_step = false;
+    bool scoring_step = false;
+
+    int stop = 0;
+
+    #pragma omp parallel num_threads(pool.size())
+    {
+        for(int i = first_iteration; i < (options.iterations + options.burnin); ++i) {
+            
+            #pragma omp single
+            {
+                checkpoint(dg, i, snapshots);
+
+                if(snapshots) {
+                    #pragma omp atomic read
+                    stop = stop_sampling;
+                }
+                else {
+                    stop = target_se_reached();
+                }
+
+                double move = get_random();
+
+                lsampler_step = move < options.lsampler_prob;
+                block_step = (not lsampler_step) and (move < (options.lsampler_prob + options.block_prob)) and (b_ordering.size() != 0);
+
+                if(lsampler_step) {
+                    lscheduler.shuffle();
+                }
+                else if(block_step) {
+                    shuffle_blocks();
+                }
+                else {
+                    random_shuffle(m_ordering.begin(), m_ordering.end(), rng);
+                    msampler.reset_finish(m_ordering[0]);
+                }
+            }
+
+            if(stop)
+                break;
+
+            if(lsampler_step) {
+                for(int r = 0; r < lscheduler.num_rounds(); ++r) {
+                    LocusSamplerTask t(lsamplers, lscheduler, dg, r);
+                    pool.execute(t, lscheduler.round_size(r));
+                }
+            }
+            else if(block_step) {
+                MeiosisUpdateTask ut(msampler, dg);
+                pool.execute(ut, msampler.num_blocks());
+
+                for(unsigned int j = 0; j < b_ordering.size(); ++j) {
+                    MeiosisBlockTask bt(msampler, dg, b_ordering[j]);
+                    pool.execute(bt, num_markers);
+
+                    #pragma omp single
+                    msampler.step_meiosis_block_sample(dg, b_ordering[j]);
+                }
+            }
+            else {
+                MeiosisResetTask rt(msampler, dg, m_ordering[0]);
+                pool.execute(rt, msampler.num_blocks());
+
+                for(unsigned int j = 0; j < m_ordering.size(); ++j) {
+                    MeiosisStepTask st(msampler, dg, m_ordering[j]);
+                    pool.execute(st, num_markers);
+
+                    #pragma omp single
+                    msampler.step_sample(dg, m_ordering[j]);
+                }
+            }
+
+            #pragma omp single
+            {
+                p.increment();
+
+                scoring_step = (i >= options.burnin) and ((i % options.scoring_period) == 0);
+
+                if(scoring_step and options.coda_logging) {
+                    double current_likelihood = dg.get_likelihood();
+                    if(current_likelihood == LOG_ILLEGAL) {
+                        fprintf(stderr, "error: descent graph illegal...\n");
+                        abort();
+                    }
+
+                    fprintf(coda_filehandle, "%d\t%f\n", i+1, current_likelihood);
+                }
+
+                if(scoring_step and snapshots) {
+                    snapshots->push(dg);
+                }
+            }
+
+            if(scoring_step and not snapshots) {
+                PeelerTask t(peelers, dg);
+                pool.execute(t, num_markers - 1);
+            }
+        }
+
+        #pragma omp single
+        {
+            if(snapshots) {
+                snapshots->finish();
+            }
+        }
+    }
+}
+
+// drains the snapshot buffer, snapshots are scored one at a time by the whole
+// team because peelers working on different snapshots would update the same
+// lod scores
+void MarkovChain::score_worker_pool(SnapshotBuffer& snapshots, int num_threads) {
+    WorkerPool pool(num_threads);
+    int num_markers = map.num_markers();
+    DescentGraph* current = NULL;
+
+    #pragma omp parallel num_threads(pool.size())
+    {
+        while(1) {
+            #pragma omp single
+            current = snapshots.front();
+
+            if(current == NULL)
+                break;
+
+            PeelerTask t(peelers, *current);
+            pool.execute(t, num_markers - 1);
+
+            #pragma omp single
+            {
+                if((stop_sampling == 0) and target_se_reached()) {
+                    #pragma omp atomic write
+                    stop_sampling = 1;
+                }
+
+                // after everything else, checkpoint() waits for this
+                snapshots.pop();
+            }
+        }
+    }
+}
+
+void MarkovChain::run_worker_pool(DescentGraph& dg, Progress& p) {
+    int num_threads = min(lsamplers.size(), peelers.size());
+
+    // scoring_threads of the cores are used for scoring, the rest for sampling
+    if((options.scoring_threads < 1) or (get_max_threads() < 2)) {
+        sample_worker_pool(dg, p, NULL, num_threads);
+        p.finish();
+        return;
+    }
+
+    int scoring_threads = min(options.scoring_threads, int(peelers.size()));
+    int sampling_threads = min(options.thread_count - options.scoring_threads, int(lsamplers.size()));
+    int max_levels = get_max_active_levels();
+
+    SnapshotBuffer snapshots(dg, options.snapshot_buffer, options.snapshot_drop);
+
+    if(sampling_threads < 1) {
+        sampling_threads = 1;
+    }
+
+    // the chain may itself be running inside a team (see LinkageProgram)
+    if(max_levels < (get_level() + 2)) {
+        set_max_active_levels(get_level() + 2);
+    }
+
+    #pragma omp parallel num_threads(2)
+    {
+        if(get_num_threads() < 2) {
+            sample_worker_pool(dg, p, NULL, num_threads);
+        }
+        else if(get_thread_num() == 0) {
+            sample_worker_pool(dg, p, &snapshots, sampling_threads);
+        }
+        else {
+            score_worker_pool(snapshots, scoring_threads);
+        }
+    }
+
+    set_max_active_levels(max_levels);
+
+    p.finish();
+
+    if(snapshots.num_dropped() != 0) {
+        fprintf(stderr, "warning: %d snapshot%s dropped because the scoring threads could not keep up\n", 
+                snapshots.num_dropped(), snapshots.num_dropped() == 1 ? " was" : "s were");
+    }
+}
+
+string MarkovChain::checkpoint_filename() {
+    char buf[16];
+    sprintf(buf, "%d", seq_num);
+    return options.checkpoint_prefix + ".ped" + ped->get_id() + ".run" + string(buf);
+}
+
+// everything needed to carry on from the start of iteration, the locus
+// scheduler and the meiosis sampler are rebuilt every step so they are not
+// included, but the meiosis ordering is shuffled in place so it is
+void MarkovChain::save_checkpoint(Checkpoint& c, DescentGraph& dg, int iteration) {
+    vector<char> rng;
+
+    get_random_state(rng);
+
+    c.clear();
+    c.put(iteration);
+    c.put(last_se_check);
+    c.put(int(dg.get_layout()));
+    c.put(dg.get_internal_size());
+    c.put_bytes(dg.get_internal_ptr(), dg.get_internal_size());
+    c.put_vector(m_ordering);
+    c.put_vector(rng);
+    lod->save(c);
+}
+
+// called between iterations when nothing is using the descent graph, if the
+// previous checkpoint is still being written then try again next iteration
+void MarkovChain::checkpoint(DescentGraph& dg, int iteration, SnapshotBuffer* snapshots) {
+    
+    if((writer == NULL) or (iteration < next_checkpoint) or (not writer->idle())) {
+        return;
+    }
+
+    // the lod scores are being updated by the scoring threads
+    if(snapshots) {
+        snapshots->drain();
+    }
+
+    Checkpoint c(checkpoint_filename());
+
+    save_checkpoint(c, dg, iteration);
+
+    writer->submit(c);
+
+    next_checkpoint = iteration + options.checkpoint_period;
+}
+
+// the chain has finished, so a resumed run will skip straight to the end
+void MarkovChain::final_checkpoint(DescentGraph& dg) {
+
+    if(writer == NULL) {
+        return;
+    }
+
+    Checkpoint c(checkpoint_filename());
+
+    save_checkpoint(c, dg, options.iterations + options.burnin);
+
+    writer->wait();
+    writer->submit(c);
+
+    delete writer;
+    writer = NULL;
+}
+
+// returns false if there is no checkpoint for this chain, in which case it
+// has to be started from the beginning
+bool MarkovChain::resume(DescentGraph& dg) {
+    Checkpoint c(checkpoint_filename());
+    int iteration;
+    unsigned int se_check;
+    int layout;
+    size_t size;
+    vector<int> ordering;
+    vector<char> rng;
+
+    if(not c.exists()) {
+        printf("no checkpoint found for pedigree %s run %d (%s)\n", ped->get_id().c_str(), seq_num, c.get_filename().c_str());
+        return false;
+    }
+
+    if(not c.read()) {
+        exit(EXIT_FAILURE);
+    }
+
+    // the graph is stored in whatever layout the chain was using
+    if(c.get(iteration) and 
+       c.get(se_check) and 
+       c.get(layout) and 
+       ((layout == LOCUS_MAJOR) or (layout == MEIOSIS_MAJOR))) {
+        dg.set_layout(static_cast<enum graph_layout>(layout));
+    }
+    else {
+        fprintf(stderr, "error: checkpoint '%s' does not match this analysis\n", c.get_filename().c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    if(not (c.get(size) and 
+            (size == dg.get_internal_size()) and 
+            c.get_bytes(dg.get_internal_ptr(), size) and
+            c.get_vector(ordering) and
+            (ordering.size() == m_ordering.size()) and
+            c.get_vector(rng) and
+            lod->load(c))) {
+        fprintf(stderr, "error: checkpoint '%s' does not match this analysis\n", c.get_filename().c_str());
+        exit(EXIT_FAILURE);
+    }
+    
+    dg.invalidate();
+
+    if(dg.get_likelihood() == LOG_ILLEGAL) {
+        fprintf(stderr, "error: descent graph in checkpoint '%s' is illegal\n", c.get_filename().c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    if(not set_random_state(rng)) {
+        fprintf(stderr, "warning: random number generators were not restored from '%s' (different number of threads?)\n", c.get_filename().c_str());
+    }
+
+    // the layout can be changed between runs
+    dg.set_layout(options.graph_layout);
+
+    first_iteration = min(iteration, options.iterations + options.burnin);
+    last_se_check = se_check;
+    m_ordering = ordering;
+
+    printf("resuming pedigree %s run %d from iteration %d (%s)\n", ped->get_id().c_str(), seq_num, first_iteration, c.get_filename().c_str());
+
+    return true;
+}
+
+// the standard errors are only checked every TARGET_SE_PERIOD samples and
+// the lod scores must not be updated while this is running
+bool MarkovChain::target_se_reached() {
+    if((options.target_se <= 0.0) or (lod->get_count() < (last_se_check + TARGET_SE_PERIOD))) {
+        return false;
+    }
+
+    last_se_check = lod->get_count();
+
+    double se = lod->get_max_se(options.target_peaks);
+
+    if(se < options.target_se) {
+        fprintf(stderr, "\ntarget standard error reached after %d samples (se = %.4f)\n", lod->get_count(), se);
+        return true;
+    }
+
+    return false;
+}
+
 // old version
 LODscores* MarkovChain::run(DescentGraph& dg) {
+    RandomInt rng;
     int thread_num = 0;
     int num_lgroups = -1;
 
-    Progress p("MCMC: ", options.iterations + options.burnin);
+    Progress p("MCMC: ", options.iterations + options.burnin - first_iteration);
     
     if(dg.get_likelihood() == LOG_ILLEGAL) {
         fprintf(stderr, "error: descent graph illegal pre-markov chain...\n");
         abort();
     }
 
-//    fprintf(stderr, "\n");
-    num_lgroups = optimal_num_lgroups(dg);
-//    fprintf(stderr, "\noptimal number of lgroups = %d\n", num_lgroups);
-//    exit(1);
+    if(options.checkpoint_period > 0) {
+        writer = new CheckpointWriter();
+        next_checkpoint = first_iteration + options.checkpoint_period;
+    }
 
-    vector<int> lgroups; //(num_lgroups, 0);
-    for(int i = 0; i < num_lgroups; ++i) {
-        lgroups.push_back(i);
+    if(options.use_pool and not options.use_gpu) {
+        run_worker_pool(dg, p);
+        final_checkpoint(dg);
+        return lod;
     }
 
-    for(int i = 0; i < (options.iterations + options.burnin); ++i) {
-        if(get_random() < options.lsampler_prob) {
+    // the tuning only depends on the pedigree, map and machine, so it is
+    // cached rather than repeated at the start of every chain
+    TuningCache cache(options.tuning_cache, ped, map.num_markers(), lsamplers.size());
+    bool online_tuning = false;
+    int tuning_steps = 0;
+    vector<int> candidates;
+    vector<double> timings;
+
+    if(get_max_threads() > 1) {
+        if(options.online_tuning) {
+            online_tuning = true;
+
+            candidates.push_back(-1);
+            for(int i = 3; i < 11; ++i) {
+                candidates.push_back(i);
+            }
+
+            timings.assign(candidates.size(), 0.0);
+        }
+        else if(not cache.lookup(num_lgroups)) {
+//          fprintf(stderr, "\n");
+            num_lgroups = optimal_num_lgroups(dg);
+//          fprintf(stderr, "\noptimal number of lgroups = %d\n", num_lgroups);
+            cache.store(num_lgroups);
+        }
+    }
+
+    vector<int> lgroups = make_lgroups(num_lgroups);
+
+    for(int i = first_iteration; i < (options.iterations + options.burnin); ++i) {
+
+        checkpoint(dg, i, NULL);
+
+        // use whatever we have got so far if burnin ends before every
+        // candidate has been timed the full number of times
+        if(online_tuning and ((i >= options.burnin) or (tuning_steps == int(candidates.size()) * ONLINE_TUNING_SWEEPS))) {
+            num_lgroups = best_num_lgroups(candidates, timings, tuning_steps);
+            lgroups = make_lgroups(num_lgroups);
+            online_tuning = false;
+
+            if(tuning_steps != 0) {
+                cache.store(num_lgroups);
+            }
+        }
 
-            if(num_lgroups == -1) {
-                run_old_lsampler(dg);
+        double move = get_random();
+        
+        if(move < options.lsampler_prob) {
+            
+            if(online_tuning) {
+                int candidate = candidates[tuning_steps % candidates.size()];
+                vector<int> tmp = make_lgroups(candidate);
+                double start_time = get_wtime();
+                
+                run_lsampler(dg, tmp, candidate);
+                
+                timings[tuning_steps % candidates.size()] += (get_wtime() - start_time);
+                ++tuning_steps;
             }
             else {
-                run_scalable_lsampler(dg, lgroups, num_lgroups);
+                run_lsampler(dg, lgroups, num_lgroups);
             }
         }
+        else if((move < (options.lsampler_prob + options.block_prob)) and (b_ordering.size() != 0)) {
+            run_block_sampler(dg);
+        }
         else {
-            random_shuffle(m_ordering.begin(), m_ordering.end());
+            random_shuffle(m_ordering.begin(), m_ordering.end(), rng);
             
             msampler.reset(dg, m_ordering[0]);
             for(unsigned int j = 0; j < m_ordering.size(); ++j) {
@@ -387,6 +938,9 @@ LODscores* MarkovChain::run(DescentGraph& dg) {
                 gpulod->calculate(dg);
             }
 #endif
+
+            if(target_se_reached())
+                break;
         }
         
     }
@@ -399,19 +953,8 @@ LODscores* MarkovChain::run(DescentGraph& dg) {
         gpulod->get_results(lod);
     }
 #endif
+
+    final_checkpoint(dg);
     
     return lod;
 }
-
-bool MarkovChain::noninterferring(vector<int>& x, int val, int thread_num) {
-    for(int i = 0; i < int(x.size()); ++i) {
-        if((i != thread_num) and (x[i] != -1)) {
-            int diff = val - x[i];
-            if((diff == 1) or (diff == -1)) {
-                return false;
-            }
-        }
-    }
-    return true;
-}
-
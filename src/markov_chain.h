@@ -9,12 +9,17 @@ using namespace std;
 #include "genetic_map.h"
 #include "meiosis_sampler.h"
 #include "locus_sampler2.h"
+#include "locus_scheduler.h"
 #include "peeler.h"
 
 class Pedigree;
 class PeelSequenceGenerator;
 class DescentGraph;
 class LODscores;
+class Progress;
+class SnapshotBuffer;
+class Checkpoint;
+class CheckpointWriter;
 #ifdef USE_CUDA
 class GPULodscores;
 #endif
@@ -33,19 +38,46 @@ class MarkovChain {
     vector<Peeler*> peelers;
     vector<LocusSampler*> lsamplers;
     MeiosisSampler msampler;
+    LocusScheduler lscheduler;
     vector<int> l_ordering;
     vector<int> m_ordering;
+    vector<int> b_ordering;     // meiosis blocks, see run_block_sampler()
 
     FILE* coda_filehandle;
     int seq_num;
 
     double temperature;
 
+    unsigned int last_se_check; // number of samples at the last target_se_reached()
+    int stop_sampling;          // set by the scoring threads, see score_worker_pool
+
+    int first_iteration;        // non-zero when resuming from a checkpoint
+    int next_checkpoint;
+    CheckpointWriter* writer;
+
     void _init();
     void _kill();
     void run_scalable_lsampler(DescentGraph& dg, vector<int>& lgroups, int num_lgroups);
     void run_old_lsampler(DescentGraph& dg);
+    void shuffle_blocks();
+    void run_block_sampler(DescentGraph& dg);
     int optimal_num_lgroups(DescentGraph& dg);
+    vector<int> make_lgroups(int num_lgroups);
+    void run_lsampler(DescentGraph& dg, vector<int>& lgroups, int num_lgroups);
+    int best_num_lgroups(vector<int>& candidates, vector<double>& timings, int steps);
+    void sample_worker_pool(DescentGraph& dg, Progress& p, SnapshotBuffer* snapshots, int num_threads);
+    void score_worker_pool(SnapshotBuffer& snapshots, int num_threads);
+    void run_worker_pool(DescentGraph& dg, Progress& p);
+    bool target_se_reached();
+    string checkpoint_filename();
+    void save_checkpoint(Checkpoint& c, DescentGraph& dg, int iteration);
+    void checkpoint(DescentGraph& dg, int iteration, SnapshotBuffer* snapshots);
+    void final_checkpoint(DescentGraph& dg);
+
+    // not copyable, msampler points at this chain's map and the peelers,
+    // samplers and checkpoint writer are deleted by _kill()
+    MarkovChain(const MarkovChain& rhs);
+    MarkovChain& operator=(const MarkovChain& rhs);
 
  public :
     MarkovChain(Pedigree* ped, GeneticMap* map, PeelSequenceGenerator* psg, struct mcmc_options options, int sequence_num, double temp=1.0) :
@@ -59,12 +91,19 @@ class MarkovChain {
 #endif
         peelers(),
         lsamplers(),
-        msampler(ped, map, options.sex_linked),
+        msampler(ped, &(this->map), options.sex_linked),  // the heated copy, not the argument
+        lscheduler(map->num_markers()),
         l_ordering(),
         m_ordering(),
+        b_ordering(),
         coda_filehandle(NULL),
         seq_num(sequence_num),
-        temperature(temp) {
+        temperature(temp),
+        last_se_check(0),
+        stop_sampling(0),
+        first_iteration(0),
+        next_checkpoint(0),
+        writer(NULL) {
     
         _init();
     }
@@ -73,45 +112,12 @@ class MarkovChain {
         _kill();
     }
     
-    MarkovChain(const MarkovChain& rhs) :
-        ped(rhs.ped), 
-        map(rhs.map),
-        psg(rhs.psg), 
-        options(rhs.options),
-        lod(rhs.lod),
-#ifdef USE_CUDA
-        gpulod(rhs.gpulod),
-#endif
-        peelers(rhs.peelers),
-        lsamplers(rhs.lsamplers),
-        msampler(rhs.msampler), 
-        l_ordering(rhs.l_ordering),
-        m_ordering(rhs.m_ordering),
-        coda_filehandle(rhs.coda_filehandle),
-        seq_num(rhs.seq_num),
-        temperature(rhs.temperature) {}
-    
-    MarkovChain& operator=(const MarkovChain& rhs) {
-        if(this != &rhs) {
-            ped = rhs.ped;
-            map = rhs.map;
-            psg = rhs.psg;
-            options = rhs.options;
-            lod = rhs.lod;
-#ifdef USE_CUDA
-            gpulod = rhs.gpulod;
-#endif
-            peelers = rhs.peelers;
-            lsamplers = rhs.lsamplers;
-            msampler = rhs.msampler;
-            l_ordering = rhs.l_ordering;
-            m_ordering = rhs.m_ordering;
-            temperature = rhs.temperature;
-        }
-        return *this;
-    }
- 
     void step(DescentGraph& dg, int start_iteration, int step_size);
+    void set_temperature(GeneticMap* cold_map, double temp);
+    double get_temperature() const {
+        return temperature;
+    }
+    bool resume(DescentGraph& dg);
     LODscores* get_result() {
         if(temperature != 1.0) {
             fprintf(stderr, "error: only the coldest chain can be used!\n");
@@ -124,7 +130,6 @@ class MarkovChain {
     }
 
     LODscores* run(DescentGraph& dg);
-    bool noninterferring(vector<int>& x, int val, int thread_num);
 };
 
 #endif
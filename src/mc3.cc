@@ -1,8 +1,10 @@
+#include <cmath>
 #include <vector>
 #include <algorithm>
 
 #include <fstream>
 #include <iomanip>
+#include <limits>
 
 #include "descent_graph.h"
 #include "peel_sequence_generator.h"
@@ -13,12 +15,42 @@
 #include "progress.h"
 #include "sequential_imputation.h"
 #include "omp_facade.h"
+#include "random.h"
+#include "convergence.h"
+#include "logarithms.h"
 
 using namespace std;
 
 
+// temperature ladder adaptation, the step size for the n-th update of a gap
+// is 1 / n^MC3_ADAPTATION_DECAY so the adaptation dies away and the ladder
+// settles down. the gaps are limited so neighbouring temperatures cannot
+// become identical and no chain is more than e^10 times hotter than the last
+const double MC3_ADAPTATION_DECAY = 0.6;
+const double MC3_MIN_LOG_GAP = -15.0;
+const double MC3_MAX_LOG_GAP = log(10.0);
+
+
+// if this is the only thing running then the cores are divided between the
+// chains, otherwise we are already one of several teams and the chains take
+// turns on the threads of this team
+void Mc3::_init_teams() {
+    int num_chains = options.mc3_number_of_chains;
+
+    if((get_level() == 0) and (options.thread_count > 1) and (not options.use_gpu)) {
+        num_teams = min(num_chains, options.thread_count);
+        team_size = options.thread_count / num_teams;
+    }
+    else {
+        num_teams = 1;
+        team_size = get_max_threads();
+    }
+}
+
 void Mc3::_init() {
 
+    _init_teams();
+
     lod = new LODscores(map);
 
     for(int i = 0; i < get_max_threads(); ++i) {
@@ -64,11 +96,34 @@ void Mc3::_init() {
         }
         */
 
-        fprintf(stderr, "Creating Markov chain %d, temperature = %.3f\n", i, temperature);
+        temperatures.push_back(temperature);
+    }
 
-        MarkovChain* tmp = new MarkovChain(ped, map, psg, options, temperature);
+    // the default ladder is only a starting point
+    if(_adaptive()) {
+        for(unsigned i = 1; i < temperatures.size(); ++i) {
+            double tmp = log(-log(temperatures[i] / temperatures[i-1]));
+            log_gaps.push_back(min(max(tmp, MC3_MIN_LOG_GAP), MC3_MAX_LOG_GAP));
+            adaptations.push_back(0);
+        }
+    }
+
+    if(num_teams > 1) {
+        printf("running %d chains concurrently, %d thread%s each\n", num_teams, team_size, team_size == 1 ? "" : "s");
+    }
+
+    // the samplers in each chain are sized for the team it runs on
+    int max_threads = get_max_threads();
+    set_num_threads(team_size);
+
+    for(int i = 0; i < options.mc3_number_of_chains; ++i) {
+        fprintf(stderr, "Creating Markov chain %d, temperature = %.3f\n", i, temperatures[i]);
+
+        MarkovChain* tmp = new MarkovChain(ped, map, psg, options, i, temperatures[i]);
         chains.push_back(tmp);
     }
+
+    set_num_threads(max_threads);
 }
 
 void Mc3::_kill() {
@@ -78,18 +133,11 @@ void Mc3::_kill() {
     for(int i = 0; i < int(chains.size()); ++i) {
         delete chains[i];
     }
-}
 
-LODscores* Mc3::run() {
-
-#define MC3_INFO
-#ifdef MC3_INFO
-    ofstream f;
-    f.open("log");
-    f << "iteration chain likelihood coldlikelihood\n";
-#endif
+    delete lod;
+}
 
-    vector<DescentGraph> graphs;
+void Mc3::_init_graphs(vector<DescentGraph>& graphs) {
     SequentialImputation si(ped, map, psg, options.sex_linked);
 
     for(unsigned i = 0; i < chains.size(); ++i) {
@@ -100,8 +148,261 @@ LODscores* Mc3::run() {
         else 
             tmp.random_descentgraph();
 
+        tmp.set_layout(options.graph_layout);
         graphs.push_back(tmp);
     }
+}
+
+// the chains do not interact while they are being stepped, so each one can
+// run on its own team of threads
+void Mc3::_step_chains(vector<DescentGraph>& graphs, int start_iteration, int step_size) {
+
+    if(num_teams == 1) {
+        for(unsigned j = 0; j < chains.size(); ++j) {
+            chains[j]->step(graphs[j], start_iteration, step_size);
+        }
+        return;
+    }
+
+    int max_levels = get_max_active_levels();
+
+    // chains -> sampling
+    set_max_active_levels(2);
+    set_random_team_size(team_size);
+
+    // static so that each chain is always run by the same team and
+    // uses the same generators, otherwise runs are not reproducible
+    #pragma omp parallel for num_threads(num_teams) schedule(static)
+    for(int j = 0; j < int(chains.size()); ++j) {
+        set_num_threads(team_size);
+        chains[j]->step(graphs[j], start_iteration, step_size);
+    }
+
+    set_random_team_size(0);
+    set_max_active_levels(max_levels);
+}
+
+// metropolis step to exchange the states of chains i and i+1, acceptance
+// is set to the probability that the exchange was accepted
+bool Mc3::_exchange(vector<DescentGraph>& graphs, int i, double& acceptance) {
+    double xx = chains[i]->get_likelihood(graphs[i]); 
+    double yy = chains[i+1]->get_likelihood(graphs[i+1]);
+    double xy = chains[i]->get_likelihood(graphs[i+1]);
+    double yx = chains[i+1]->get_likelihood(graphs[i]);
+    double ratio = (xy + yx) - (xx + yy);
+
+    acceptance = (ratio >= 0.0) ? 1.0 : exp_relative(ratio, 0.0);
+
+    double r = get_random();
+
+    if((r == 0.0) or (log(r) < min(0.0, ratio))) {
+        graphs[i].swap(graphs[i+1]);
+        return true;
+    }
+
+    return false;
+}
+
+// temperatures given on the command line are used as they are
+bool Mc3::_adaptive() {
+    return options.mc3 and (options.mc3_temperatures.size() == 0) and (options.mc3_number_of_chains > 1);
+}
+
+// stochastic approximation (Robbins-Monro), widen the gap between
+// chains i and i+1 if exchanges are accepted more often than the target
+// and narrow it if they are accepted less often
+void Mc3::_adapt_temperature(int i, double acceptance) {
+    double gain = 1.0 / pow(double(++adaptations[i]), MC3_ADAPTATION_DECAY);
+
+    log_gaps[i] += gain * (acceptance - options.mc3_exchange_target);
+    log_gaps[i] = min(max(log_gaps[i], MC3_MIN_LOG_GAP), MC3_MAX_LOG_GAP);
+}
+
+// the coldest chain always stays at 1.0
+void Mc3::_set_temperatures() {
+    for(unsigned i = 1; i < chains.size(); ++i) {
+        temperatures[i] = temperatures[i-1] * exp(-exp(log_gaps[i-1]));
+        chains[i]->set_temperature(map, temperatures[i]);
+    }
+}
+
+// interval with the highest lod score over all chains
+unsigned int Mc3::_peak_index() {
+    unsigned int num_scores = chains[0]->get_result()->num_lodscores();
+    unsigned int best = 0;
+    double best_score = LOG_ZERO;
+
+    for(unsigned int i = 0; i < num_scores; ++i) {
+        double tmp = chains[0]->get_result()->get_raw(i);
+
+        for(unsigned int j = 1; j < chains.size(); ++j) {
+            tmp = log_sum(tmp, chains[j]->get_result()->get_raw(i));
+        }
+
+        if(tmp > best_score) {
+            best = i;
+            best_score = tmp;
+        }
+    }
+
+    return best;
+}
+
+// independent chains that are stepped together one scoring period at a time,
+// burnin ends as soon as R-hat for the log likelihood is below the threshold
+// and sampling stops once R-hat for both the log likelihood and the peak lod
+// score are below the threshold and both have a large enough effective sample
+// size. -b and -i are upper limits
+//
+// the diagnostics are only recalculated every DIAGNOSTIC_PERIOD scoring
+// periods, the only per step cost is one likelihood calculation per chain
+LODscores* Mc3::run_until_converged() {
+    vector<DescentGraph> graphs;
+    int period = options.scoring_period;
+    int burnin_limit = ((options.burnin + period - 1) / period) * period;
+    int iteration = 0;      // what the chains think the iteration number is
+    int samples = 0;        // iterations since the end of burnin
+    int peak = -1;
+    bool burnin = (options.burnin > 0);
+    double rhat_likelihood = numeric_limits<double>::infinity();
+    double rhat_peak = numeric_limits<double>::infinity();
+    double ess_likelihood = 0.0;
+    double ess_peak = 0.0;
+
+    ConvergenceDiagnostics likelihoods(chains.size());
+    ConvergenceDiagnostics peak_lods(chains.size());
+
+    _init_graphs(graphs);
+
+    Progress p("MCMC: ", (options.burnin + options.iterations) / period);
+
+    double sampling_start = get_wtime();
+
+    for(int spurt = 1; samples < options.iterations; ++spurt) {
+
+        _step_chains(graphs, iteration, period);
+
+        for(unsigned j = 0; j < chains.size(); ++j) {
+            likelihoods.add(j, chains[j]->get_likelihood(graphs[j]));
+        }
+
+        iteration += period;
+
+        if(not burnin) {
+            samples += period;
+
+            if(peak != -1) {
+                for(unsigned j = 0; j < chains.size(); ++j) {
+                    peak_lods.add(j, chains[j]->get_result()->get_last(peak));
+                }
+            }
+        }
+
+        p.increment();
+
+        if((spurt % DIAGNOSTIC_PERIOD) != 0) {
+            if(burnin and (iteration >= burnin_limit)) {
+                burnin = false;
+                likelihoods.clear();
+                sampling_start = get_wtime();
+            }
+            continue;
+        }
+
+        if(burnin) {
+            // ignore the first half, as in Gelman & Rubin
+            rhat_likelihood = likelihoods.rhat(likelihoods.size() / 2);
+
+            if((rhat_likelihood < options.rhat_threshold) or (iteration >= burnin_limit)) {
+                burnin = false;
+                iteration = max(iteration, burnin_limit);
+                likelihoods.clear();
+                sampling_start = get_wtime();
+
+                fprintf(stderr, "\nburnin ended after %d iterations (R-hat = %.3f)\n", spurt * period, rhat_likelihood);
+            }
+
+            continue;
+        }
+
+        // lod scores are only comparable at the same position, start
+        // again whenever the peak moves
+        int current_peak = _peak_index();
+        if(current_peak != peak) {
+            peak = current_peak;
+            peak_lods.clear();
+            continue;
+        }
+
+        ConvergenceDiagnostics scaled_lods = peak_lods.exp_scaled();
+
+        rhat_likelihood = likelihoods.rhat();
+        ess_likelihood = likelihoods.ess();
+        rhat_peak = scaled_lods.rhat();
+        ess_peak = scaled_lods.ess();
+
+        if((rhat_likelihood < options.rhat_threshold) and \
+           (rhat_peak < options.rhat_threshold) and \
+           (ess_likelihood >= options.min_ess) and \
+           (ess_peak >= options.min_ess)) {
+            break;
+        }
+    }
+
+    p.finish();
+
+    // -i can stop the loop between diagnostics, so whatever was last
+    // calculated may be out of date (or still from burnin)
+    rhat_likelihood = likelihoods.rhat();
+    ess_likelihood = likelihoods.ess();
+
+    if(peak_lods.size() != 0) {
+        ConvergenceDiagnostics scaled_lods = peak_lods.exp_scaled();
+
+        rhat_peak = scaled_lods.rhat();
+        ess_peak = scaled_lods.ess();
+    }
+
+    // per second of sampling (after burnin), for comparing samplers
+    double sampling_time = max(get_wtime() - sampling_start, 1e-9);
+
+    fprintf(stderr, "sampling stopped after %d iterations (%.1fs)\n"
+                    "\tlikelihood: R-hat = %.3f, ESS = %.1f (%.2f/s)\n",
+                    samples, sampling_time,
+                    rhat_likelihood, ess_likelihood, ess_likelihood / sampling_time);
+
+    if(peak_lods.size() != 0) {
+        fprintf(stderr, "\tpeak lod:   R-hat = %.3f, ESS = %.1f (%.2f/s)\n",
+                        rhat_peak, ess_peak, ess_peak / sampling_time);
+    }
+    else {
+        fprintf(stderr, "\tpeak lod:   not assessed, no samples since the peak was found\n");
+    }
+
+    LODscores* tmp = chains[0]->get_result();
+    for(unsigned i = 1; i < chains.size(); ++i) {
+        tmp->merge_results(chains[i]->get_result());
+    }
+
+    return tmp;
+}
+
+LODscores* Mc3::run() {
+
+    if(options.autostop and not options.mc3) {
+        return run_until_converged();
+    }
+
+//#define MC3_INFO
+#ifdef MC3_INFO
+    ofstream f;
+    f.open("log");
+    f << "iteration chain likelihood coldlikelihood\n";
+#endif
+
+    vector<DescentGraph> graphs;
+
+    _init_graphs(graphs);
 
 
     vector<int> swap_success(chains.size(), 0);
@@ -112,17 +413,19 @@ LODscores* Mc3::run() {
         options.mc3_exchange_period = 10;
     }
 
-    int spurts = (options.burnin + options.iterations) / options.mc3_exchange_period;
+    int period = options.mc3_exchange_period;
+    int spurts = (options.burnin + options.iterations) / period;
+    bool adapting = _adaptive();
 
     Progress p((not options.mc3) or (chains.size() == 1) ? "MCMC: " : "MC3: ", spurts);
 
     for(int i = 0; i < spurts; ++i) {
         // advance all chains
-        for(unsigned j = 0; j < chains.size(); ++j) {
-            chains[j]->step(graphs[j], i * spurts, options.mc3_exchange_period);
+        _step_chains(graphs, i * period, period);
 
 #ifdef MC3_INFO
-            f << (i * options.mc3_exchange_period) \
+        for(unsigned j = 0; j < chains.size(); ++j) {
+            f << (i * period) \
               << " " \
               << j \
               << " " \
@@ -130,31 +433,51 @@ LODscores* Mc3::run() {
               << " " \
               << chains[0]->get_likelihood(graphs[j]) \
               << "\n";
-#endif
         }
+#endif
 
         p.increment();
 
-        if(options.mc3) {
-            // metropolis step
-            int rand = (chains.size() - 1) * get_random();
+        if(not options.mc3) {
+            continue;
+        }
 
-            double xx = chains[rand]->get_likelihood(graphs[rand]); 
-            double yy = chains[rand+1]->get_likelihood(graphs[rand+1]);
-            double xy = chains[rand]->get_likelihood(graphs[rand+1]);
-            double yx = chains[rand+1]->get_likelihood(graphs[rand]);
-            double ratio = (xy + yx) - (xx + yy);
-        
-            double r = get_random();
+        // the ladder is fixed once burnin is over, exchange rates are
+        // only reported for the final ladder
+        if(adapting and (((i + 1) * period) > options.burnin)) {
+            adapting = false;
+
+            fill(swap_success.begin(), swap_success.end(), 0);
+            fill(swap_failure.begin(), swap_failure.end(), 0);
+
+            fprintf(stderr, "\ntemperatures after burnin:");
+            for(unsigned j = 0; j < temperatures.size(); ++j) {
+                fprintf(stderr, " %.4f", temperatures[j]);
+            }
+            fprintf(stderr, "\n");
+        }
+
+        // even/odd scheme, every other spurt attempts (0,1), (2,3), ... and 
+        // the rest (1,2), (3,4), ... none of the pairs overlap so the 
+        // exchanges are independent of one another
+        for(int j = (i % 2); (j + 1) < int(chains.size()); j += 2) {
+            double acceptance;
 
-            if((r == 0.0) or (log(r) < min(0.0, ratio))) {
-                swap(graphs[rand], graphs[rand+1]);
-                swap_success[rand] += 1;
+            if(_exchange(graphs, j, acceptance)) {
+                swap_success[j] += 1;
             }
             else {
-                swap_failure[rand] += 1;
+                swap_failure[j] += 1;
+            }
+
+            if(adapting) {
+                _adapt_temperature(j, acceptance);
             }
         }
+
+        if(adapting) {
+            _set_temperatures();
+        }
     }
 
     p.finish();
@@ -162,12 +485,19 @@ LODscores* Mc3::run() {
     // output a file containing the exchange rates
     // between chains
     if(options.mc3) {
+        vector<double> rates(chains.size(), 0.0);
+
+        for(int i = 0; i < int(chains.size())-1; ++i) {
+            int total = swap_success[i] + swap_failure[i];
+            rates[i] = (total == 0) ? 0.0 : swap_success[i] / static_cast<double>(total);
+        }
+
         if(options.exchange_filename != "") {
             ofstream ef;
             ef.open(options.exchange_filename.c_str());
 
             for(int i = 0; i < int(chains.size())-1; ++i) {
-                ef << i << " " << swap_success[i] / static_cast<double>(swap_success[i] + swap_failure[i]) << "\n";
+                ef << i << " " << temperatures[i] << " " << rates[i] << "\n";
             }
 
             ef.close();
@@ -175,7 +505,7 @@ LODscores* Mc3::run() {
 
         for(int i = 0; i < int(chains.size())-1; ++i) {
             fprintf(stderr, "%d -- %d : %.3f (%d/%d)\n", \
-                i, i+1, swap_success[i] / static_cast<double>(swap_success[i] + swap_failure[i]), \
+                i, i+1, rates[i], \
                 swap_success[i], swap_success[i] + swap_failure[i]);
         }
     }
@@ -198,4 +528,3 @@ LODscores* Mc3::run() {
 
     return chains[0]->get_result();
 }
-
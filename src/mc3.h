@@ -12,6 +12,7 @@ class GeneticMap;
 class PeelSequenceGenerator;
 class MarkovChain;
 class LODscores;
+class DescentGraph;
 
 class Mc3 {
     
@@ -24,8 +25,23 @@ class Mc3 {
     vector<Peeler*> peelers;
     vector<MarkovChain*> chains;
 
+    int num_teams;              // chains are stepped concurrently by teams of threads
+    int team_size;
+    vector<double> temperatures;
+    vector<double> log_gaps;    // log(-log(t[i+1] / t[i])), adapted during burnin
+    vector<int> adaptations;    // number of updates to each gap so far
+
     void _init();
+    void _init_teams();
     void _kill();
+    void _init_graphs(vector<DescentGraph>& graphs);
+    void _step_chains(vector<DescentGraph>& graphs, int start_iteration, int step_size);
+    bool _exchange(vector<DescentGraph>& graphs, int i, double& acceptance);
+    bool _adaptive();
+    void _adapt_temperature(int i, double acceptance);
+    void _set_temperatures();
+    unsigned int _peak_index();
+    LODscores* run_until_converged();
 
   public:
     Mc3(Pedigree* ped, GeneticMap* map, PeelSequenceGenerator* psg, struct mcmc_options opt) :
@@ -35,7 +51,12 @@ class Mc3 {
         psg(psg),
         lod(0),
         peelers(), 
-        chains() {
+        chains(),
+        num_teams(1),
+        team_size(1),
+        temperatures(),
+        log_gaps(),
+        adaptations() {
     
         _init();
     }
@@ -51,7 +72,12 @@ class Mc3 {
         psg(rhs.psg),
         lod(rhs.lod),
         peelers(rhs.peelers),
-        chains(rhs.chains) {}
+        chains(rhs.chains),
+        num_teams(rhs.num_teams),
+        team_size(rhs.team_size),
+        temperatures(rhs.temperatures),
+        log_gaps(rhs.log_gaps),
+        adaptations(rhs.adaptations) {}
 
     Mc3& operator=(const Mc3& rhs) {
         if(this != &rhs) {
@@ -62,6 +88,11 @@ class Mc3 {
             lod = rhs.lod;
             peelers = rhs.peelers;
             chains = rhs.chains;
+            num_teams = rhs.num_teams;
+            team_size = rhs.team_size;
+            temperatures = rhs.temperatures;
+            log_gaps = rhs.log_gaps;
+            adaptations = rhs.adaptations;
         }
         return *this;
     }
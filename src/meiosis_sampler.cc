@@ -1,4 +1,5 @@
 #include <cmath>
+#include <algorithm>
 
 #include "types.h"
 #include "pedigree.h"
@@ -7,6 +8,7 @@
 #include "descent_graph.h"
 #include "meiosis_sampler.h"
 #include "founder_allele_graph4.h"
+#include "founder_allele_graph_block.h"
 #include "random.h"
 
 //#include "founder_allele_graph3.h"
@@ -15,28 +17,81 @@ using namespace std;
 
 
 void MeiosisSampler::reset(DescentGraph& dg, unsigned int parameter) {
-    unsigned person_id = ped->num_founders() + (parameter / 2);
-    enum parentage p = static_cast<enum parentage>(parameter % 2);
     
     #pragma omp parallel for
-    for(int i = 0; i < int(map->num_markers()); ++i) {
-        f4[i].reset(dg);
+    for(int i = 0; i < int(num_blocks()); ++i) {
+        reset_block(dg, parameter, i);
     }
     
+    last_parameter = parameter;
+}
+
+void MeiosisSampler::reset_block(DescentGraph& dg, unsigned int parameter, int block) {
+    int first = block * FOUNDERALLELEGRAPH_BLOCK;
+    int last = min(first + FOUNDERALLELEGRAPH_BLOCK, int(map->num_markers()));
+    
+    update_block(dg, block);
+    
+    for(int i = first; i < last; ++i) {
+        reset_locus(dg, parameter, i);
+    }
+}
+
+void MeiosisSampler::update_graphs(DescentGraph& dg) {
+    
     #pragma omp parallel for
-    for(int i = 0; i < int(map->num_markers()); ++i) {
-        int index = i * 2;
-        int meiosis = dg.get(person_id, i, p);
-        
-        raw_matrix[index + meiosis] = graph_likelihood(dg, person_id, i, p, meiosis);
-        
-        if(raw_matrix[index + meiosis] == 0.0) {
-            fprintf(stderr, "error: illegal descent graph given to m-sampler (%s:%d)\n", __FILE__, __LINE__);
-            abort();
+    for(int i = 0; i < int(num_blocks()); ++i) {
+        update_block(dg, i);
+    }
+}
+
+void MeiosisSampler::update_block(DescentGraph& dg, int block) {
+    FounderAlleleGraph4* graphs[FOUNDERALLELEGRAPH_BLOCK];
+    double probs[FOUNDERALLELEGRAPH_BLOCK];
+    int first = block * FOUNDERALLELEGRAPH_BLOCK;
+    int last = min(first + FOUNDERALLELEGRAPH_BLOCK, int(map->num_markers()));
+    int count = 0;
+    
+    // the founder allele graphs are kept up to date with the changes made
+    // by step_sample(), so only loci something else has changed since (e.g.
+    // the locus sampler) need to be rebuilt
+    for(int i = first; i < last; ++i) {
+        if((graph_id[i] != dg.get_id()) or (graph_changes[i] != dg.get_changes(i))) {
+            graphs[count++] = &f4[i];
+            graph_id[i] = dg.get_id();
+            graph_changes[i] = dg.get_changes(i);
         }
     }
     
-    last_parameter = parameter;
+    if(count != 0) {
+        blocks[block].evaluate(dg, graphs, count, probs);
+    }
+}
+
+void MeiosisSampler::reset_locus(DescentGraph& dg, unsigned int parameter, int locus) {
+    unsigned person_id = ped->num_founders() + (parameter / 2);
+    enum parentage p = static_cast<enum parentage>(parameter % 2);
+    int index = locus * 2;
+    
+    int meiosis = dg.get(person_id, locus, p);
+    
+    raw_matrix[index + meiosis] = graph_likelihood(dg, person_id, locus, p, meiosis);
+    
+    if(raw_matrix[index + meiosis] == 0.0) {
+        fprintf(stderr, "error: illegal descent graph given to m-sampler (%s:%d)\n", __FILE__, __LINE__);
+        abort();
+    }
+}
+
+// the founder allele graphs point at seq, which a copy has its own of
+void MeiosisSampler::set_sequences() {
+    for(unsigned int i = 0; i < f4.size(); ++i) {
+        f4[i].set_sequence(&seq);
+    }
+    
+    for(unsigned int i = 0; i < blocks.size(); ++i) {
+        blocks[i].set_sequence(&seq);
+    }
 }
 
 void MeiosisSampler::find_founderallelegraph_ordering() {
@@ -72,6 +127,89 @@ void MeiosisSampler::find_founderallelegraph_ordering() {
     }
 }
 
+// meioses that are coupled through the pedigree, every meiosis into the 
+// children of one couple (a sibship) and every meiosis out of one person 
+// (e.g. a founder) with more than one child
+//
+// flipping one of these never changes which founder allele another of 
+// them carries, see FounderAlleleGraph4::flip_combinations()
+void MeiosisSampler::find_meiosis_blocks() {
+    vector<int> meioses;
+    
+    for(unsigned i = ped->num_founders(); i < ped->num_members(); ++i) {
+        Person* p = ped->get_by_index(i);
+        Person* mother = ped->get_by_index(p->get_maternalid());
+        bool first = true;
+        
+        // each sibship is only added once, from its first child
+        for(unsigned j = 0; j < mother->num_children(); ++j) {
+            Person* sib = mother->get_child(j);
+            
+            if((sib->get_paternalid() == p->get_paternalid()) and (sib->get_internalid() < i)) {
+                first = false;
+                break;
+            }
+        }
+        
+        if(not first) {
+            continue;
+        }
+        
+        meioses.clear();
+        
+        for(unsigned j = 0; j < mother->num_children(); ++j) {
+            Person* sib = mother->get_child(j);
+            
+            if(sib->get_paternalid() != p->get_paternalid()) {
+                continue;
+            }
+            
+            for(int k = 0; k < 2; ++k) {
+                enum parentage allele = static_cast<enum parentage>(k);
+                
+                if(not sib->safe_to_ignore_meiosis(allele)) {
+                    meioses.push_back(((sib->get_internalid() - ped->num_founders()) * 2) + k);
+                }
+            }
+        }
+        
+        add_meiosis_block(meioses);
+    }
+    
+    for(unsigned i = 0; i < ped->num_members(); ++i) {
+        Person* p = ped->get_by_index(i);
+        enum parentage allele = p->isfemale() ? MATERNAL : PATERNAL;
+        
+        meioses.clear();
+        
+        for(unsigned j = 0; j < p->num_children(); ++j) {
+            Person* child = p->get_child(j);
+            
+            if(not child->safe_to_ignore_meiosis(allele)) {
+                meioses.push_back(((child->get_internalid() - ped->num_founders()) * 2) + allele);
+            }
+        }
+        
+        add_meiosis_block(meioses);
+    }
+}
+
+// blocks larger than MEIOSIS_BLOCK_MAX are split as evenly as possible, a 
+// block of one meiosis is just what step() does
+void MeiosisSampler::add_meiosis_block(vector<int>& meioses) {
+    int n = meioses.size();
+    int pieces = (n + MEIOSIS_BLOCK_MAX - 1) / MEIOSIS_BLOCK_MAX;
+    
+    for(int i = 0; i < pieces; ++i) {
+        int first = (i * n) / pieces;
+        int last = ((i + 1) * n) / pieces;
+        
+        if((last - first) > 1) {
+            meiosis_blocks.push_back(vector<int>(meioses.begin() + first, meioses.begin() + last));
+        }
+    }
+}
+
 double MeiosisSampler::graph_likelihood(DescentGraph& dg, unsigned person_id, unsigned locus, enum parentage parent, unsigned value) {
     /*
     // don't use 'flip' code...
@@ -87,22 +225,25 @@ double MeiosisSampler::graph_likelihood(DescentGraph& dg, unsigned person_id, un
     
     return lik4;
     */
-    double lik4;
-    unsigned tmp = dg.get(person_id, locus, parent);
-    bool flip = tmp != value;
-    
-    if(flip)
-        f4[locus].flip(dg, person_id, parent);
+    // the founder allele graph works out the likelihood of a flip from 
+    // the components it touches, so nothing needs flipping back
+    if(unsigned(dg.get(person_id, locus, parent)) != value)
+        return f4[locus].flip_likelihood(dg, person_id, parent);
     
-    lik4 = f4[locus].likelihood();
+    return f4[locus].likelihood();
+}
+
+void MeiosisSampler::step(DescentGraph& dg, unsigned int parameter) {
     
-    if(flip)
-        f4[locus].flip(dg, person_id, parent);
+    #pragma omp parallel for
+    for(int i = 0; i < int(map->num_markers()); ++i) {
+        step_locus(dg, parameter, i);
+    }
     
-    return lik4;
+    step_sample(dg, parameter);
 }
 
-void MeiosisSampler::step(DescentGraph& dg, unsigned int parameter) {
+void MeiosisSampler::step_locus(DescentGraph& dg, unsigned int parameter, int locus) {
     // parameter is the founder allele
     unsigned person_id = ped->num_founders() + (parameter / 2);
     enum parentage p = static_cast<enum parentage>(parameter % 2);
@@ -110,28 +251,28 @@ void MeiosisSampler::step(DescentGraph& dg, unsigned int parameter) {
     unsigned last_id = ped->num_founders() + (last_parameter / 2);
     enum parentage last_p = static_cast<enum parentage>(last_parameter % 2);
     
-    int num_markers = static_cast<int>(map->num_markers());
+    int index = locus * 2;
     
+    //matrix[index + 0] = graph_likelihood(dg, person_id, locus, p, 0);
+    //matrix[index + 1] = graph_likelihood(dg, person_id, locus, p, 1);
     
-    #pragma omp parallel for
-    for(int i = 0; i < num_markers; ++i) {
-        int index = i * 2;
-        
-        //matrix[index + 0] = graph_likelihood(dg, person_id, i, p, 0);
-        //matrix[index + 1] = graph_likelihood(dg, person_id, i, p, 1);
-        
-        int tmp = dg.get(person_id, i, p);
-        int tmp2 = dg.get(last_id, i, last_p);
-        
-        raw_matrix[index + tmp] = raw_matrix[index + tmp2];
-        raw_matrix[index + (1-tmp)] = graph_likelihood(dg, person_id, i, p, 1-tmp);
-        
-        if((raw_matrix[index] == 0.0) and (raw_matrix[index+1] == 0.0)) {
-            fprintf(stderr, "error: illegal descent graph given to m-sampler (%s:%d)\n", __FILE__, __LINE__);
-            abort();
-        }
+    int tmp = dg.get(person_id, locus, p);
+    int tmp2 = dg.get(last_id, locus, last_p);
+    
+    raw_matrix[index + tmp] = raw_matrix[index + tmp2];
+    raw_matrix[index + (1-tmp)] = graph_likelihood(dg, person_id, locus, p, 1-tmp);
+    
+    if((raw_matrix[index] == 0.0) and (raw_matrix[index+1] == 0.0)) {
+        fprintf(stderr, "error: illegal descent graph given to m-sampler (%s:%d)\n", __FILE__, __LINE__);
+        abort();
     }
+}
+
+void MeiosisSampler::step_sample(DescentGraph& dg, unsigned int parameter) {
+    unsigned person_id = ped->num_founders() + (parameter / 2);
+    enum parentage p = static_cast<enum parentage>(parameter % 2);
     
+    int num_markers = static_cast<int>(map->num_markers());
     
     double total = raw_matrix[0] + raw_matrix[1];
     
@@ -165,6 +306,7 @@ void MeiosisSampler::step(DescentGraph& dg, unsigned int parameter) {
     if(tmp_orig != tmp_samp) {
         f4[i].flip(dg, person_id, p);
         dg.set(person_id, i, p, tmp_samp);
+        graph_changes[i] = dg.get_changes(i);
     }
     
     while(--i >= 0) {
@@ -183,6 +325,7 @@ void MeiosisSampler::step(DescentGraph& dg, unsigned int parameter) {
         if(tmp_orig != tmp_samp) {
             f4[i].flip(dg, person_id, p);
             dg.set(person_id, i, p, tmp_samp);
+            graph_changes[i] = dg.get_changes(i);
         }
     }
     
@@ -190,6 +333,167 @@ void MeiosisSampler::step(DescentGraph& dg, unsigned int parameter) {
     last_parameter = parameter;
 }
 
+void MeiosisSampler::step_meiosis_block(DescentGraph& dg, unsigned int block) {
+    
+    #pragma omp parallel for
+    for(int i = 0; i < int(map->num_markers()); ++i) {
+        step_meiosis_block_locus(dg, block, i);
+    }
+    
+    step_meiosis_block_sample(dg, block);
+}
+
+// the likelihood of every joint state of the meioses in the block, state 
+// bit i is the value of meiosis i
+void MeiosisSampler::step_meiosis_block_locus(DescentGraph& dg, unsigned int block, int locus) {
+    vector<int>& meioses = meiosis_blocks[block];
+    int n = meioses.size();
+    unsigned int people[MEIOSIS_BLOCK_MAX];
+    enum parentage alleles[MEIOSIS_BLOCK_MAX];
+    double probs[MEIOSIS_BLOCK_STATES];
+    double* row = &block_matrix[locus * MEIOSIS_BLOCK_STATES];
+    int current = 0;
+    
+    for(int i = 0; i < n; ++i) {
+        people[i] = ped->num_founders() + (meioses[i] / 2);
+        alleles[i] = static_cast<enum parentage>(meioses[i] % 2);
+        current |= (dg.get(people[i], locus, alleles[i]) << i);
+    }
+    
+    // probs are relative to the current state
+    f4[locus].flip_combinations(dg, n, people, alleles, probs);
+    
+    if(probs[0] == 0.0) {
+        fprintf(stderr, "error: illegal descent graph given to m-sampler (%s:%d)\n", __FILE__, __LINE__);
+        abort();
+    }
+    
+    for(int i = 0; i < (1 << n); ++i) {
+        row[i ^ current] = probs[i];
+    }
+}
+
+// recombination is independent in each meiosis, so the transition between 
+// loci is applied one meiosis at a time
+void MeiosisSampler::step_meiosis_block_sample(DescentGraph& dg, unsigned int block) {
+    vector<int>& meioses = meiosis_blocks[block];
+    int n = meioses.size();
+    int states = 1 << n;
+    int num_markers = static_cast<int>(map->num_markers());
+    unsigned int people[MEIOSIS_BLOCK_MAX];
+    enum parentage alleles[MEIOSIS_BLOCK_MAX];
+    double prev[MEIOSIS_BLOCK_STATES];
+    
+    for(int i = 0; i < n; ++i) {
+        people[i] = ped->num_founders() + (meioses[i] / 2);
+        alleles[i] = static_cast<enum parentage>(meioses[i] % 2);
+    }
+    
+    // forwards
+    for(int i = 0; i < num_markers; ++i) {
+        double* row = &block_matrix[i * MEIOSIS_BLOCK_STATES];
+        double total = 0.0;
+        
+        if(i != 0) {
+            double theta = map->get_theta(i-1);
+            double inversetheta = map->get_inversetheta(i-1);
+            
+            copy(row - MEIOSIS_BLOCK_STATES, row - MEIOSIS_BLOCK_STATES + states, prev);
+            
+            for(int j = 0; j < n; ++j) {
+                int bit = 1 << j;
+                
+                for(int k = 0; k < states; ++k) {
+                    if(k & bit) {
+                        continue;
+                    }
+                    
+                    double same = prev[k];
+                    double other = prev[k | bit];
+                    
+                    prev[k]       = (same * inversetheta) + (other * theta);
+                    prev[k | bit] = (other * inversetheta) + (same * theta);
+                }
+            }
+            
+            for(int k = 0; k < states; ++k) {
+                row[k] *= prev[k];
+            }
+        }
+        
+        for(int k = 0; k < states; ++k) {
+            total += row[k];
+        }
+        
+        for(int k = 0; k < states; ++k) {
+            row[k] /= total;
+        }
+    }
+    
+    // sample backwards
+    // change descent graph in place
+    int next = 0;
+    
+    for(int i = num_markers - 1; i >= 0; --i) {
+        double* row = &block_matrix[i * MEIOSIS_BLOCK_STATES];
+        int current = 0;
+        
+        if(i != (num_markers - 1)) {
+            for(int k = 0; k < states; ++k) {
+                for(int j = 0; j < n; ++j) {
+                    row[k] *= (((k ^ next) >> j) & 1) ? map->get_theta(i) : map->get_inversetheta(i);
+                }
+            }
+        }
+        
+        next = sample_block_state(row, states);
+        
+        for(int j = 0; j < n; ++j) {
+            current |= (dg.get(people[j], i, alleles[j]) << j);
+        }
+        
+        if(next == current) {
+            continue;
+        }
+        
+        for(int j = 0; j < n; ++j) {
+            if(((next ^ current) >> j) & 1) {
+                f4[i].flip(dg, people[j], alleles[j]);
+                dg.set(people[j], i, alleles[j], (next >> j) & 1);
+            }
+        }
+        
+        graph_changes[i] = dg.get_changes(i);
+    }
+}
+
+unsigned MeiosisSampler::sample_block_state(double* probs, int states) {
+    double total = 0.0;
+    int last = 0;
+    
+    for(int i = 0; i < states; ++i) {
+        total += probs[i];
+    }
+    
+    double r = get_random() * total;
+    
+    for(int i = 0; i < states; ++i) {
+        if(probs[i] == 0.0) {
+            continue;
+        }
+        
+        if(r < probs[i]) {
+            return i;
+        }
+        
+        r -= probs[i];
+        last = i;
+    }
+    
+    // rounding
+    return last;
+}
+
 unsigned MeiosisSampler::sample(int locus) {
     int index = locus * 2;
     
@@ -10,25 +10,47 @@ using namespace std;
 #include "sampler.h"
 #include "logarithms.h"
 #include "founder_allele_graph4.h"
+#include "founder_allele_graph_block.h"
 
 
 class Pedigree;
 class GeneticMap;
 
+// the most meioses resampled together by step_meiosis_block(), each block 
+// has up to 2^MEIOSIS_BLOCK_MAX joint states per locus
+const int MEIOSIS_BLOCK_MAX = 4;
+const int MEIOSIS_BLOCK_STATES = 1 << MEIOSIS_BLOCK_MAX;
+
 
 class MeiosisSampler : Sampler {
     
     vector<FounderAlleleGraph4> f4;
+    vector<FounderAlleleGraphBlock> blocks;     // FOUNDERALLELEGRAPH_BLOCK loci each
     vector<double> raw_matrix;
     vector<double> fb_matrix;
     vector<int> seq;
     unsigned int last_parameter;
     
+    // the descent graph each founder allele graph was built from, see
+    // update_block()
+    vector<unsigned long> graph_id;
+    vector<unsigned int> graph_changes;
+    
+    // sets of meioses (as parameters to step()) that are strongly coupled, 
+    // see find_meiosis_blocks()
+    vector<vector<int> > meiosis_blocks;
+    vector<double> block_matrix;    // MEIOSIS_BLOCK_STATES per locus
+    
     
     double graph_likelihood(DescentGraph& dg, unsigned person_id, unsigned locus, enum parentage parent, unsigned value);
     double initial_likelihood(DescentGraph& dg, unsigned locus);
     void incremental_likelihood(DescentGraph& dg, unsigned person_id, unsigned locus, enum parentage parent, double* meiosis0, double* meiosis1);
     void find_founderallelegraph_ordering();
+    void find_meiosis_blocks();
+    void add_meiosis_block(vector<int>& meioses);
+    unsigned sample_block_state(double* probs, int states);
+    void set_sequences();
+    void reset_locus(DescentGraph& dg, unsigned int parameter, int locus);
     
     unsigned sample(int locus);
     
@@ -36,15 +58,21 @@ class MeiosisSampler : Sampler {
     MeiosisSampler(Pedigree* ped, GeneticMap* map, bool sex_linked) :
         Sampler(ped, map),
         f4(map->num_markers(), FounderAlleleGraph4(ped, map, sex_linked)),
+        blocks((map->num_markers() + FOUNDERALLELEGRAPH_BLOCK - 1) / FOUNDERALLELEGRAPH_BLOCK, FounderAlleleGraphBlock(ped)),
         raw_matrix(map->num_markers() * 2),
         fb_matrix(map->num_markers() * 2),
         seq(),
-        last_parameter(0) {
+        last_parameter(0),
+        graph_id(map->num_markers(), 0),
+        graph_changes(map->num_markers(), 0),
+        meiosis_blocks(),
+        block_matrix(map->num_markers() * MEIOSIS_BLOCK_STATES) {
         
         find_founderallelegraph_ordering();
+        find_meiosis_blocks();
+        set_sequences();
         
         for(unsigned int i = 0; i < map->num_markers(); ++i) {
-            f4[i].set_sequence(&seq);
             f4[i].set_locus(i);
         }
     }
@@ -52,10 +80,18 @@ class MeiosisSampler : Sampler {
     MeiosisSampler(const MeiosisSampler& rhs) :
         Sampler(rhs.ped, rhs.map),
         f4(rhs.f4),
+        blocks(rhs.blocks),
         raw_matrix(rhs.raw_matrix),
         fb_matrix(rhs.fb_matrix),
         seq(rhs.seq),
-        last_parameter(rhs.last_parameter) {}
+        last_parameter(rhs.last_parameter),
+        graph_id(rhs.graph_id),
+        graph_changes(rhs.graph_changes),
+        meiosis_blocks(rhs.meiosis_blocks),
+        block_matrix(rhs.block_matrix) {
+        
+        set_sequences();
+    }
     
     virtual ~MeiosisSampler() {}
     
@@ -64,10 +100,17 @@ class MeiosisSampler : Sampler {
         if(this != &rhs) {
             Sampler::operator=(rhs);
             f4 = rhs.f4;
+            blocks = rhs.blocks;
             raw_matrix = rhs.raw_matrix;
             fb_matrix = rhs.fb_matrix;
             seq = rhs.seq;
             last_parameter = rhs.last_parameter;
+            graph_id = rhs.graph_id;
+            graph_changes = rhs.graph_changes;
+            meiosis_blocks = rhs.meiosis_blocks;
+            block_matrix = rhs.block_matrix;
+            
+            set_sequences();
         }
         
         return *this;
@@ -75,7 +118,36 @@ class MeiosisSampler : Sampler {
     
     void reset(DescentGraph& dg, unsigned int parameter);
     
+    // the founder allele graphs cache allele frequencies, call this
+    // after the genetic map has been changed (e.g. reheated)
+    void update_frequencies() {
+        for(unsigned int i = 0; i < f4.size(); ++i) {
+            f4[i].set_locus(i);
+        }
+    }
+    
     virtual void step(DescentGraph& dg, unsigned int parameter);
+    
+    // reset() and step() split into the parts that can be run in parallel
+    // (one call per block of loci or per locus) and the part that cannot, 
+    // for callers that manage their own threads
+    unsigned int num_blocks() const { return blocks.size(); }
+    void reset_block(DescentGraph& dg, unsigned int parameter, int block);
+    void reset_finish(unsigned int parameter) { last_parameter = parameter; }
+    void step_locus(DescentGraph& dg, unsigned int parameter, int locus);
+    void step_sample(DescentGraph& dg, unsigned int parameter);
+    
+    // the block sampler resamples all the meioses of a block jointly at 
+    // every locus (forward-backward over their joint states), call 
+    // update_graphs() once before a run of calls to step_meiosis_block()
+    unsigned int num_meiosis_blocks() const { return meiosis_blocks.size(); }
+    void update_graphs(DescentGraph& dg);
+    void step_meiosis_block(DescentGraph& dg, unsigned int block);
+    
+    // as above, for callers that manage their own threads
+    void update_block(DescentGraph& dg, int block);
+    void step_meiosis_block_locus(DescentGraph& dg, unsigned int block, int locus);
+    void step_meiosis_block_sample(DescentGraph& dg, unsigned int block);
 };
 
 #endif
@@ -26,6 +26,14 @@ inline void set_num_threads(int t) {
     #endif
 }
 
+inline int get_num_threads() {
+    #if defined(_OPENMP)
+    return omp_get_num_threads();
+    #else
+    return 1;
+    #endif
+}
+
 inline int get_thread_num() {
     #if defined(_OPENMP)
     return omp_get_thread_num();
@@ -34,6 +42,38 @@ inline int get_thread_num() {
     #endif
 }
 
+inline int get_level() {
+    #if defined(_OPENMP)
+    return omp_get_level();
+    #else
+    return 0;
+    #endif
+}
+
+inline int get_ancestor_thread_num(int level) {
+    #if defined(_OPENMP)
+    return omp_get_ancestor_thread_num(level);
+    #else
+    return (level == 0) ? 0 : -1;
+    #endif
+}
+
+inline int get_max_active_levels() {
+    #if defined(_OPENMP)
+    return omp_get_max_active_levels();
+    #else
+    return 1;
+    #endif
+}
+
+inline void set_max_active_levels(int levels) {
+    #if defined(_OPENMP)
+    omp_set_max_active_levels(levels);
+    #else
+    (void) levels;
+    #endif
+}
+
 inline double get_wtime() {
     #if defined(_OPENMP)
     return omp_get_wtime();
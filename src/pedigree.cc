@@ -60,6 +60,24 @@ void Pedigree::_count_leaves() {
 	}
 }
 
+// a child inherits their maternal allele from their mother and their 
+// paternal allele from their father, so each child is stored as the meiosis 
+// (child * 2) + allele, which is also the child's index into an edge list
+void Pedigree::_index_children() {
+    child_offsets.assign(1, 0);
+    child_meioses.clear();
+    
+    for(unsigned int i = 0; i < members.size(); ++i) {
+        enum parentage allele = members[i].isfemale() ? MATERNAL : PATERNAL;
+        
+        for(unsigned int j = 0; j < members[i].num_children(); ++j) {
+            child_meioses.push_back((members[i].get_child(j)->get_internalid() * 2) + allele);
+        }
+        
+        child_offsets.push_back(child_meioses.size());
+    }
+}
+
 bool Pedigree::sanity_check() {
     int components;
 
@@ -85,6 +103,7 @@ bool Pedigree::sanity_check() {
     
     _count_founders();
     _count_leaves();
+    _index_children();
 	
 	return true;
 }
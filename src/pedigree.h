@@ -18,6 +18,8 @@ class Pedigree {
 	vector<Person> members;
 	unsigned int number_of_founders;
 	unsigned int number_of_leaves;
+    vector<int> child_offsets;      // person i's children are child_meioses[child_offsets[i] .. child_offsets[i+1])
+    vector<int> child_meioses;      // (child * 2) + the allele the child got from i
 	
 	
 	bool _mendelian_errors() const;
@@ -29,8 +31,31 @@ class Pedigree {
     void _set_typed_flags();
 	void _count_founders();
     void _count_leaves();
+    void _index_children();
 	int _count_components();
 	int _person_compare(const Person& a, const Person& b) const;
+
+    // members point back at their pedigree, so need updating whenever the
+    // pedigree is copied (eg: when the parser's vector of pedigrees grows).
+    // once sanity_check() has filled in the relationships, the copied
+    // children and mates still point at the members of the original, so
+    // they are filled in again
+    void _update_pedigree_pointers() {
+        bool related = false;
+
+        for(unsigned int i = 0; i < members.size(); ++i) {
+            members[i].set_pedigree(this);
+            related = related or (members[i].num_children() != 0);
+        }
+
+        if(related) {
+            for(unsigned int i = 0; i < members.size(); ++i) {
+                members[i].clear_relationships();
+            }
+
+            _fill_in_relationships();
+        }
+    }
     
  public:
 	Pedigree(const string id, bool sex_linked) : 
@@ -38,14 +63,21 @@ class Pedigree {
         sex_linked(sex_linked),
         members(), 
         number_of_founders(0), 
-        number_of_leaves(0) {}
+        number_of_leaves(0),
+        child_offsets(),
+        child_meioses() {}
     
     Pedigree(const Pedigree& rhs) :
         id(rhs.id),
         sex_linked(rhs.sex_linked),
         members(rhs.members),
         number_of_founders(rhs.number_of_founders),
-        number_of_leaves(rhs.number_of_leaves) {}
+        number_of_leaves(rhs.number_of_leaves),
+        child_offsets(rhs.child_offsets),
+        child_meioses(rhs.child_meioses) {
+
+        _update_pedigree_pointers();
+    }
     
 	~Pedigree() {}
 
@@ -58,6 +90,10 @@ class Pedigree {
             members = rhs.members;
             number_of_founders = rhs.number_of_founders;
             number_of_leaves = rhs.number_of_leaves;
+            child_offsets = rhs.child_offsets;
+            child_meioses = rhs.child_meioses;
+
+            _update_pedigree_pointers();
         }
         
         return *this;
@@ -88,6 +124,20 @@ class Pedigree {
 		return number_of_leaves;
 	}
 
+    // flat copy of each person's children, so descent graph traversals do
+    // not need to chase Person pointers, see _index_children()
+    inline int children_begin(int i) const {
+        return child_offsets[i];
+    }
+    
+    inline int children_end(int i) const {
+        return child_offsets[i + 1];
+    }
+    
+    inline int get_child_meiosis(int j) const {
+        return child_meioses[j];
+    }
+
 	//Person* get_by_index(int i);
 	Person* get_by_name(const string& id);
 	
@@ -0,0 +1,532 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
+#include <cstring>
+#include <cctype>
+#include <string>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "types.h"
+#include "trait.h"
+#include "person.h"
+#include "pedigree.h"
+#include "peeling.h"
+#include "peel_sequence_generator.h"
+#include "peel_codegen.h"
+
+using namespace std;
+
+
+// 64-bit FNV-1a, it only has to tell sources apart (the length goes in the
+// filename as well). there are no 64-bit literals in C++98, so the constants
+// are put together from two halves
+const uint64_t FNV_OFFSET_BASIS = (uint64_t(0xcbf29ce4U) << 32) | 0x84222325U;
+const uint64_t FNV_PRIME = (uint64_t(0x00000100U) << 32) | 0x000001b3U;
+
+// the same as Rfunction::get_phased_trait()
+static enum phased_trait kid_trait(int m, int p, int maternal_allele, int paternal_allele, bool male_x) {
+    bool m_affected = (m == TRAIT_AA) or ((m == TRAIT_AU) and (maternal_allele == 0)) or ((m == TRAIT_UA) and (maternal_allele == 1));
+    bool p_affected = (p == TRAIT_AA) or ((p == TRAIT_AU) and (paternal_allele == 0)) or ((p == TRAIT_UA) and (paternal_allele == 1));
+
+    if(male_x) {
+        return m_affected ? TRAIT_AA : TRAIT_UU;
+    }
+
+    if(m_affected) {
+        return p_affected ? TRAIT_AA : TRAIT_AU;
+    }
+
+    return p_affected ? TRAIT_UA : TRAIT_UU;
+}
+
+// ISO C++ does not allow casting dlsym()'s void* to a function pointer
+template<class F>
+static F function_symbol(void* handle, const string& name) {
+    void* symbol = dlsym(handle, name.c_str());
+    F f;
+
+    memcpy(&f, &symbol, sizeof(f));
+
+    return f;
+}
+
+// pedigree ids come straight from the input, so anything other than letters
+// and digits is written as an octal escape
+static string c_string(const string& s) {
+    stringstream ss;
+
+    ss << "\"";
+
+    for(unsigned int i = 0; i < s.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(s[i]);
+
+        if(isalnum(c)) {
+            ss << c;
+        }
+        else {
+            ss << "\\" << oct << setw(3) << setfill('0') << int(c) << dec;
+        }
+    }
+
+    ss << "\"";
+
+    return ss.str();
+}
+
+uint64_t PeelCodeGenerator::hash(const string& s) {
+    uint64_t h = FNV_OFFSET_BASIS;
+
+    for(unsigned int i = 0; i < s.size(); ++i) {
+        h ^= static_cast<unsigned char>(s[i]);
+        h *= FNV_PRIME;
+    }
+
+    return h;
+}
+
+// the same order of multiplications as Rfunction::multiply_previous(), g points 
+// at the positions of element e in the previous functions, see 
+// PeelOperation::get_prev_positions()
+void PeelCodeGenerator::multiply_previous(stringstream& ss, PeelOperation& op, const string& value, const string& indent) {
+    unsigned int num_prev = op.get_prev_size();
+
+    if(num_prev == 0) {
+        return;
+    }
+
+    ss << indent << "{\n"
+       << indent << "    const int* pos = &g[" << value << " * " << num_prev << "];\n";
+
+    for(unsigned int j = 0; j < num_prev; ++j) {
+        ss << indent << "    tmp = (pos[" << j << "] < 0) ? 0.0 : tmp * p" << j << "[pos[" << j << "]];\n";
+    }
+
+    ss << indent << "}\n";
+}
+
+// one kernel per peel operation and rfunction type, these do exactly what
+// SamplerRfunction::evaluate_*_peel<>() and TraitRfunction::evaluate_*_peel<>()
+// do for each element, so results are bit-identical
+void PeelCodeGenerator::kernel_source(stringstream& ss, unsigned int i, bool trait) {
+    PeelOperation& op = psg->get_peel_order()[i];
+    enum peeloperation type = op.get_type();
+    unsigned int peel_id = op.get_peelnode();
+    vector<unsigned int>& kids = op.get_children();
+
+    ss << "extern \"C\" void lkg_" << (trait ? "trait_" : "sampler_") << i << "(const struct peel_kernel_args* a) {\n"
+       << "    const double* tc = a->trait_cache;\n";
+
+    for(unsigned int j = 0; j < op.get_prev_size(); ++j) {
+        ss << "    const double* p" << j << " = a->previous[" << j << "];\n";
+    }
+
+    if((type == CHILD_PEEL) or (type == PARENT_PEEL)) {
+        ss << (trait ? "    const double* r = a->recombination;\n" : "    const double* const* t = a->transmission;\n");
+    }
+
+    ss << "\n"
+       << "    for(int e = 0; e < a->count; ++e) {\n"
+       << "        double total = 0.0;\n"
+       << "        double tmp;\n";
+
+    // the cutset is only decoded by child and parent peels
+    if((type == CHILD_PEEL) or (type == PARENT_PEEL)) {
+        ss << "        const unsigned idx = a->elements[e];\n";
+    }
+
+    if(op.get_prev_size() != 0) {
+        ss << "        const int* g = &a->gather[e * " << (4 * op.get_prev_size()) << "];\n";
+    }
+
+    if(type == CHILD_PEEL) {
+        Person* kid = ped->get_by_index(peel_id);
+        bool male_x = sex_linked and (kid->get_sex() == MALE);
+
+        ss << "        const unsigned mat = (idx >> " << op.get_cutnode_shift(kid->get_maternalid()) << ") & 3U;\n"
+           << "        const unsigned pat = (idx >> " << op.get_cutnode_shift(kid->get_paternalid()) << ") & 3U;\n";
+
+        if(trait) {
+            ss << "        const unsigned* kid = &lkg_kid_trait[" << (male_x ? 1 : 0) << "][((mat * 4) + pat) * 4];\n"
+               << "        unsigned k;\n";
+
+            for(int a = 0; a < 4; ++a) {
+                ss << "        k = kid[" << a << "];\n"
+                   << "        tmp = tc[k];\n"
+                   << "        if(tmp != 0.0) {\n";
+                multiply_previous(ss, op, "k", "            ");
+                ss << "            tmp *= r[" << a << "];\n"
+                   << "            total += tmp;\n"
+                   << "        }\n";
+            }
+        }
+        else {
+            for(int v = 0; v < 4; ++v) {
+                stringstream value;
+                value << v;
+
+                ss << "        tmp = tc[" << v << "];\n"
+                   << "        if(tmp != 0.0) {\n"
+                   << "            tmp *= t[0][(mat * 16) + (pat * 4) + " << v << "];\n";
+                multiply_previous(ss, op, value.str(), "            ");
+                ss << "            a->presum[(e * 4) + " << v << "] = tmp;\n"
+                   << "            total += tmp;\n"
+                   << "        }\n";
+            }
+        }
+    }
+    else if(type == PARENT_PEEL) {
+        for(unsigned int c = 0; c < kids.size(); ++c) {
+            Person* child = ped->get_by_index(kids[c]);
+            unsigned int partner = (child->get_maternalid() == peel_id) ? child->get_paternalid() : child->get_maternalid();
+
+            ss << "        const unsigned k" << c << " = (idx >> " << op.get_cutnode_shift(kids[c]) << ") & 3U;\n"
+               << "        const unsigned q" << c << " = (idx >> " << op.get_cutnode_shift(partner) << ") & 3U;\n";
+        }
+
+        for(int v = 0; v < 4; ++v) {
+            stringstream value;
+            value << v;
+
+            ss << "        tmp = tc[" << v << "];\n"
+               << "        if(tmp != 0.0) {\n";
+            multiply_previous(ss, op, value.str(), "            ");
+            ss << "            double cp = 1.0;\n";
+
+            for(unsigned int c = 0; c < kids.size(); ++c) {
+                Person* child = ped->get_by_index(kids[c]);
+                bool mother = child->get_maternalid() == peel_id;
+
+                if(trait) {
+                    bool male_x = sex_linked and (child->get_sex() == MALE);
+
+                    ss << "            {\n"
+                       << "                const unsigned* kid = &lkg_kid_trait[" << (male_x ? 1 : 0) << "][";
+
+                    if(mother) {
+                        ss << "(" << (v * 4) << " + q" << c << ") * 4];\n";
+                    }
+                    else {
+                        ss << "((q" << c << " * 4) + " << v << ") * 4];\n";
+                    }
+
+                    ss << "                double ct = 0.0;\n";
+
+                    for(int a = 0; a < 4; ++a) {
+                        ss << "                if(kid[" << a << "] == k" << c << ") ct += r[" << ((c * 4) + a) << "];\n";
+                    }
+
+                    ss << "                cp *= ct;\n"
+                       << "            }\n";
+                }
+                else {
+                    ss << "            cp *= t[" << c << "][";
+
+                    if(mother) {
+                        ss << (v * 16) << " + (q" << c << " * 4) + k" << c << "];\n";
+                    }
+                    else {
+                        ss << "(q" << c << " * 16) + " << (v * 4) << " + k" << c << "];\n";
+                    }
+                }
+            }
+
+            ss << "            tmp *= cp;\n";
+
+            if(not trait) {
+                ss << "            a->presum[(e * 4) + " << v << "] = tmp;\n";
+            }
+
+            ss << "            total += tmp;\n"
+               << "        }\n";
+        }
+    }
+    // partner and last peels, Rfunction::evaluate_partner_peel<>()
+    else {
+        for(int v = 0; v < 4; ++v) {
+            stringstream value;
+            value << v;
+
+            ss << "        tmp = tc[" << v << "];\n"
+               << "        if(tmp != 0.0) {\n";
+            multiply_previous(ss, op, value.str(), "            ");
+            ss << "            a->presum[(e * 4) + " << v << "] = tmp;\n"
+               << "            total += tmp;\n"
+               << "        }\n";
+        }
+    }
+
+    ss << "        a->pmatrix[e] = total;\n"
+       << "    }\n"
+       << "}\n\n";
+}
+
+string PeelCodeGenerator::operations_source() {
+    vector<PeelOperation>& ops = psg->get_peel_order();
+    stringstream ss;
+
+    ss << "// generated by PeelCodeGenerator for pedigree " << ped->get_id() << ", do not edit\n\n"
+       << "struct peel_kernel_args {\n"
+       << "    const int* elements;\n"
+       << "    int count;\n"
+       << "    const double* trait_cache;\n"
+       << "    const double* const* transmission;\n"
+       << "    const double* recombination;\n"
+       << "    const double* const* previous;\n"
+       << "    const int* gather;\n"
+       << "    double* pmatrix;\n"
+       << "    double* presum;\n"
+       << "};\n\n";
+
+    // child trait for ((mother * 4) + father) * 4 + (maternal allele * 2) + paternal allele,
+    // the second table is for males when sex-linked
+    ss << "static const unsigned lkg_kid_trait[2][64] = {\n";
+
+    for(int x = 0; x < 2; ++x) {
+        ss << "    {";
+
+        for(int n = 0; n < 64; ++n) {
+            ss << kid_trait(n / 16, (n / 4) % 4, (n / 2) % 2, n % 2, x == 1) << ((n != 63) ? "," : "");
+        }
+
+        ss << "}" << ((x == 0) ? "," : "") << "\n";
+    }
+
+    ss << "};\n\n"
+       << "extern \"C\" int lkg_num_operations() {\n"
+       << "    return " << ops.size() << ";\n"
+       << "}\n\n";
+
+    for(unsigned int i = 0; i < ops.size(); ++i) {
+        kernel_source(ss, i, false);
+        kernel_source(ss, i, true);
+    }
+
+    return ss.str();
+}
+
+// hash and length of the kernels, this names the shared object in the cache
+string PeelCodeGenerator::source_id(const string& kernels) {
+    stringstream ss;
+
+    ss << hex << setw(16) << setfill('0') << hash(kernels) << dec << "_" << kernels.size();
+
+    return ss.str();
+}
+
+// what the kernels were generated from, load() checks this before using
+// a shared object from the cache
+string PeelCodeGenerator::identity_source(const string& id) {
+    stringstream ss;
+
+    ss << "extern \"C\" const char* lkg_source_id() {\n"
+       << "    return \"" << id << "\";\n"
+       << "}\n\n"
+       << "extern \"C\" const char* lkg_pedigree_id() {\n"
+       << "    return " << c_string(ped->get_id()) << ";\n"
+       << "}\n";
+
+    return ss.str();
+}
+
+string PeelCodeGenerator::source() {
+    string kernels = operations_source();
+
+    return kernels + identity_source(source_id(kernels));
+}
+
+bool PeelCodeGenerator::compile(const string& source, const string& filename) {
+    stringstream tmp;
+    FILE* f;
+
+    // concurrent runs write their own temporary files and then rename them
+    tmp << filename << "." << getpid();
+
+    string src = tmp.str() + ".cc";
+    string obj = tmp.str() + ".so";
+    string log = filename + ".log";
+
+    if((f = fopen(src.c_str(), "w")) == NULL) {
+        fprintf(stderr, "warning: could not write '%s'\n", src.c_str());
+        return false;
+    }
+
+    fputs(source.c_str(), f);
+    fclose(f);
+
+    // the compiler is run directly rather than through the shell, so nothing
+    // in the paths is interpreted. $CXX can still have several words
+    // (eg: "ccache g++"), they are split on whitespace
+    const char* cxx = getenv("CXX");
+    stringstream words((cxx != NULL) ? cxx : "");
+    vector<string> args;
+    vector<char*> argv;
+    string word;
+
+    while(words >> word) {
+        args.push_back(word);
+    }
+
+    if(args.empty()) {
+        args.push_back("c++");
+    }
+
+    args.push_back("-O2");
+    args.push_back("-fPIC");
+    args.push_back("-shared");
+    args.push_back("-o");
+    args.push_back(obj);
+    args.push_back(src);
+
+    for(unsigned int i = 0; i < args.size(); ++i) {
+        argv.push_back(const_cast<char*>(args[i].c_str()));
+    }
+    argv.push_back(NULL);
+
+    fflush(stdout);
+    fflush(stderr);
+
+    pid_t pid = fork();
+
+    if(pid == 0) {
+        int fd = open(log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+        if(fd != -1) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+
+        execvp(argv[0], &argv[0]);
+
+        fprintf(stderr, "could not run '%s' (%s)\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+
+    int status = 0;
+    bool ret = (pid != -1) and (waitpid(pid, &status, 0) == pid) and WIFEXITED(status) and (WEXITSTATUS(status) == 0);
+
+    unlink(src.c_str());
+
+    if((not ret) or (rename(obj.c_str(), filename.c_str()) != 0)) {
+        fprintf(stderr, "warning: could not compile peel kernels (see '%s')\n", log.c_str());
+        unlink(obj.c_str());
+        return false;
+    }
+
+    unlink(log.c_str());
+
+    return true;
+}
+
+// returns NULL if the shared object cannot be loaded or was not generated
+// from the same source, eg: a hash collision or a file left in the cache
+// by a different version of the program
+void* PeelCodeGenerator::open_kernels(const string& filename, const string& id, vector<peel_kernel>& samplers, vector<peel_kernel>& traits) {
+    vector<PeelOperation>& ops = psg->get_peel_order();
+
+    void* handle = dlopen(filename.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+    if(handle == NULL) {
+        fprintf(stderr, "warning: could not load '%s' (%s)\n", filename.c_str(), dlerror());
+        return NULL;
+    }
+
+    typedef const char* (*string_function)();
+    typedef int (*count_function)();
+    string_function source_id = function_symbol<string_function>(handle, "lkg_source_id");
+    string_function pedigree_id = function_symbol<string_function>(handle, "lkg_pedigree_id");
+    count_function num_operations = function_symbol<count_function>(handle, "lkg_num_operations");
+
+    if((source_id == NULL) or (source_id() != id) or \
+       (pedigree_id == NULL) or (pedigree_id() != ped->get_id()) or \
+       (num_operations == NULL) or (num_operations() != int(ops.size()))) {
+        fprintf(stderr, "warning: '%s' does not match pedigree %s\n", filename.c_str(), ped->get_id().c_str());
+        dlclose(handle);
+        return NULL;
+    }
+
+    samplers.clear();
+    traits.clear();
+
+    for(unsigned int i = 0; i < ops.size(); ++i) {
+        stringstream s;
+        stringstream t;
+
+        s << "lkg_sampler_" << i;
+        t << "lkg_trait_" << i;
+
+        samplers.push_back(function_symbol<peel_kernel>(handle, s.str()));
+        traits.push_back(function_symbol<peel_kernel>(handle, t.str()));
+
+        if((samplers.back() == NULL) or (traits.back() == NULL)) {
+            fprintf(stderr, "warning: '%s' does not match pedigree %s\n", filename.c_str(), ped->get_id().c_str());
+            dlclose(handle);
+            return NULL;
+        }
+    }
+
+    return handle;
+}
+
+bool PeelCodeGenerator::load() {
+    vector<PeelOperation>& ops = psg->get_peel_order();
+    vector<peel_kernel> samplers;
+    vector<peel_kernel> traits;
+
+    for(unsigned int i = 0; i < ops.size(); ++i) {
+        if(ops[i].get_type() == NULL_PEEL) {
+            fprintf(stderr, "warning: peel operation %d has no type, not compiling pedigree %s\n", i, ped->get_id().c_str());
+            return false;
+        }
+    }
+
+    if((mkdir(cache_dir.c_str(), 0755) != 0) and (errno != EEXIST)) {
+        fprintf(stderr, "warning: could not create code cache '%s'\n", cache_dir.c_str());
+        return false;
+    }
+
+    string kernels = operations_source();
+    string id = source_id(kernels);
+    string code = kernels + identity_source(id);
+    string filename = cache_dir + "/swift_" + id + ".so";
+    bool cached = access(filename.c_str(), R_OK) == 0;
+
+    if((not cached) and (not compile(code, filename))) {
+        return false;
+    }
+
+    // the library is never closed, the kernels are used until the program exits
+    void* handle = open_kernels(filename, id, samplers, traits);
+
+    // whatever was in the cache is replaced
+    if((handle == NULL) and cached) {
+        fprintf(stderr, "warning: recompiling peel kernels for pedigree %s\n", ped->get_id().c_str());
+
+        cached = false;
+
+        if(compile(code, filename)) {
+            handle = open_kernels(filename, id, samplers, traits);
+        }
+    }
+
+    if(handle == NULL) {
+        return false;
+    }
+
+    for(unsigned int i = 0; i < ops.size(); ++i) {
+        ops[i].set_kernels(samplers[i], traits[i]);
+    }
+
+    printf("%s peel kernels for pedigree %s from '%s'\n", cached ? "read" : "compiled", ped->get_id().c_str(), filename.c_str());
+
+    return true;
+}
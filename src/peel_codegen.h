@@ -0,0 +1,78 @@
+#ifndef LKG_PEELCODEGEN_H_
+#define LKG_PEELCODEGEN_H_
+
+using namespace std;
+
+#include <string>
+#include <sstream>
+#include <vector>
+#include <stdint.h>
+
+#include "peeling.h"
+
+class Pedigree;
+class PeelSequenceGenerator;
+class PeelOperation;
+
+
+// writes out straight-line C++ for every operation of a peeling sequence,
+// with the cutset decoding and the loops over children all fixed at code 
+// generation time, compiles it with the
+// system compiler ($CXX or c++) and loads it with dlopen. Rfunctions pick up
+// the kernels from their PeelOperation, see Rfunction::evaluate_compiled()
+//
+// shared objects are cached in a directory under a 64-bit hash of the source,
+// so repeated runs on the same pedigree (and peeling sequence) only compile
+// once. each one records the hash and the pedigree id, a cached file that
+// does not match is recompiled. if anything fails the rfunctions keep using
+// the generic code
+class PeelCodeGenerator {
+
+    Pedigree* ped;
+    PeelSequenceGenerator* psg;
+    bool sex_linked;
+    string cache_dir;
+
+    static uint64_t hash(const string& s);
+
+    string operations_source();
+    string source_id(const string& kernels);
+    string identity_source(const string& id);
+    bool compile(const string& source, const string& filename);
+    void* open_kernels(const string& filename, const string& id, vector<peel_kernel>& samplers, vector<peel_kernel>& traits);
+    void kernel_source(stringstream& ss, unsigned int i, bool trait);
+    void multiply_previous(stringstream& ss, PeelOperation& op, const string& value, const string& indent);
+
+ public :
+    PeelCodeGenerator(Pedigree* ped, PeelSequenceGenerator* psg, bool sex_linked, const string& cache_dir) :
+        ped(ped),
+        psg(psg),
+        sex_linked(sex_linked),
+        cache_dir(cache_dir) {}
+
+    PeelCodeGenerator(const PeelCodeGenerator& rhs) :
+        ped(rhs.ped),
+        psg(rhs.psg),
+        sex_linked(rhs.sex_linked),
+        cache_dir(rhs.cache_dir) {}
+
+    ~PeelCodeGenerator() {}
+
+    PeelCodeGenerator& operator=(const PeelCodeGenerator& rhs) {
+        if(this != &rhs) {
+            ped = rhs.ped;
+            psg = rhs.psg;
+            sex_linked = rhs.sex_linked;
+            cache_dir = rhs.cache_dir;
+        }
+        return *this;
+    }
+
+    string source();
+
+    // returns false if the generic rfunctions are still being used
+    bool load();
+};
+
+#endif
+
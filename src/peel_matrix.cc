@@ -13,14 +13,12 @@
 using namespace std;
 
 
-PeelMatrix::PeelMatrix(unsigned int num_dim, unsigned int val_dim) :
-    keys(),
-    number_of_dimensions(num_dim),
-    values_per_dimension(val_dim),
-    size((unsigned int) pow(static_cast<double>(values_per_dimension), static_cast<double>(number_of_dimensions))),
+PeelMatrix::PeelMatrix(unsigned int max_elements) :
+    size(max_elements),
+    capacity(max_elements),
     data(NULL) {
     
-    data = new double[size];
+    data = new double[capacity];
     reset();
 }
 
@@ -29,31 +27,25 @@ void PeelMatrix::reset() {
 }
 
 PeelMatrix::PeelMatrix(const PeelMatrix& rhs) :
-    keys(rhs.keys),
-    number_of_dimensions(rhs.number_of_dimensions),
-    values_per_dimension(rhs.values_per_dimension),
     size(rhs.size),
+    capacity(rhs.capacity),
     data(NULL) {
     
-    data = new double[size];
-    copy(rhs.data, rhs.data + size, data);
+    data = new double[capacity];
+    copy(rhs.data, rhs.data + capacity, data);
 }
 
 PeelMatrix& PeelMatrix::operator=(const PeelMatrix& rhs) {
 
     if(this != &rhs) {
-        number_of_dimensions = rhs.number_of_dimensions;
-        values_per_dimension = rhs.values_per_dimension;
-
-        if(size != rhs.size) {
+        if(capacity != rhs.capacity) {
             delete[] data;
-            data = new double[rhs.size];
+            data = new double[rhs.capacity];
         }
 
         size = rhs.size;
-        copy(rhs.data, rhs.data + size, data);
-        
-        keys = rhs.keys;
+        capacity = rhs.capacity;
+        copy(rhs.data, rhs.data + capacity, data);
     }
 
     return *this;
@@ -63,10 +55,6 @@ PeelMatrix::~PeelMatrix() {
     delete[] data;
 }
 
-void PeelMatrix::set_keys(vector<unsigned int>& k) {
-    keys = k;
-}
-
 double PeelMatrix::get_result() {
     if(size != 1) {
         fprintf(stderr, "Cannot get result from an intermediate r-function\n");
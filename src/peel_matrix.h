@@ -4,6 +4,7 @@
 using namespace std;
 
 #include <cstdio>
+#include <cstdlib>
 #include <cmath>
 #include <map>
 #include <vector>
@@ -13,55 +14,52 @@ using namespace std;
 #include "trait.h"
 
 
+// only the legal elements of an rfunction are stored, element i is the i'th
+// matrix index in the list being evaluated (see PeelOperation::get_matrix_indices()
+// and PeelOperation::get_lod_indices()), so the size changes from locus to
+// locus but never goes above the capacity given to the constructor
 class PeelMatrix {
-    vector<unsigned int> keys;
-    unsigned int number_of_dimensions;
-    unsigned int values_per_dimension;
     unsigned int size;
+    unsigned int capacity;
     double* data;
-    
-    void init_offsets();
-    
+
  public :
-    PeelMatrix(unsigned int num_dim, unsigned int val_dim);
+    PeelMatrix(unsigned int max_elements);
     PeelMatrix(const PeelMatrix& rhs);
     PeelMatrix& operator=(const PeelMatrix& rhs);
     ~PeelMatrix();
-    
-    void set_keys(vector<unsigned int>& k);
+
+    void resize(unsigned int n) {
+        if(n > capacity) {
+            fprintf(stderr, "error: peel matrix of %d elements resized to %d (%s:%d)\n", capacity, n, __FILE__, __LINE__);
+            abort();
+        }
+
+        size = n;
+    }
 
     double get_result();
     double sum();
     void normalise();
-    
-    inline int generate_index(vector<int>& index) const {
-        int tmp = 0;
-        
-        for(int i = 0; i < int(keys.size()); ++i) {
-            tmp += (index[keys[i]] * (1 << (2 * i)));
-        }
-        
-        return tmp;
-    }
-    
-    double get(vector<int>& pmk) const {
-        return data[generate_index(pmk)];
-    }
-    
+
     double get(unsigned int pmk) const {
         return data[pmk];
     }
-    
+
     void set(unsigned int pmk, double value) {
         data[pmk] = value;
     }
-    
+
     void add(unsigned int pmk, double value) {
         data[pmk] += value;
     }
-    
+
+    double* get_data() {
+        return data;
+    }
+
     void reset();
-    
+
     void raw_print() {
         for(unsigned int i = 0; i < size; ++i) {
             printf("%.3f\n", data[i]);
@@ -81,13 +81,14 @@ int PeelSequenceGenerator::find_function_containing(vector<unsigned>& nodes) {
     return -1;
 }
 
+// element i of a matrix assigns ((i >> (2 * j)) & 3) to cutset[j], with the 
+// peelnode as the last (most significant) dimension of the presum matrix
 void PeelSequenceGenerator::bruteforce_assignments(PeelOperation& op) {
     int ndim = op.get_cutset_size();
-    int total, offset, index;
+    int total;
     
     total = pow(4.0, ndim + 1);
     
-    vector<vector<int> > assigns(total, vector<int>(ped->num_members(), -1));
     vector<vector<int> > matrix_indices(map->num_markers());
     vector<vector<int> > presum_indices(map->num_markers());
     vector<int> lod_indices;
@@ -95,23 +96,13 @@ void PeelSequenceGenerator::bruteforce_assignments(PeelOperation& op) {
     vector<unsigned int> cutset(op.get_cutset());
     cutset.push_back(op.get_peelnode());
     
-    for(int ind = 0; ind < total; ++ind) {
-        index = ind;
-        
-        for(int i = ndim; i > -1; --i) {
-            offset = 1 << (i * 2);
-            assigns[ind][cutset[i]] = index / offset;
-            index %= offset;
-        }
-    }
-    
     // presum indices, ndim is always one bigger
     for(int locus = 0; locus < int(map->num_markers()); ++locus) {
         for(int i = 0; i < total; ++i) {
             bool valid = true;
             
             for(int j = 0; j < (ndim + 1); ++j) {
-                if(not ge.is_legal(cutset[j], locus, assigns[i][cutset[j]])) {
+                if(not ge.is_legal(cutset[j], locus, (i >> (2 * j)) & 3)) {
                     valid = false;
                     break;
                 }
@@ -126,18 +117,6 @@ void PeelSequenceGenerator::bruteforce_assignments(PeelOperation& op) {
     
     cutset.pop_back();
     total = pow(4.0, ndim);
-    vector<vector<int> > assigns2(total, vector<int>(ped->num_members(), -1));
-    
-    for(int ind = 0; ind < total; ++ind) {
-        index = ind;
-        
-        for(int i = ndim; i > -1; --i) {
-            offset = 1 << (i * 2);
-            assigns2[ind][cutset[i]] = index / offset;
-            index %= offset;
-        }
-    }
-    
     
     // matrix_indices
     for(int locus = 0; locus < int(map->num_markers()); ++locus) {
@@ -145,7 +124,7 @@ void PeelSequenceGenerator::bruteforce_assignments(PeelOperation& op) {
             bool valid = true;
             
             for(int j = 0; j < ndim; ++j) {
-                if(not ge.is_legal(cutset[j], locus, assigns2[i][cutset[j]])) {
+                if(not ge.is_legal(cutset[j], locus, (i >> (2 * j)) & 3)) {
                     valid = false;
                     break;
                 }
@@ -165,7 +144,7 @@ void PeelSequenceGenerator::bruteforce_assignments(PeelOperation& op) {
         bool valid = true;
         
         for(int j = 0; j < ndim; ++j) {
-            pt = static_cast<enum phased_trait>(assigns[i][cutset[j]]);
+            pt = static_cast<enum phased_trait>((i >> (2 * j)) & 3);
             
             if((ped->get_by_index(cutset[j]))->get_disease_prob(pt) == 0.0) {
                 valid = false;
@@ -179,12 +158,86 @@ void PeelSequenceGenerator::bruteforce_assignments(PeelOperation& op) {
     }
     
     
-    op.set_index_values(assigns2);
     op.set_matrix_indices(matrix_indices);
     op.set_presum_indices(presum_indices);
     op.set_lod_indices(lod_indices);
 }
 
+// where each element of op's matrices is found in each of the previous functions' 
+// matrices, which only store their legal elements, so rfunctions do not need 
+// to search in their inner loops (previous functions must already be in peelorder)
+void PeelSequenceGenerator::find_prev_positions(PeelOperation& op) {
+    vector<unsigned int>& cutset = op.get_cutset();
+    vector<unsigned int>& prev = op.get_prevfunctions();
+    unsigned int peelnode = op.get_peelnode();
+    
+    // where each of the keys of previous function j is in an index of op, 
+    // with the peelnode after the cutset as in the presum matrix
+    vector<vector<unsigned int> > shifts(prev.size());
+    
+    for(unsigned int j = 0; j < prev.size(); ++j) {
+        vector<unsigned int>& keys = peelorder[prev[j]].get_cutset();
+        
+        for(unsigned int k = 0; k < keys.size(); ++k) {
+            if(keys[k] == peelnode) {
+                shifts[j].push_back(2 * cutset.size());
+                continue;
+            }
+            
+            int pos = find(cutset.begin(), cutset.end(), keys[k]) - cutset.begin();
+            
+            if(pos == int(cutset.size())) {
+                fprintf(stderr, "error: previous function is not contained in the cutset (%s:%d)\n", __FILE__, __LINE__);
+                abort();
+            }
+            
+            shifts[j].push_back(2 * pos);
+        }
+    }
+    
+    vector<vector<int> > positions(map->num_markers());
+    vector<int> lod_positions;
+    vector<vector<int>*> prev_indices(prev.size());
+    
+    for(int locus = 0; locus < int(map->num_markers()); ++locus) {
+        for(unsigned int j = 0; j < prev.size(); ++j) {
+            prev_indices[j] = peelorder[prev[j]].get_matrix_indices(locus);
+        }
+        
+        find_positions(*(op.get_matrix_indices(locus)), 2 * cutset.size(), prev_indices, shifts, positions[locus]);
+    }
+    
+    for(unsigned int j = 0; j < prev.size(); ++j) {
+        prev_indices[j] = peelorder[prev[j]].get_lod_indices();
+    }
+    
+    find_positions(*(op.get_lod_indices()), 2 * cutset.size(), prev_indices, shifts, lod_positions);
+    
+    op.set_prev_positions(positions, lod_positions);
+}
+
+// the index lists made by bruteforce_assignments() are sorted
+void PeelSequenceGenerator::find_positions(vector<int>& indices, unsigned int peelnode_shift, vector<vector<int>*>& prev_indices, 
+                                           vector<vector<unsigned int> >& shifts, vector<int>& positions) {
+    positions.reserve(indices.size() * 4 * prev_indices.size());
+    
+    for(unsigned int i = 0; i < indices.size(); ++i) {
+        for(int v = 0; v < 4; ++v) {
+            for(unsigned int j = 0; j < prev_indices.size(); ++j) {
+                int tmp = 0;
+                
+                for(unsigned int k = 0; k < shifts[j].size(); ++k) {
+                    tmp += (((indices[i] | (v << peelnode_shift)) >> shifts[j][k]) & 3) << (2 * k);
+                }
+                
+                vector<int>::iterator it = lower_bound(prev_indices[j]->begin(), prev_indices[j]->end(), tmp);
+                
+                positions.push_back(((it != prev_indices[j]->end()) and (*it == tmp)) ? it - prev_indices[j]->begin() : -1);
+            }
+        }
+    }
+}
+
 void PeelSequenceGenerator::set_type(PeelOperation& p) {
     enum peeloperation t = NULL_PEEL;
     
@@ -234,12 +287,39 @@ void PeelSequenceGenerator::finalise_peel_order(vector<unsigned int>& seq) {
         set_type(p);
         find_prev_functions(p);
         bruteforce_assignments(p);
+        find_prev_positions(p);
         
         eliminate_node(tmp, seq[i]);
         
         peelorder.push_back(p);
         state.toggle_peel_operation(p);
     }
+
+    sequence = seq;
+}
+
+bool PeelSequenceGenerator::set_sequence(vector<unsigned int>& seq) {
+    
+    if(seq.size() != ped->num_members()) {
+        return false;
+    }
+
+    vector<bool> seen(seq.size(), false);
+
+    for(unsigned int i = 0; i < seq.size(); ++i) {
+        if((seq[i] >= seq.size()) or seen[seq[i]]) {
+            return false;
+        }
+        seen[seq[i]] = true;
+    }
+
+    if(not is_legit(seq)) {
+        return false;
+    }
+    
+    finalise_peel_order(seq);
+
+    return true;
 }
 
 void PeelSequenceGenerator::build_simple_graph() {
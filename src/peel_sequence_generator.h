@@ -21,6 +21,7 @@ class PeelSequenceGenerator {
     GeneticMap* map;
     bool verbose;
     vector<PeelOperation> peelorder;
+    vector<unsigned int> sequence;  // the order people were peeled in
     PeelingState state;
     GenotypeElimination ge;
     
@@ -29,6 +30,9 @@ class PeelSequenceGenerator {
     void find_prev_functions(PeelOperation& op);
     int find_function_containing(vector<unsigned>& nodes);
     void bruteforce_assignments(PeelOperation& op);
+    void find_prev_positions(PeelOperation& op);
+    void find_positions(vector<int>& indices, unsigned int peelnode_shift, vector<vector<int>*>& prev_indices, 
+                        vector<vector<unsigned int> >& shifts, vector<int>& positions);
     
     int calculate_cost(vector<unsigned int>& seq);
     void finalise_peel_order(vector<unsigned int>& seq);
@@ -51,6 +55,7 @@ class PeelSequenceGenerator {
         map(m),
         verbose(verbose),
         peelorder(),
+        sequence(),
         state(p),
         ge(p, sex_linked) {
         
@@ -66,6 +71,7 @@ class PeelSequenceGenerator {
         map(rhs.map),
         verbose(rhs.verbose),
         peelorder(rhs.peelorder),
+        sequence(rhs.sequence),
         state(rhs.state),
         ge(rhs.ge) {}
         
@@ -75,6 +81,7 @@ class PeelSequenceGenerator {
             map = rhs.map;
             verbose = rhs.verbose;
             peelorder = rhs.peelorder;
+            sequence = rhs.sequence;
             state = rhs.state;
             ge = rhs.ge;
         }
@@ -86,6 +93,11 @@ class PeelSequenceGenerator {
     vector<PeelOperation>& get_peel_order();
     unsigned int get_peeling_cost();
     void build_peel_sequence(unsigned int iterations);
+
+    // for restoring a peel sequence found earlier (see Checkpoint) instead
+    // of searching again, returns false if it does not fit this pedigree
+    vector<unsigned int>& get_sequence() { return sequence; }
+    bool set_sequence(vector<unsigned int>& seq);
     
     string debug_string();
 };
@@ -4,6 +4,7 @@
 using namespace std;
 
 #include <vector>
+#include <algorithm>
 
 #include "peeling.h"
 #include "trait_rfunction.h"
@@ -31,6 +32,17 @@ class Peeler {
     
     Peeler& operator=(const Peeler& rhs);
     
+    // the rfunctions point at each other, swapping the vectors moves the
+    // elements without invalidating those pointers
+    void swap(Peeler& rhs) {
+        std::swap(ped, rhs.ped);
+        std::swap(map, rhs.map);
+        std::swap(lod, rhs.lod);
+        rfunctions.swap(rhs.rfunctions);
+        std::swap(locus, rhs.locus);
+        std::swap(sex_linked, rhs.sex_linked);
+    }
+    
     double calc_trait_prob();
     double get_trait_prob(); // XXX to ease transition, but delete later...
     
@@ -45,5 +57,9 @@ class Peeler {
     void process(DescentGraph* dg);
 };
 
+inline void swap(Peeler& a, Peeler& b) {
+    a.swap(b);
+}
+
 #endif
 
@@ -14,6 +14,23 @@ using namespace std;
 #include "pedigree.h"
 
 
+// arguments to a compiled rfunction kernel, see PeelCodeGenerator, the 
+// generated source has its own copy of this struct so keep them in sync
+struct peel_kernel_args {
+    const int* elements;                // matrix indices to evaluate, element i is
+                                        // at i in pmatrix and (i * 4) + peelnode in presum
+    int count;
+    const double* trait_cache;          // peelnode, 4 values
+    const double* const* transmission;  // SamplerRfunction, 64 values per child
+    const double* recombination;        // TraitRfunction, 4 values per child
+    const double* const* previous;      // matrix of each previous function
+    const int* gather;                  // see PeelOperation::get_prev_positions()
+    double* pmatrix;
+    double* presum;
+};
+
+typedef void (*peel_kernel)(const struct peel_kernel_args* args);
+
 enum peeloperation {
     NULL_PEEL,
     CHILD_PEEL,
@@ -33,10 +50,15 @@ class PeelOperation {
     vector<unsigned int> previous;  // all previous functions (0-3) (at least 3 is the most i have seen...)
     
     // cached indices 
-    vector<vector<int> > assignments;
     vector<vector<int> > presum_indices;
     vector<vector<int> > matrix_indices;
     vector<int> lod_indices;
+    vector<vector<int> > prev_positions;    // where element i of matrix_indices[locus] is in previous
+                                            // function j with the peelnode = v, at ((i * 4) + v) * previous.size() + j,
+                                            // or -1 if that element is not legal
+    vector<int> lod_prev_positions;         // the same, but for lod_indices
+    peel_kernel sampler_kernel;     // compiled versions of the rfunctions, or NULL
+    peel_kernel trait_kernel;
     
     
  public :
@@ -48,10 +70,13 @@ class PeelOperation {
         cutset(), 
         children(),
         previous(),
-        assignments(),
         presum_indices(),
         matrix_indices(),
-        lod_indices() {}
+        lod_indices(),
+        prev_positions(),
+        lod_prev_positions(),
+        sampler_kernel(NULL),
+        trait_kernel(NULL) {}
     
     PeelOperation(const PeelOperation& rhs) :
         ped(rhs.ped),
@@ -61,10 +86,13 @@ class PeelOperation {
         cutset(rhs.cutset),
         children(rhs.children),
         previous(rhs.previous),
-        assignments(rhs.assignments),
         presum_indices(rhs.presum_indices),
         matrix_indices(rhs.matrix_indices),
-        lod_indices(rhs.lod_indices) {}
+        lod_indices(rhs.lod_indices),
+        prev_positions(rhs.prev_positions),
+        lod_prev_positions(rhs.lod_prev_positions),
+        sampler_kernel(rhs.sampler_kernel),
+        trait_kernel(rhs.trait_kernel) {}
         
     ~PeelOperation() {}
     
@@ -78,10 +106,13 @@ class PeelOperation {
             cutset = rhs.cutset;
             children = rhs.children;
             previous = rhs.previous;
-            assignments = rhs.assignments;
             presum_indices = rhs.presum_indices;
             matrix_indices = rhs.matrix_indices;
             lod_indices = rhs.lod_indices;
+            prev_positions = rhs.prev_positions;
+            lod_prev_positions = rhs.lod_prev_positions;
+            sampler_kernel = rhs.sampler_kernel;
+            trait_kernel = rhs.trait_kernel;
         }
         
         return *this;
@@ -125,6 +156,18 @@ class PeelOperation {
         return cutset[i];
     }
     
+    // cutset[i] is stored in bits (2 * i) and (2 * i) + 1 of a matrix index
+    unsigned get_cutnode_shift(unsigned int node) const {
+        vector<unsigned int>::const_iterator it = find(cutset.begin(), cutset.end(), node);
+        
+        if(it == cutset.end()) {
+            fprintf(stderr, "error: %d is not in the cutset of %d (%s:%d)\n", node, peelnode, __FILE__, __LINE__);
+            abort();
+        }
+        
+        return 2 * (it - cutset.begin());
+    }
+    
     void reset() {
         cutset.clear();
     }
@@ -303,10 +346,6 @@ class PeelOperation {
         return ss.str();
     }
     
-    void set_index_values(vector<vector<int> > assigns) {
-        assignments = assigns;
-    }
-    
     void set_presum_indices(vector<vector<int> > indices) {
         presum_indices = indices;
     }
@@ -319,10 +358,9 @@ class PeelOperation {
         lod_indices = indices;
     }
     
-    // return-by-value as each locus uses it to store temporary values
-    // for the node being peeled as well 
-    vector<vector<int> > get_index_values() {
-        return assignments;
+    void set_prev_positions(vector<vector<int> >& positions, vector<int>& lod_positions) {
+        prev_positions = positions;
+        lod_prev_positions = lod_positions;
     }
     
     vector<int>* get_presum_indices(int locus) {
@@ -336,6 +374,38 @@ class PeelOperation {
     vector<int>* get_lod_indices() {
         return &lod_indices;
     }
+    
+    vector<int>* get_prev_positions(int locus) {
+        return &prev_positions[locus];
+    }
+    
+    vector<int>* get_lod_prev_positions() {
+        return &lod_prev_positions;
+    }
+    
+    // the most elements an rfunction for this operation needs to store
+    unsigned int get_max_matrix_size() const {
+        unsigned int tmp = lod_indices.size();
+        
+        for(unsigned int i = 0; i < matrix_indices.size(); ++i) {
+            tmp = max(tmp, static_cast<unsigned int>(matrix_indices[i].size()));
+        }
+        
+        return tmp;
+    }
+    
+    void set_kernels(peel_kernel sampler, peel_kernel trait) {
+        sampler_kernel = sampler;
+        trait_kernel = trait;
+    }
+    
+    peel_kernel get_sampler_kernel() const {
+        return sampler_kernel;
+    }
+    
+    peel_kernel get_trait_kernel() const {
+        return trait_kernel;
+    }
 };
 
 class PeelingState {
@@ -116,6 +116,7 @@ class Person {
 
 	/* setters */
 	void set_internalid(unsigned int id) { internal_id = id; }
+	void set_pedigree(Pedigree* p) { ped = p; }
 	void set_maternalid(unsigned int id) { maternal_id = id; }
 	void set_paternalid(unsigned int id) { paternal_id = id; }
     
@@ -174,6 +175,12 @@ class Person {
     // pedigree construction / validation
 	bool mendelian_errors() const ;
 	void fill_in_relationships();
+
+    // children and mates point into the pedigree, see Pedigree(const Pedigree&)
+    void clear_relationships() {
+        children.clear();
+        mates.clear();
+    }
     
 	// so I can sort, I don't care for a specific (strong) ordering, 
 	// I just want all the founders first
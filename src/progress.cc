@@ -17,6 +17,10 @@ Progress::Progress(string s, unsigned int increments) :
 }
 
 void Progress::update_progress() {
+    // nothing to do (e.g. resuming a run that had already finished) counts as
+    // done, also avoids 0/0 which traps with floating point exceptions enabled
+    double fraction = (increments_total == 0) ? 1.0 : (increments_count / double(increments_total));
+
     /*
     printf("\r%s%s %.1f%% %s", 
         PROGRESS_COLOUR, 
@@ -26,7 +30,7 @@ void Progress::update_progress() {
     */
     printf("\r%s %.1f%%", 
         label.c_str(), 
-        (increments_count / double(increments_total)) * 100);
+        fraction * 100);
     fflush(stdout);
 }
 
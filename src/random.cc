@@ -1,4 +1,6 @@
 #include <cstdio>
+#include <cstring>
+#include <vector>
 #include <iostream>
 #include <fstream>
 
@@ -13,6 +15,9 @@ using namespace std;
 
 const gsl_rng_type* T;
 gsl_rng** r;
+int num_generators = 0;
+vector<int> random_team_first;
+vector<int> random_team_sizes;
 
 
 void init_random() {    
@@ -21,9 +26,10 @@ void init_random() {
     T = gsl_rng_default;
     //r = gsl_rng_alloc (T);
     
-    r = new gsl_rng*[get_max_threads()];
+    num_generators = get_max_threads();
+    r = new gsl_rng*[num_generators];
     
-    for(int i = 0; i < get_max_threads(); ++i) {
+    for(int i = 0; i < num_generators; ++i) {
         r[i] = gsl_rng_alloc(T);
     }
 }
@@ -31,7 +37,7 @@ void init_random() {
 void destroy_random() {
     //gsl_rng_free(r);
     
-    for(int i = 0; i < get_max_threads(); ++i) {
+    for(int i = 0; i < num_generators; ++i) {
         gsl_rng_free(r[i]);
     }
     
@@ -90,11 +96,96 @@ void seed_random_implicit() {
     printf("generator type: %s\n", gsl_rng_name(r[0]));
 }
 
+// when independent runs are executed concurrently each run has its own
+// team of threads nested inside the outer team, so thread numbers are only
+// unique within a team. the generators are divided up between the teams in
+// blocks of the size of each team, code running directly in the outer team
+// uses the first generator of its block
+void set_random_teams(const vector<int>& sizes) {
+    int first = 0;
+
+    random_team_first.clear();
+    random_team_sizes = sizes;
+
+    for(unsigned int i = 0; i < sizes.size(); ++i) {
+        random_team_first.push_back(first);
+        first += sizes[i];
+    }
+
+    if(first > num_generators) {
+        fprintf(stderr, "error: %d threads in teams, but only %d random number generators (%s:%d)\n", first, num_generators, __FILE__, __LINE__);
+        abort();
+    }
+}
+
+// teams of equal size, zero means the threads are not divided into teams
+void set_random_team_size(int size) {
+    vector<int> sizes;
+
+    if(size != 0) {
+        sizes.assign(num_generators / size, size);
+    }
+
+    set_random_teams(sizes);
+}
+
+static inline int get_random_index() {
+    if(random_team_first.empty()) {
+        return get_thread_num();
+    }
+
+    return random_team_first[get_ancestor_thread_num(1)] + ((get_level() > 1) ? get_thread_num() : 0);
+}
+
 double get_random() {
-    return gsl_rng_uniform(r[get_thread_num()]);
+    return gsl_rng_uniform(r[get_random_index()]);
 }
 
 int get_random_int(int limit) {
-    return gsl_rng_uniform_int(r[get_thread_num()], limit);
+    return gsl_rng_uniform_int(r[get_random_index()], limit);
 }
 
+
+// the block of generators used by the current team (see set_random_teams)
+static void get_random_block(int& first, int& n) {
+    if(random_team_first.empty()) {
+        first = 0;
+        n = num_generators;
+        return;
+    }
+
+    first = random_team_first[get_ancestor_thread_num(1)];
+    n = random_team_sizes[get_ancestor_thread_num(1)];
+}
+
+void get_random_state(vector<char>& state) {
+    int first, n;
+
+    get_random_block(first, n);
+
+    state.clear();
+
+    for(int i = first; i < (first + n); ++i) {
+        char* tmp = static_cast<char*>(gsl_rng_state(r[i]));
+        state.insert(state.end(), tmp, tmp + gsl_rng_size(r[i]));
+    }
+}
+
+bool set_random_state(vector<char>& state) {
+    int first, n;
+
+    get_random_block(first, n);
+
+    if(state.size() != (n * gsl_rng_size(r[0]))) {
+        return false;
+    }
+
+    char* tmp = &state[0];
+
+    for(int i = first; i < (first + n); ++i) {
+        memcpy(gsl_rng_state(r[i]), tmp, gsl_rng_size(r[i]));
+        tmp += gsl_rng_size(r[i]);
+    }
+
+    return true;
+}
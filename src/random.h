@@ -3,14 +3,32 @@
 
 using namespace std;
 
+#include <cstddef>
+#include <vector>
+
 void init_random();
 void destroy_random();
 
 void seed_random_explicit(string filename);
 void seed_random_implicit();
+void set_random_teams(const vector<int>& sizes);
+void set_random_team_size(int size);
 
 double get_random();
 int get_random_int(int limit);
 
+// the states of the generators belonging to the current team, so that
+// a chain can be checkpointed and carry on with the same random numbers
+void get_random_state(vector<char>& state);
+bool set_random_state(vector<char>& state);
+
+// for random_shuffle, so shuffles come from the same generators as
+// everything else rather than rand()
+struct RandomInt {
+    ptrdiff_t operator()(ptrdiff_t limit) {
+        return get_random_int(limit);
+    }
+};
+
 #endif
 
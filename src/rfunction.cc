@@ -17,30 +17,30 @@ Rfunction::Rfunction(Pedigree* p, GeneticMap* m, unsigned int locus, PeelOperati
     map(m),
     ped(p),
     offset(0),
-    pmatrix(po->get_cutset_size(), NUM_ALLELES),
-    pmatrix_presum(po->get_cutset_size() + 1, NUM_ALLELES),
+    pmatrix(po->get_max_matrix_size()),
+    pmatrix_presum(po->get_max_matrix_size() * NUM_ALLELES),
     peel(po), 
     previous_rfunctions(previous),
     locus(locus),
-    indices(peel->get_index_values()),
     valid_indices(peel->get_matrix_indices(locus)),
     valid_lod_indices(peel->get_lod_indices()),
-    index_offset(1 << (2 * peel->get_cutset_size())),
-    size(pow((double)NUM_ALLELES, (int)peel->get_cutset_size())),
+    prev_positions(peel->get_prev_positions(locus)),
+    lod_prev_positions(peel->get_lod_prev_positions()),
+    gather(prev_positions),
     peel_id(peel->get_peelnode()),
+    maternal_shift(0),
+    paternal_shift(0),
+    child_shifts(),
+    partner_shifts(),
+    kernel(NULL),
+    prev_data(),
     theta(0.0),
     antitheta(1.0),
     theta2(0.0),
     antitheta2(1.0),
     sex_linked(sex_linked) {
     
-    pmatrix.set_keys(peel->get_cutset());
-          
-    // XXX temporary, neater way of doing this?
-    vector<unsigned> tmp(peel->get_cutset());
-    tmp.push_back(peel->get_peelnode());
-    
-    pmatrix_presum.set_keys(tmp);      
+    find_cutset_shifts();
 }
 
 Rfunction::Rfunction(const Rfunction& rhs) :
@@ -52,12 +52,18 @@ Rfunction::Rfunction(const Rfunction& rhs) :
     peel(rhs.peel),
     previous_rfunctions(rhs.previous_rfunctions),
     locus(rhs.locus),
-    indices(rhs.indices),
     valid_indices(rhs.valid_indices),
     valid_lod_indices(rhs.valid_lod_indices),
-    index_offset(rhs.index_offset),
-    size(rhs.size),
+    prev_positions(rhs.prev_positions),
+    lod_prev_positions(rhs.lod_prev_positions),
+    gather(rhs.gather),
     peel_id(rhs.peel_id),
+    maternal_shift(rhs.maternal_shift),
+    paternal_shift(rhs.paternal_shift),
+    child_shifts(rhs.child_shifts),
+    partner_shifts(rhs.partner_shifts),
+    kernel(rhs.kernel),
+    prev_data(),
     theta(rhs.theta),
     antitheta(rhs.antitheta),
     theta2(rhs.theta2),
@@ -75,12 +81,17 @@ Rfunction& Rfunction::operator=(const Rfunction& rhs) {
         offset = rhs.offset;
         previous_rfunctions = rhs.previous_rfunctions;
         locus = rhs.locus;
-        indices = rhs.indices;
         valid_indices = rhs.valid_indices;
         valid_lod_indices = rhs.valid_lod_indices;
-        index_offset = rhs.index_offset;
-        size = rhs.size;
+        prev_positions = rhs.prev_positions;
+        lod_prev_positions = rhs.lod_prev_positions;
+        gather = rhs.gather;
         peel_id = rhs.peel_id;
+        maternal_shift = rhs.maternal_shift;
+        paternal_shift = rhs.paternal_shift;
+        child_shifts = rhs.child_shifts;
+        partner_shifts = rhs.partner_shifts;
+        kernel = rhs.kernel;
         theta = rhs.theta;
         antitheta = rhs.antitheta;
         theta2 = rhs.theta2;
@@ -91,6 +102,27 @@ Rfunction& Rfunction::operator=(const Rfunction& rhs) {
     return *this;
 }
 
+void Rfunction::find_cutset_shifts() {
+    
+    if(peel->get_type() == CHILD_PEEL) {
+        Person* kid = ped->get_by_index(peel_id);
+        
+        maternal_shift = peel->get_cutnode_shift(kid->get_maternalid());
+        paternal_shift = peel->get_cutnode_shift(kid->get_paternalid());
+    }
+    else if(peel->get_type() == PARENT_PEEL) {
+        vector<unsigned int>& kids = peel->get_children();
+        
+        for(unsigned int i = 0; i < kids.size(); ++i) {
+            Person* child = ped->get_by_index(kids[i]);
+            unsigned int partner = (child->get_maternalid() == peel_id) ? child->get_paternalid() : child->get_maternalid();
+            
+            child_shifts.push_back(peel->get_cutnode_shift(kids[i]));
+            partner_shifts.push_back(peel->get_cutnode_shift(partner));
+        }
+    }
+}
+
 enum phased_trait Rfunction::get_phased_trait(enum phased_trait m, enum phased_trait p, 
                                                    int maternal_allele, int paternal_allele, enum sex child_sex) {
                                                    
@@ -112,57 +144,6 @@ enum phased_trait Rfunction::get_phased_trait(enum phased_trait m, enum phased_t
     return pt;
 }
 
-// this function is the same for Traits and Sampling
-void Rfunction::evaluate_partner_peel(unsigned int pmatrix_index) {
-    double tmp = 0.0;
-    double total = 0.0;
-    
-    unsigned int presum_index;
-    
-    
-    for(unsigned i = 0; i < 4; ++i) {
-        presum_index = pmatrix_index + (index_offset * i);
-        
-        indices[pmatrix_index][peel_id] = i;
-        
-        tmp = trait_cache[i];
-        if(tmp == 0.0)
-            continue;
-        
-        for(unsigned int j = 0; j < previous_rfunctions.size(); ++j) {
-            tmp *= previous_rfunctions[j]->get(indices[pmatrix_index]);
-        }
-        
-        pmatrix_presum.set(presum_index, tmp);
-        
-        total += tmp;
-    }
-    
-    pmatrix.set(pmatrix_index, total);
-}
-
-void Rfunction::evaluate_element(unsigned int pmatrix_index, DescentGraph* dg) {
-    switch(peel->get_type()) {
-        
-        case CHILD_PEEL :
-            evaluate_child_peel(pmatrix_index, dg);
-            break;
-            
-        case PARTNER_PEEL :
-        case LAST_PEEL :
-            evaluate_partner_peel(pmatrix_index);
-            break;
-        
-        case PARENT_PEEL :
-            evaluate_parent_peel(pmatrix_index, dg);
-            break;
-        
-        default :
-            fprintf(stderr, "error: default should never be reached! (%s:%d)\n", __FILE__, __LINE__);
-            abort();
-    }
-}
-
 bool Rfunction::legal_genotype(unsigned personid, enum phased_trait g) {
     Person* p = ped->get_by_index(personid);
     
@@ -170,8 +151,6 @@ bool Rfunction::legal_genotype(unsigned personid, enum phased_trait g) {
 }
 
 void Rfunction::evaluate(DescentGraph* dg, unsigned int offset) {
-    //pmatrix.reset();
-    //pmatrix_presum.reset();
     
     // transmission probability cache
     preevaluate_init(dg);
@@ -181,20 +160,51 @@ void Rfunction::evaluate(DescentGraph* dg, unsigned int offset) {
     
     //#pragma omp parallel for
     
-    // calculate lod score
-    if(offset != 0) {
-        //for(unsigned int i = 0; i < size; ++i) {
-        for(unsigned int i = 0; i < valid_lod_indices->size(); ++i) {
-            evaluate_element((*valid_lod_indices)[i], dg);
-        }
+    // calculate lod score (offset != 0) or run the locus sampler 
+    // (only for the SamplerRfunction at the moment)
+    vector<int>& elements = (offset != 0) ? *valid_lod_indices : *valid_indices;
+    
+    gather = (offset != 0) ? lod_prev_positions : prev_positions;
+    
+    // only the elements being evaluated are stored, every one of them is 
+    // written to pmatrix, but not for every value of the peelnode in the presum
+    pmatrix.resize(elements.size());
+    pmatrix_presum.resize(elements.size() * NUM_ALLELES);
+    pmatrix_presum.reset();
+    
+    if(kernel != NULL) {
+        evaluate_compiled(elements, dg);
     }
-    // running locus sampler
     else {
-        // this is only for the SamplerRfunction at the moment
-        for(unsigned int i = 0; i < valid_indices->size(); ++i) {
-            evaluate_element((*valid_indices)[i], dg);
-        }
+        evaluate_elements(elements, dg);
+    }
+}
+
+// the same as evaluate_elements(), but using the straight-line code from 
+// PeelCodeGenerator, the subclass fills in its transmission or 
+// recombination tables
+void Rfunction::evaluate_compiled(vector<int>& elements, DescentGraph* dg) {
+    struct peel_kernel_args args;
+    
+    prev_data.resize(previous_rfunctions.size());
+    
+    for(unsigned int j = 0; j < previous_rfunctions.size(); ++j) {
+        prev_data[j] = previous_rfunctions[j]->pmatrix.get_data();
     }
+    
+    args.elements = elements.empty() ? NULL : &elements[0];
+    args.count = elements.size();
+    args.trait_cache = trait_cache;
+    args.transmission = NULL;
+    args.recombination = NULL;
+    args.previous = prev_data.empty() ? NULL : &prev_data[0];
+    args.gather = gather->empty() ? NULL : &(*gather)[0];
+    args.pmatrix = pmatrix.get_data();
+    args.presum = pmatrix_presum.get_data();
+    
+    kernel_tables(args, dg);
+    
+    kernel(&args);
 }
 
 void Rfunction::normalise(double* p) {
@@ -3,6 +3,8 @@
 
 using namespace std;
 
+#include <cstdio>
+#include <cstdlib>
 #include <vector>
 
 #include "types.h"
@@ -29,12 +31,18 @@ class Rfunction {
     PeelOperation* peel;
     vector<Rfunction*> previous_rfunctions;
     unsigned int locus;
-    vector<vector<int> > indices;
     vector<int>* valid_indices;
     vector<int>* valid_lod_indices;
-    unsigned int index_offset;
-    unsigned int size;
+    vector<int>* prev_positions;
+    vector<int>* lod_prev_positions;
+    vector<int>* gather;                    // one of the above, see evaluate()
     unsigned int peel_id;
+    unsigned int maternal_shift;            // child peel, where the parents are in a matrix index
+    unsigned int paternal_shift;
+    vector<unsigned int> child_shifts;      // parent peel, where each of peel->get_children()
+    vector<unsigned int> partner_shifts;    // and their other parent are in a matrix index
+    peel_kernel kernel;                     // set by subclasses if this peel has been compiled
+    vector<const double*> prev_data;
     double theta;
     double antitheta;
     double theta2;
@@ -106,15 +114,134 @@ class Rfunction {
         abort();
     }
     
+    // traits are decoded from the matrix index, see PeelOperation::get_cutnode_shift()
+    inline enum phased_trait get_cutset_trait(unsigned int pmatrix_index, unsigned int shift) {
+        return static_cast<enum phased_trait>((pmatrix_index >> shift) & 3);
+    }
+    
+    // multiply element 'position' by each previous function with the peelnode 
+    // set to 'value', see PeelSequenceGenerator::find_prev_positions(), elements
+    // that are not in a previous function are zero there, NPREV is the number 
+    // of previous functions or -1 if it is only known at runtime
+    template<int NPREV>
+    inline double multiply_previous(double tmp, unsigned int position, unsigned int value) {
+        const unsigned int num_prev = (NPREV < 0) ? previous_rfunctions.size() : NPREV;
+        
+        if(num_prev == 0)
+            return tmp;
+        
+        const int* positions = &(*gather)[((position * NUM_ALLELES) + value) * num_prev];
+        
+        for(unsigned int j = 0; j < num_prev; ++j) {
+            if(positions[j] < 0)
+                return 0.0;
+            
+            tmp *= previous_rfunctions[j]->get(positions[j]);
+        }
+        
+        return tmp;
+    }
+    
+    // this is the same for Traits and Sampling
+    template<int NPREV>
+    void evaluate_partner_peel(unsigned int position) {
+        double tmp = 0.0;
+        double total = 0.0;
+        
+        
+        for(unsigned i = 0; i < 4; ++i) {
+            tmp = trait_cache[i];
+            if(tmp == 0.0)
+                continue;
+            
+            tmp = multiply_previous<NPREV>(tmp, position, i);
+            
+            pmatrix_presum.set((position * NUM_ALLELES) + i, tmp);
+            
+            total += tmp;
+        }
+        
+        pmatrix.set(position, total);
+    }
+    
+    // R is the subclass providing evaluate_child_peel<NPREV>() and 
+    // evaluate_parent_peel<NPREV>(), the peel type and the number of previous 
+    // functions are only looked at once per evaluate() so every loop in the 
+    // kernel, except over a parent's children, has a compile-time trip count
+    //
+    // element i is stored at position i of pmatrix and the traits of the 
+    // cutset are decoded from its matrix index, elements[i]
+    template<class R, enum peeloperation TYPE, int NPREV>
+    void evaluate_kernel(vector<int>& elements, DescentGraph* dg) {
+        R* r = static_cast<R*>(this);
+        
+        for(unsigned int i = 0; i < elements.size(); ++i) {
+            switch(TYPE) {
+                case CHILD_PEEL :
+                    r->template evaluate_child_peel<NPREV>(i, elements[i], dg);
+                    break;
+                case PARENT_PEEL :
+                    r->template evaluate_parent_peel<NPREV>(i, elements[i], dg);
+                    break;
+                default :
+                    evaluate_partner_peel<NPREV>(i);
+                    break;
+            }
+        }
+    }
+    
+    template<class R, enum peeloperation TYPE>
+    void evaluate_kernel(vector<int>& elements, DescentGraph* dg) {
+        switch(previous_rfunctions.size()) {
+            case 0 :
+                evaluate_kernel<R, TYPE, 0>(elements, dg);
+                break;
+            case 1 :
+                evaluate_kernel<R, TYPE, 1>(elements, dg);
+                break;
+            case 2 :
+                evaluate_kernel<R, TYPE, 2>(elements, dg);
+                break;
+            case 3 :
+                evaluate_kernel<R, TYPE, 3>(elements, dg);
+                break;
+            default :
+                evaluate_kernel<R, TYPE, -1>(elements, dg);
+                break;
+        }
+    }
+    
+    template<class R>
+    void evaluate_kernel(vector<int>& elements, DescentGraph* dg) {
+        switch(peel->get_type()) {
+            case CHILD_PEEL :
+                evaluate_kernel<R, CHILD_PEEL>(elements, dg);
+                break;
+            
+            case PARTNER_PEEL :
+            case LAST_PEEL :
+                evaluate_kernel<R, PARTNER_PEEL>(elements, dg);
+                break;
+            
+            case PARENT_PEEL :
+                evaluate_kernel<R, PARENT_PEEL>(elements, dg);
+                break;
+            
+            default :
+                fprintf(stderr, "error: default should never be reached! (%s:%d)\n", __FILE__, __LINE__);
+                abort();
+        }
+    }
+    
         
  private :
     bool legal_genotype(unsigned personid, enum phased_trait g);
+    void find_cutset_shifts();
     virtual void preevaluate_init(DescentGraph* dg)=0;
     virtual double get_trait_probability(unsigned person_id, enum phased_trait pt)=0;
-    virtual void evaluate_child_peel(unsigned int pmatrix_index, DescentGraph* dg)=0;
-    virtual void evaluate_parent_peel(unsigned int pmatrix_index, DescentGraph* dg)=0;
-    void evaluate_partner_peel(unsigned int pmatrix_index);
-    void evaluate_element(unsigned int pmatrix_index, DescentGraph* dg);
+    virtual void evaluate_elements(vector<int>& elements, DescentGraph* dg)=0;
+    virtual void kernel_tables(struct peel_kernel_args& args, DescentGraph* dg)=0;
+    void evaluate_compiled(vector<int>& elements, DescentGraph* dg);
 
  public :
     Rfunction(Pedigree* p, GeneticMap* m, unsigned int locus, PeelOperation* po, vector<Rfunction*> previous, bool sex_linked);
@@ -122,7 +249,7 @@ class Rfunction {
     Rfunction& operator=(const Rfunction& rhs);
     virtual ~Rfunction() {}
     
-    double get(vector<int>& index) {
+    double get(unsigned int index) {
         return pmatrix.get(index);
     }
     
@@ -1,5 +1,6 @@
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
 
 #include "sampler_rfunction.h"
 #include "descent_graph.h"
@@ -156,12 +157,25 @@ void SamplerRfunction::get_recombination_distribution(DescentGraph* dg,
     
 }
 
+// the cutset has already been sampled, so find where its assignment is in 
+// valid_indices (which is sorted) to get the presum elements
 void SamplerRfunction::sample(vector<int>& pmk) {
-    double prob_dist[4];
+    double prob_dist[4] = { 0.0, 0.0, 0.0, 0.0 };
+    vector<unsigned int>& cutset = peel->get_cutset();
+    int index = 0;
     
-    for(unsigned i = 0; i < 4; ++i) {
-        pmk[peel_id] = i;
-        prob_dist[i] = pmatrix_presum.get(pmk);        
+    for(unsigned i = 0; i < cutset.size(); ++i) {
+        index += pmk[cutset[i]] << (2 * i);
+    }
+    
+    vector<int>::iterator it = lower_bound(valid_indices->begin(), valid_indices->end(), index);
+    
+    if((it != valid_indices->end()) and (*it == index)) {
+        unsigned int position = it - valid_indices->begin();
+        
+        for(unsigned i = 0; i < 4; ++i) {
+            prob_dist[i] = pmatrix_presum.get((position * NUM_ALLELES) + i);
+        }
     }
     
     normalise(prob_dist);
@@ -187,11 +201,9 @@ void SamplerRfunction::sample(vector<int>& pmk) {
     pmk[peel_id] = last;
 }
 
-void SamplerRfunction::evaluate_child_peel(unsigned int pmatrix_index, DescentGraph* dg) {
+template<int NPREV>
+void SamplerRfunction::evaluate_child_peel(unsigned int position, unsigned int pmatrix_index, DescentGraph* dg) {
         
-    unsigned int presum_index;
-    Person* kid = ped->get_by_index(peel_id);    
-    
     enum phased_trait mat_trait;
     enum phased_trait pat_trait;
     enum phased_trait kid_trait;
@@ -200,14 +212,11 @@ void SamplerRfunction::evaluate_child_peel(unsigned int pmatrix_index, DescentGr
 
     dg->illegal(); // get rid of warning
     
-    mat_trait = static_cast<enum phased_trait>(indices[pmatrix_index][kid->get_maternalid()]);
-    pat_trait = static_cast<enum phased_trait>(indices[pmatrix_index][kid->get_paternalid()]);
+    mat_trait = get_cutset_trait(pmatrix_index, maternal_shift);
+    pat_trait = get_cutset_trait(pmatrix_index, paternal_shift);
     
     for(unsigned i = 0; i < 4; ++i) {
         kid_trait = static_cast<enum phased_trait>(i);
-        presum_index = pmatrix_index + (index_offset * i);
-
-        indices[pmatrix_index][peel_id] = i;
 
         tmp = trait_cache[i];
         if(tmp == 0.0)
@@ -215,16 +224,14 @@ void SamplerRfunction::evaluate_child_peel(unsigned int pmatrix_index, DescentGr
 
         tmp *= transmission[0][transmission_index(mat_trait, pat_trait, kid_trait)];
 
-        for(unsigned int j = 0; j < previous_rfunctions.size(); ++j) {
-            tmp *= previous_rfunctions[j]->get(indices[pmatrix_index]);
-        }
+        tmp = multiply_previous<NPREV>(tmp, position, i);
 
-        pmatrix_presum.set(presum_index, tmp);
+        pmatrix_presum.set((position * NUM_ALLELES) + i, tmp);
 
         total += tmp;
     }
 
-    pmatrix.set(pmatrix_index, total);
+    pmatrix.set(position, total);
 /*
     if(total == 0.0) {
         fprintf(stderr, "ERROR: evaluate child peel(%s) = ZERO\n", kid->get_id().c_str());
@@ -233,9 +240,8 @@ void SamplerRfunction::evaluate_child_peel(unsigned int pmatrix_index, DescentGr
 }
 
 #pragma GCC diagnostic ignored "-Wunused-parameter" // dg used moved due to optimisation
-void SamplerRfunction::evaluate_parent_peel(unsigned int pmatrix_index, DescentGraph* dg) {
-    
-    unsigned int presum_index;
+template<int NPREV>
+void SamplerRfunction::evaluate_parent_peel(unsigned int position, unsigned int pmatrix_index, DescentGraph* dg) {
     
     enum phased_trait kid_trait;
     enum phased_trait mat_trait;
@@ -246,17 +252,12 @@ void SamplerRfunction::evaluate_parent_peel(unsigned int pmatrix_index, DescentG
         
     for(unsigned int i = 0; i < 4; ++i) {
         mat_trait = pat_trait = static_cast<enum phased_trait>(i);
-        presum_index = pmatrix_index + (index_offset * i);
-        
-        indices[pmatrix_index][peel_id] = i;
         
         tmp = trait_cache[i];
         if(tmp == 0.0)
             continue;
         
-        for(unsigned int j = 0; j < previous_rfunctions.size(); ++j) {
-            tmp *= previous_rfunctions[j]->get(indices[pmatrix_index]);
-        }
+        tmp = multiply_previous<NPREV>(tmp, position, i);
         
         double child_prob = 1.0;
         
@@ -264,13 +265,13 @@ void SamplerRfunction::evaluate_parent_peel(unsigned int pmatrix_index, DescentG
             unsigned int child_id = children[c];
             Person* child = ped->get_by_index(child_id);
             
-            kid_trait = static_cast<enum phased_trait>(indices[pmatrix_index][child_id]);
+            kid_trait = get_cutset_trait(pmatrix_index, child_shifts[c]);
             
             if(child->get_maternalid() == peel_id) {
-                pat_trait = static_cast<enum phased_trait>(indices[pmatrix_index][child->get_paternalid()]);
+                pat_trait = get_cutset_trait(pmatrix_index, partner_shifts[c]);
             }
             else {
-                mat_trait = static_cast<enum phased_trait>(indices[pmatrix_index][child->get_maternalid()]);
+                mat_trait = get_cutset_trait(pmatrix_index, partner_shifts[c]);
             }
             
             child_prob *= transmission[c][transmission_index(mat_trait, pat_trait, kid_trait)];
@@ -278,12 +279,20 @@ void SamplerRfunction::evaluate_parent_peel(unsigned int pmatrix_index, DescentG
         
         tmp *= child_prob;
         
-        pmatrix_presum.set(presum_index, tmp);
+        pmatrix_presum.set((position * NUM_ALLELES) + i, tmp);
         
         total += tmp;
     }
     
-    pmatrix.set(pmatrix_index, total);
+    pmatrix.set(position, total);
+}
+
+void SamplerRfunction::evaluate_elements(vector<int>& elements, DescentGraph* dg) {
+    evaluate_kernel<SamplerRfunction>(elements, dg);
+}
+
+void SamplerRfunction::kernel_tables(struct peel_kernel_args& args, DescentGraph* dg) {
+    args.transmission = transmission.empty() ? NULL : &transmission[0];
 }
 
 void SamplerRfunction::setup_transmission_cache() {
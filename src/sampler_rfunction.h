@@ -25,8 +25,12 @@ class SamplerRfunction : public Rfunction {
     unsigned int transmission_index(enum phased_trait mat_trait, 
                                     enum phased_trait pat_trait, 
                                     enum phased_trait kid_trait);
-    void evaluate_child_peel(unsigned int pmatrix_index, DescentGraph* dg);
-    void evaluate_parent_peel(unsigned int pmatrix_index, DescentGraph* dg);
+    template<int NPREV> void evaluate_child_peel(unsigned int position, unsigned int pmatrix_index, DescentGraph* dg);
+    template<int NPREV> void evaluate_parent_peel(unsigned int position, unsigned int pmatrix_index, DescentGraph* dg);
+    void evaluate_elements(vector<int>& elements, DescentGraph* dg);
+    void kernel_tables(struct peel_kernel_args& args, DescentGraph* dg);
+    
+    friend class Rfunction; // Rfunction::evaluate_kernel()
     
     void preevaluate_init(DescentGraph* dg);
 
@@ -44,6 +48,8 @@ class SamplerRfunction : public Rfunction {
         for(int i = 0; i < 4; ++i) {
             trait_cache[i] = get_trait_probability(peel_id, static_cast<enum phased_trait>(i));
         }
+        
+        kernel = peel->get_sampler_kernel();
     }
     
     SamplerRfunction(const SamplerRfunction& rhs) :
@@ -106,9 +112,7 @@ class SamplerRfunction : public Rfunction {
         // XXX this is such a bad idea, it get changed all over the place!
         // but only one thread operates on each locus at a time...
         valid_indices = peel->get_matrix_indices(l);
-        
-        pmatrix.reset();
-        pmatrix_presum.reset();
+        prev_positions = peel->get_prev_positions(l);
     }
     
     void set_locus_minimal(unsigned int l) {
@@ -131,9 +135,7 @@ class SamplerRfunction : public Rfunction {
         // XXX this is such a bad idea, it get changed all over the place!
         // but only one thread operates on each locus at a time...
         valid_indices = peel->get_matrix_indices(l);
-        
-        pmatrix.reset();
-        pmatrix_presum.reset();
+        prev_positions = peel->get_prev_positions(l);
     }
 };
 
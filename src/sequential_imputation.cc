@@ -32,7 +32,7 @@ void SequentialImputation::run(DescentGraph& dg, int iterations) {
         p.increment();
         
         if(tmp_prob > best_prob) {
-            dg = tmp;
+            dg.swap(tmp);
             best_prob = tmp_prob;
         }
         
@@ -97,8 +97,9 @@ void SequentialImputation::parallel_run(DescentGraph& dg, int iterations) {
             }
         }
         
+        // the replicate that is swapped out is overwritten next time round
         if(index != -1) {
-            dg = *graphs[index];
+            dg.swap(*graphs[index]);
         }
     }
     
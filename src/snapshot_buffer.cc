@@ -0,0 +1,141 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <sched.h>
+
+#include "snapshot_buffer.h"
+#include "descent_graph.h"
+
+using namespace std;
+
+
+SnapshotBuffer::SnapshotBuffer(DescentGraph& dg, int size, bool drop_when_full) :
+    slots(),
+    drop_when_full(drop_when_full),
+    head(0),
+    tail(0),
+    finished(0),
+    dropped(0) {
+
+    if(size < 1) {
+        fprintf(stderr, "error: snapshot buffer must have at least one slot (%s:%d)\n", __FILE__, __LINE__);
+        abort();
+    }
+
+    for(int i = 0; i < size; ++i) {
+        slots.push_back(new DescentGraph(dg));
+    }
+}
+
+SnapshotBuffer::SnapshotBuffer(const SnapshotBuffer& rhs) :
+    slots(),
+    drop_when_full(rhs.drop_when_full),
+    head(rhs.head),
+    tail(rhs.tail),
+    finished(rhs.finished),
+    dropped(rhs.dropped) {
+
+    for(unsigned int i = 0; i < rhs.slots.size(); ++i) {
+        slots.push_back(new DescentGraph(*(rhs.slots[i])));
+    }
+}
+
+SnapshotBuffer::~SnapshotBuffer() {
+    for(unsigned int i = 0; i < slots.size(); ++i) {
+        delete slots[i];
+    }
+}
+
+SnapshotBuffer& SnapshotBuffer::operator=(const SnapshotBuffer& rhs) {
+    if(this != &rhs) {
+        for(unsigned int i = 0; i < slots.size(); ++i) {
+            delete slots[i];
+        }
+
+        slots.clear();
+        for(unsigned int i = 0; i < rhs.slots.size(); ++i) {
+            slots.push_back(new DescentGraph(*(rhs.slots[i])));
+        }
+
+        drop_when_full = rhs.drop_when_full;
+        head = rhs.head;
+        tail = rhs.tail;
+        finished = rhs.finished;
+        dropped = rhs.dropped;
+    }
+    return *this;
+}
+
+int SnapshotBuffer::read_counter(int* counter) {
+    int value;
+
+    #pragma omp atomic read
+    value = *counter;
+
+    // make sure the snapshot itself is not read before the counter
+    #pragma omp flush
+
+    return value;
+}
+
+void SnapshotBuffer::write_counter(int* counter, int value) {
+    // make sure the snapshot is complete before it is published
+    #pragma omp flush
+
+    #pragma omp atomic write
+    *counter = value;
+}
+
+// the two sides are in different thread teams, so there is no barrier
+// to wait at, give up the core to whoever we are waiting for
+void SnapshotBuffer::wait() {
+    sched_yield();
+}
+
+bool SnapshotBuffer::push(DescentGraph& dg) {
+    int size = slots.size();
+
+    while((tail - read_counter(&head)) == size) {
+        if(drop_when_full) {
+            ++dropped;
+            return false;
+        }
+
+        wait();
+    }
+
+    slots[tail % size]->copy_changed(dg);
+
+    write_counter(&tail, tail + 1);
+
+    return true;
+}
+
+void SnapshotBuffer::drain() {
+    while(read_counter(&head) != tail) {
+        wait();
+    }
+}
+
+void SnapshotBuffer::finish() {
+    write_counter(&finished, 1);
+}
+
+DescentGraph* SnapshotBuffer::front() {
+    while(read_counter(&tail) == head) {
+        // tail must be checked again after seeing finished, otherwise the
+        // last snapshot can be missed
+        if(read_counter(&finished) and (read_counter(&tail) == head)) {
+            return NULL;
+        }
+
+        wait();
+    }
+
+    return slots[head % slots.size()];
+}
+
+void SnapshotBuffer::pop() {
+    write_counter(&head, head + 1);
+}
+
@@ -0,0 +1,60 @@
+#ifndef LKG_SNAPSHOTBUFFER_H_
+#define LKG_SNAPSHOTBUFFER_H_
+
+using namespace std;
+
+#include <vector>
+
+class DescentGraph;
+
+
+// ring buffer of descent graph snapshots passed from the sampling threads to
+// the scoring threads so that lod scores can be calculated while the chain
+// keeps running
+//
+// there is exactly one producer (the thread that takes the snapshot) and one
+// consumer (the thread that hands the snapshot to the scoring team), so the
+// two counters are only ever written by one side each. when the buffer is
+// full the producer either waits for a free slot or drops the snapshot
+//
+// each slot keeps the graph it was last given, so a snapshot only copies the
+// loci that have changed since (see DescentGraph::copy_changed())
+class SnapshotBuffer {
+
+    vector<DescentGraph*> slots;
+    bool drop_when_full;
+    int head;       // number of snapshots removed by the consumer
+    int tail;       // number of snapshots added by the producer
+    int finished;
+    int dropped;
+
+    int read_counter(int* counter);
+    void write_counter(int* counter, int value);
+    void wait();
+
+ public :
+    SnapshotBuffer(DescentGraph& dg, int size, bool drop_when_full);
+    SnapshotBuffer(const SnapshotBuffer& rhs);
+    ~SnapshotBuffer();
+    SnapshotBuffer& operator=(const SnapshotBuffer& rhs);
+
+    // producer side, push() returns false if the snapshot was dropped
+    bool push(DescentGraph& dg);
+    void finish();
+
+    // producer side, waits until every snapshot pushed so far has been
+    // popped (ie: scored)
+    void drain();
+
+    // consumer side, front() waits for a snapshot and returns NULL once
+    // the producer has finished and the buffer is empty
+    DescentGraph* front();
+    void pop();
+
+    int num_dropped() const {
+        return dropped;
+    }
+};
+
+#endif
+
@@ -25,7 +25,8 @@ double TraitRfunction::get_trait_probability(unsigned person_id, enum phased_tra
     return (ped->get_by_index(person_id))->get_disease_prob(pt);
 }
 
-void TraitRfunction::evaluate_child_peel(unsigned int pmatrix_index, DescentGraph* dg) {
+template<int NPREV>
+void TraitRfunction::evaluate_child_peel(unsigned int position, unsigned int pmatrix_index, DescentGraph* dg) {
     Person* kid = ped->get_by_index(peel_id);
     
     enum phased_trait kid_trait;
@@ -40,8 +41,8 @@ void TraitRfunction::evaluate_child_peel(unsigned int pmatrix_index, DescentGrap
     double total = 0.0;
 
         
-    mat_trait = static_cast<enum phased_trait>(indices[pmatrix_index][kid->get_maternalid()]);
-    pat_trait = static_cast<enum phased_trait>(indices[pmatrix_index][kid->get_paternalid()]);
+    mat_trait = get_cutset_trait(pmatrix_index, maternal_shift);
+    pat_trait = get_cutset_trait(pmatrix_index, paternal_shift);
 
     // iterate over all descent graphs to determine child trait 
     // based on parents' traits
@@ -49,15 +50,11 @@ void TraitRfunction::evaluate_child_peel(unsigned int pmatrix_index, DescentGrap
         for(int j = 0; j < 2; ++j) {    // paternal
             kid_trait = get_phased_trait(mat_trait, pat_trait, i, j, child_gender);
 
-            indices[pmatrix_index][peel_id] = static_cast<int>(kid_trait);
-
             tmp = trait_cache[static_cast<int>(kid_trait)];
             if(tmp == 0.0)
                 continue;
 
-            for(unsigned int k = 0; k < previous_rfunctions.size(); ++k) {
-                tmp *= previous_rfunctions[k]->get(indices[pmatrix_index]);
-            }
+            tmp = multiply_previous<NPREV>(tmp, position, static_cast<int>(kid_trait));
 
             tmp *= (!dg ? trait_prob : trait_prob * get_recombination_probability(dg, peel_id, i, j));
 
@@ -65,10 +62,11 @@ void TraitRfunction::evaluate_child_peel(unsigned int pmatrix_index, DescentGrap
         }
     }
 
-    pmatrix.set(pmatrix_index, total);
+    pmatrix.set(position, total);
 }
 
-void TraitRfunction::evaluate_parent_peel(unsigned int pmatrix_index, DescentGraph* dg) {
+template<int NPREV>
+void TraitRfunction::evaluate_parent_peel(unsigned int position, unsigned int pmatrix_index, DescentGraph* dg) {
     enum phased_trait pivot_trait;
     enum phased_trait mat_trait;
     enum phased_trait pat_trait;
@@ -81,35 +79,30 @@ void TraitRfunction::evaluate_parent_peel(unsigned int pmatrix_index, DescentGra
     for(unsigned a = 0; a < 4; ++a) {
         mat_trait = pat_trait = static_cast<enum phased_trait>(a);
         
-        indices[pmatrix_index][peel_id] = a;
-        
         //tmp = get_trait_probability(peel_id, mat_trait);
         tmp = trait_cache[a];
         if(tmp == 0.0)
             continue;
         
-        for(unsigned int i = 0; i < previous_rfunctions.size(); ++i) {
-            tmp *= previous_rfunctions[i]->get(indices[pmatrix_index]);
-        }
+        tmp = multiply_previous<NPREV>(tmp, position, a);
         
         double child_prob = 1.0;
         
-        for(unsigned c = 0; c < peel->get_cutset_size(); ++c) {
-            unsigned int child_id = peel->get_cutnode(c);
-            enum phased_trait kid_trait = static_cast<enum phased_trait>(indices[pmatrix_index][child_id]);
+        vector<unsigned int>& kids = peel->get_children();
+        
+        for(unsigned c = 0; c < kids.size(); ++c) {
+            unsigned int child_id = kids[c];
+            enum phased_trait kid_trait = get_cutset_trait(pmatrix_index, child_shifts[c]);
             
             Person* child = ped->get_by_index(child_id);
-            
-            if(not child->is_parent(peel_id))
-                continue;
 
             enum sex child_gender = child->get_sex();
             
             if(child->get_maternalid() == peel_id) {
-                pat_trait = static_cast<enum phased_trait>(indices[pmatrix_index][child->get_paternalid()]);
+                pat_trait = get_cutset_trait(pmatrix_index, partner_shifts[c]);
             }
             else {
-                mat_trait = static_cast<enum phased_trait>(indices[pmatrix_index][child->get_maternalid()]);
+                mat_trait = get_cutset_trait(pmatrix_index, partner_shifts[c]);
             }
 
             double child_tmp = 0.0;
@@ -133,6 +126,40 @@ void TraitRfunction::evaluate_parent_peel(unsigned int pmatrix_index, DescentGra
         total += tmp;
     }
     
-    pmatrix.set(pmatrix_index, total);
+    pmatrix.set(position, total);
+}
+
+void TraitRfunction::evaluate_elements(vector<int>& elements, DescentGraph* dg) {
+    evaluate_kernel<TraitRfunction>(elements, dg);
+}
+
+// the per-child factors multiplied in by evaluate_child_peel() and 
+// evaluate_parent_peel(), as 4 values (maternal allele * 2 + paternal allele)
+// for each child
+void TraitRfunction::kernel_tables(struct peel_kernel_args& args, DescentGraph* dg) {
+    recombination.clear();
+    
+    if(peel->get_type() == CHILD_PEEL) {
+        add_recombination(dg, peel_id);
+    }
+    else if(peel->get_type() == PARENT_PEEL) {
+        vector<unsigned int>& kids = peel->get_children();
+        
+        for(unsigned int c = 0; c < kids.size(); ++c) {
+            add_recombination(dg, kids[c]);
+        }
+    }
+    
+    args.recombination = recombination.empty() ? NULL : &recombination[0];
+}
+
+void TraitRfunction::add_recombination(DescentGraph* dg, unsigned person_id) {
+    double trait_prob = sex_linked ? 0.5 : 0.25;
+    
+    for(int i = 0; i < 2; ++i) {        // maternal
+        for(int j = 0; j < 2; ++j) {    // paternal
+            recombination.push_back(!dg ? trait_prob : trait_prob * get_recombination_probability(dg, person_id, i, j));
+        }
+    }
 }
 
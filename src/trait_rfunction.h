@@ -10,26 +10,37 @@ using namespace std;
 
 class TraitRfunction : public Rfunction {
     
+    vector<double> recombination;   // see kernel_tables()
+    
     double get_recombination_probability(DescentGraph* dg, unsigned person_id, int maternal_allele, int paternal_allele);
     double get_trait_probability(unsigned person_id, enum phased_trait pt);
     
     #pragma GCC diagnostic ignored "-Wunused-parameter"
     void preevaluate_init(DescentGraph* dg) {}
 
-    void evaluate_child_peel(unsigned int pmatrix_index, DescentGraph* dg);
-    void evaluate_parent_peel(unsigned int pmatrix_index, DescentGraph* dg);
+    template<int NPREV> void evaluate_child_peel(unsigned int position, unsigned int pmatrix_index, DescentGraph* dg);
+    template<int NPREV> void evaluate_parent_peel(unsigned int position, unsigned int pmatrix_index, DescentGraph* dg);
+    void evaluate_elements(vector<int>& elements, DescentGraph* dg);
+    void kernel_tables(struct peel_kernel_args& args, DescentGraph* dg);
+    void add_recombination(DescentGraph* dg, unsigned person_id);
+    
+    friend class Rfunction; // Rfunction::evaluate_kernel()
     
  public :
     TraitRfunction(Pedigree* p, GeneticMap* m, unsigned int locus, PeelOperation* po, vector<Rfunction*> previous, bool sex_linked) : 
-        Rfunction(p, m, locus, po, previous, sex_linked) {
+        Rfunction(p, m, locus, po, previous, sex_linked),
+        recombination() {
         
         for(int i = 0; i < 4; ++i) {
             trait_cache[i] = get_trait_probability(peel_id, static_cast<enum phased_trait>(i));
         }
+        
+        kernel = peel->get_trait_kernel();
     }
     
     TraitRfunction(const TraitRfunction& rhs) :
-        Rfunction(rhs) {
+        Rfunction(rhs),
+        recombination() {
         
         for(int i = 0; i < 4; ++i) {
             trait_cache[i] = rhs.trait_cache[i]; //get_trait_probability(peel_id, static_cast<enum phased_trait>(i));
@@ -0,0 +1,104 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#include "tuning_cache.h"
+#include "pedigree.h"
+#include "person.h"
+
+using namespace std;
+
+
+// FNV-1a, it only has to tell configurations apart
+const unsigned int FNV_OFFSET_BASIS = 2166136261U;
+const unsigned int FNV_PRIME = 16777619U;
+
+TuningCache::TuningCache(const string& filename, Pedigree* ped, unsigned int num_markers, unsigned int num_threads) :
+    filename(filename),
+    key(FNV_OFFSET_BASIS) {
+
+    key = hash(key, ped->num_members());
+
+    for(unsigned int i = 0; i < ped->num_members(); ++i) {
+        Person* p = ped->get_by_index(i);
+
+        key = hash(key, p->get_maternalid());
+        key = hash(key, p->get_paternalid());
+        key = hash(key, static_cast<unsigned int>(p->get_sex()));
+        key = hash(key, p->istyped() ? 1 : 0);
+    }
+
+    key = hash(key, num_markers);
+    key = hash(key, num_threads);
+    key = hash(key, cpu_model());
+}
+
+unsigned int TuningCache::hash(unsigned int h, const string& s) {
+    for(unsigned int i = 0; i < s.size(); ++i) {
+        h ^= static_cast<unsigned char>(s[i]);
+        h *= FNV_PRIME;
+    }
+
+    return h;
+}
+
+unsigned int TuningCache::hash(unsigned int h, unsigned int value) {
+    for(unsigned int i = 0; i < sizeof(value); ++i) {
+        h ^= (value >> (8 * i)) & 0xff;
+        h *= FNV_PRIME;
+    }
+
+    return h;
+}
+
+string TuningCache::cpu_model() {
+    ifstream cpuinfo("/proc/cpuinfo");
+    string line;
+
+    while(getline(cpuinfo, line)) {
+        if(line.compare(0, 10, "model name") == 0) {
+            return line;
+        }
+    }
+
+    return "unknown";
+}
+
+bool TuningCache::lookup(int& num_lgroups) {
+    ifstream cache(filename.c_str());
+    unsigned int tmp_key;
+    int tmp_value;
+    bool found = false;
+
+    if(filename == "") {
+        return false;
+    }
+
+    while(cache >> hex >> tmp_key >> dec >> tmp_value) {
+        if(tmp_key == key) {
+            num_lgroups = tmp_value;
+            found = true;
+        }
+    }
+
+    return found;
+}
+
+void TuningCache::store(int num_lgroups) {
+    FILE* f;
+
+    if(filename == "") {
+        return;
+    }
+
+    if((f = fopen(filename.c_str(), "a")) == NULL) {
+        fprintf(stderr, "warning: could not write to tuning cache '%s'\n", filename.c_str());
+        return;
+    }
+
+    fprintf(f, "%08x %d\n", key, num_lgroups);
+    fclose(f);
+}
+
@@ -0,0 +1,49 @@
+#ifndef LKG_TUNINGCACHE_H_
+#define LKG_TUNINGCACHE_H_
+
+using namespace std;
+
+#include <string>
+
+class Pedigree;
+
+
+// on-disk cache of the number of lgroups picked by MarkovChain::optimal_num_lgroups
+//
+// the file is plain text with one "key value" pair per line, where the key is
+// a hash of everything the timing depends on: the pedigree structure, number
+// of markers, number of threads and the cpu model. later entries override
+// earlier ones, so storing a new value just appends to the file
+class TuningCache {
+
+    string filename;
+    unsigned int key;
+
+    static unsigned int hash(unsigned int h, const string& s);
+    static unsigned int hash(unsigned int h, unsigned int value);
+    static string cpu_model();
+
+ public :
+    TuningCache(const string& filename, Pedigree* ped, unsigned int num_markers, unsigned int num_threads);
+
+    TuningCache(const TuningCache& rhs) :
+        filename(rhs.filename),
+        key(rhs.key) {}
+
+    ~TuningCache() {}
+
+    TuningCache& operator=(const TuningCache& rhs) {
+        if(this != &rhs) {
+            filename = rhs.filename;
+            key = rhs.key;
+        }
+        return *this;
+    }
+
+    // returns false if there is no entry for this key (or no cache file)
+    bool lookup(int& num_lgroups);
+    void store(int num_lgroups);
+};
+
+#endif
+
@@ -32,6 +32,12 @@ enum affection {
     AFFECTED
 };
 
+// how the bits of a descent graph are ordered in memory, see DescentGraph
+enum graph_layout {
+    LOCUS_MAJOR,
+    MEIOSIS_MAJOR
+};
+
 enum simple_disease_model {
     AUTOSOMAL_RECESSIVE,
     AUTOSOMAL_DOMINANT
@@ -62,6 +68,13 @@ struct mcmc_options {
     int scoring_period;
     int mcmc_runs;
 
+    // convergence
+    bool autostop;
+    double rhat_threshold;
+    int min_ess;
+    double target_se;
+    int target_peaks;
+
     // coda
     bool coda_logging;
     string coda_prefix;
@@ -71,11 +84,25 @@ struct mcmc_options {
     int peelopt_iterations;
     
     double lsampler_prob;
+    double block_prob;          // meiosis block sampler, see MeiosisSampler
     
     // parallelism
     int thread_count;
     bool use_gpu;
+    bool use_pool;
+    int scoring_threads;
+    int snapshot_buffer;
+    bool snapshot_drop;
+    string tuning_cache;
+    bool online_tuning;
+    enum graph_layout graph_layout;
+    string codegen_dir;         // empty to use the generic rfunctions
     
+    // checkpointing
+    string checkpoint_prefix;
+    int checkpoint_period;
+    bool resume;
+
     // things precalculated or stored in files
     string peelseq_filename;
     string random_filename;
@@ -95,6 +122,7 @@ struct mcmc_options {
     int mc3;
     int mc3_number_of_chains;
     int mc3_exchange_period;
+    double mc3_exchange_target;
     vector<double> mc3_temperatures;
 
     mcmc_options() :
@@ -104,13 +132,30 @@ struct mcmc_options {
         si_iterations(DEFAULT_SEQUENTIALIMPUTATION_RUNS),
         scoring_period(DEFAULT_MCMC_SCORING_PERIOD),
         mcmc_runs(DEFAULT_MCMC_RUNS),
+        autostop(false),
+        rhat_threshold(DEFAULT_RHAT_THRESHOLD),
+        min_ess(DEFAULT_MIN_ESS),
+        target_se(0.0),
+        target_peaks(DEFAULT_TARGET_PEAKS),
         coda_logging(false),
         coda_prefix(DEFAULT_CODA_PREFIX),
         lodscores(DEFAULT_LODSCORES),
         peelopt_iterations(DEFAULT_PEELOPT_ITERATIONS),
         lsampler_prob(DEFAULT_LSAMPLER_PROB),
+        block_prob(DEFAULT_BLOCK_PROB),
         thread_count(DEFAULT_THREAD_COUNT),
         use_gpu(false),
+        use_pool(true),
+        scoring_threads(DEFAULT_SCORING_THREADS),
+        snapshot_buffer(DEFAULT_SNAPSHOT_BUFFER),
+        snapshot_drop(false),
+        tuning_cache(DEFAULT_TUNING_CACHE),
+        online_tuning(false),
+        graph_layout(LOCUS_MAJOR),
+        codegen_dir(""),
+        checkpoint_prefix(DEFAULT_CHECKPOINT_PREFIX),
+        checkpoint_period(0),
+        resume(false),
         peelseq_filename(""),
         random_filename(""),
         exchange_filename(""),
@@ -124,6 +169,7 @@ struct mcmc_options {
         mc3(false),
         mc3_number_of_chains(DEFAULT_MCMC_CHAINS), 
         mc3_exchange_period(DEFAULT_MCMC_EXCHANGE_PERIOD),
+        mc3_exchange_target(DEFAULT_MCMC_EXCHANGE_TARGET),
         mc3_temperatures() {}
 
     string debug_string() {
@@ -0,0 +1,55 @@
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include "worker_pool.h"
+#include "omp_facade.h"
+
+using namespace std;
+
+
+void WorkerPool::run_block(WorkerTask& task, int owner, int thread_num) {
+    int* next = &head[owner * PADDING];
+    int end = tail[owner * PADDING];
+    int index;
+
+    while(1) {
+        #pragma omp atomic capture
+        index = (*next)++;
+
+        if(index >= end)
+            break;
+
+        task(index, thread_num);
+    }
+}
+
+void WorkerPool::execute(WorkerTask& task, int num_items) {
+    int thread_num = get_thread_num();
+    int team_size = min(num_threads, get_num_threads());
+
+    if(thread_num >= num_threads) {
+        fprintf(stderr, "error: worker pool has %d threads, but was called from thread %d (%s:%d)\n",
+                num_threads, thread_num, __FILE__, __LINE__);
+        abort();
+    }
+
+    // the runtime is allowed to give us fewer threads than we asked for,
+    // so blocks are based on the size of the team that actually exists
+    head[thread_num * PADDING] = (num_items * thread_num) / team_size;
+    tail[thread_num * PADDING] = (num_items * (thread_num + 1)) / team_size;
+
+    #pragma omp barrier
+
+    run_block(task, thread_num, thread_num);
+
+    // steal from everyone else, starting with our neighbour so that
+    // thieves are spread out over the victims
+    for(int i = 1; i < team_size; ++i) {
+        run_block(task, (thread_num + i) % team_size, thread_num);
+    }
+
+    #pragma omp barrier
+}
+
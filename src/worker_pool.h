@@ -0,0 +1,67 @@
+#ifndef LKG_WORKERPOOL_H_
+#define LKG_WORKERPOOL_H_
+
+using namespace std;
+
+#include <vector>
+
+
+// a unit of work that can be run on any thread in the pool, thread_num
+// identifies which per-thread objects (LocusSampler, Peeler etc) to use
+class WorkerTask {
+ public :
+    virtual ~WorkerTask() {}
+    virtual void operator()(int index, int thread_num)=0;
+};
+
+// work-stealing scheduler for a persistent team of threads
+//
+// the pool does not create threads itself, instead every member of an
+// enclosing omp parallel region calls execute() with the same task, so
+// the team is only forked once per Markov chain rather than once per
+// sampling step. each thread starts with a contiguous block of the items
+// and when it runs out steals from the other threads' blocks
+class WorkerPool {
+
+    // counters are padded to avoid false sharing between threads
+    static const int PADDING = 16;
+
+    int num_threads;
+    vector<int> head;   // next unclaimed item in each thread's block
+    vector<int> tail;   // end of each thread's block
+
+    void run_block(WorkerTask& task, int owner, int thread_num);
+
+ public :
+    WorkerPool(int num_threads) :
+        num_threads(num_threads),
+        head(num_threads * PADDING, 0),
+        tail(num_threads * PADDING, 0) {}
+
+    WorkerPool(const WorkerPool& rhs) :
+        num_threads(rhs.num_threads),
+        head(rhs.head),
+        tail(rhs.tail) {}
+
+    ~WorkerPool() {}
+
+    WorkerPool& operator=(const WorkerPool& rhs) {
+        if(this != &rhs) {
+            num_threads = rhs.num_threads;
+            head = rhs.head;
+            tail = rhs.tail;
+        }
+        return *this;
+    }
+
+    int size() const {
+        return num_threads;
+    }
+
+    // must be called by all threads in the team, returns once every item
+    // in [0, num_items) has been processed (ie: it ends with a barrier)
+    void execute(WorkerTask& task, int num_items);
+};
+
+#endif
+